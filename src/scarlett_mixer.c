@@ -25,10 +25,24 @@
 #include <math.h>
 #include <string.h>
 #include <assert.h>
+#include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #include <alsa/asoundlib.h>
 
+#include "scarlettmixer_private.h"
+#include "trace.h"
+
 #define RTK_URI "http://gareus.org/oss/scarlettmixer#"
 #define RTK_GUI "ui"
 
@@ -36,168 +50,335 @@
 #define GD_CX 20.5
 #define GD_CY 15.5
 
-/* device specifics, see also
- * https://git.kernel.org/pub/scm/linux/kernel/git/torvalds/linux.git/tree/sound/usb/mixer_scarlett.c#n635
+/* gain automation, see automation_tick() */
+#define MAX_MOVES 64
+
+typedef enum {
+	CURVE_LIN,    //< linear in dB
+	CURVE_FADER,  //< linear in knob position
+	CURVE_SCURVE, //< cosine ease in/out, in dB
+} AutoCurve;
+
+typedef struct {
+	SmCtrl*    ctrl;
+	double    t_start;  //< sec, relative to timeline start
+	double    duration; //< sec
+	float     from;     //< dB, NAN: value when the move starts
+	float     to;       //< dB
+	AutoCurve curve;
+	bool      started;
+	bool      done;
+	bool      pending;  //< written value differs from curve
+	double    due;      //< deadline, time when the pending step became due
+	long      want;     //< whole dB
+	long      written;  //< whole dB
+} AutoMove;
+
+typedef struct {
+	AutoMove move[MAX_MOVES];
+	int      n_moves;
+	int64_t  t0;      //< monotonic usec of timeline start, 0: stopped
+	int64_t  t_last;  //< previous tick
+	double   budget;  //< max. control writes per second
+	double   tokens;
+	unsigned n_writes;
+	unsigned n_coalesced;
+} Automation;
+
+/* scene morphing, see morph_set() */
+typedef struct {
+	int16_t* db;  //< per control, whole dB
+	int16_t* val; //< per control, enum item, capture switch or mute state
+} Scene;
+
+typedef struct {
+	float    pos;  //< fader position at which the control changes
+	uint16_t slot; //< control index * 2, +1 for enum/switch value
+	int16_t  lo;   //< value below pos
+	int16_t  hi;   //< value at and above pos
+} MorphStep;
+
+typedef struct {
+	Scene      scene[2];
+	MorphStep* step;     //< sorted by pos
+	size_t     n_steps;
+	float      pos;      //< current fader position
+	float      flip;     //< position at which enum and switch controls change
+} Morph;
+
+/* Shared memory state export, see shm_update().
+ *
+ * Layout (native endian, fixed for SHM_VERSION): a ShmHeader followed by
+ * n_ctrl ShmCtrl entries in control order. Readers must use the seqlock:
+ *
+ *   do {
+ *     s0 = atomic_load_acquire (&hdr->seq);
+ *     if (s0 & 1) continue;        // update in progress
+ *     copy the values;
+ *     atomic_thread_fence_acquire ();
+ *   } while (atomic_load_relaxed (&hdr->seq) != s0);
  */
+#define SHM_MAGIC   0x584d4353 // "SCMX"
+#define SHM_VERSION 1
+#define SHM_NO_DB   INT32_MIN
 
-#define MAX_GAINS   10
-#define MAX_BUSSES  20
-#define MAX_HIZS    2
-#define MAX_PADS    4
-#define MAX_AIRS    2
+typedef struct {
+	char     name[48];
+	uint32_t caps; //< SM_CAP_* flags
+	int32_t  db;   //< gain, dB * 100, SHM_NO_DB: no gain
+	int32_t  val;  //< enum item, capture switch or mute (1: muted), -1: none
+	uint32_t pad;
+} ShmCtrl; // 64 bytes
 
 typedef struct {
-	char        name[64];
-	unsigned    smi;  //< mixer matrix inputs
-	unsigned    smo;  //< mixer matrix outputs
-	unsigned    sin;  //< inputs (capture select)
-	unsigned    sout; //< outputs assigns
-	unsigned    smst; //< main outputs (stereo gain controls w/mute =?= sout / 2)
-	unsigned    samo; //< aux outputs (mono gain controls w/o mute)
-
-	unsigned    num_hiz;
-	unsigned    num_pad;
-	unsigned    num_air;
-	bool        pads_are_switches;
-	bool        matrix_mix_column_major;
-	unsigned    matrix_mix_offset;
-	unsigned    matrix_mix_stride;
-	unsigned    matrix_in_offset;
-	unsigned    matrix_in_stride;
-	unsigned    input_offset;
-	int         out_gain_map[MAX_GAINS];
-	char        out_gain_labels[MAX_GAINS][16];
-	int         out_bus_map[MAX_BUSSES];
-	int         hiz_map[MAX_HIZS];
-	int         pad_map[MAX_PADS];
-	int         air_map[MAX_AIRS];
-} Device;
-
-static Device devices[] = {
-	{
-		.name = "Scarlett 18i6 USB",
-		.smi = 18, .smo = 6,
-		.sin = 18, .sout = 6,
-		.smst = 3,
-		.samo = 0,
-		.num_hiz = 2,
-		.num_pad = 0,
-		.num_air = 0,
-		.pads_are_switches = false,
-		.matrix_mix_column_major = false,
-		.matrix_mix_offset = 33, .matrix_mix_stride = 7,
-		.matrix_in_offset = 32, .matrix_in_stride = 7,
-		.input_offset = 14,
-		.out_gain_map = { 1 /* Monitor */, 4 /* Headphone */, 7 /* SPDIF */, -1, -1 , -1, -1, -1, -1, -1 }, // PBS
-		.out_gain_labels = { "Monitor", "Headphone", "SPDIF", "", "", "", "", "", "", "" },
-		.out_bus_map = { 2, 3, 5, 6, 8, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 }, // Source, ENUM
-		.hiz_map = { 12, 13 },
-		.pad_map = { -1, -1, -1, -1 },
-	},
-	{
-		.name = "Scarlett 18i8 USB",
-		.smi = 18, .smo = 8,
-		.sin = 18, .sout = 8,
-		.smst = 4,
-		.samo = 0,
-		.num_hiz = 2,
-		.num_pad = 4,
-		.num_air = 0,
-		.pads_are_switches = false,
-		.matrix_mix_column_major = false,
-		.matrix_mix_offset = 40, .matrix_mix_stride = 9, // < Matrix 01 Mix A
-		.matrix_in_offset = 39, .matrix_in_stride = 9,   // Matrix 01 Input, ENUM
-		.input_offset = 20,   // < Input Source 01, ENUM
-		.out_gain_map = { 1 /* Monitor */, 4 /* Headphone 1 */, 7 /* Headphone 2 */, 10 /* SPDIF */, -1, -1 , -1, -1, -1, -1 },
-		.out_gain_labels = { "Monitor", "Headphone 1", "Headphone 2", "SPDIF", "", "", "", "", "", "" },
-		.out_bus_map = { 2, 3, 5, 6, 8, 9, 11, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
-		.hiz_map = { 15, 17 }, // < Input 1 Impedance, ENUM,  Input 2 Impedance, ENUM
-		.pad_map = { 16, 18, 19, 20 },
-	},
-	{
-		.name = "Scarlett 6i6 USB",
-		.smi = 6, .smo = 6,
-		.sin = 6, .sout = 6,
-		.smst = 3,
-		.samo = 0,
-		.num_hiz = 2,
-		.num_pad = 4, // XXX does the device have pad? bug in kernel-driver?
-		.num_air = 0,
-		.pads_are_switches = false,
-		.matrix_mix_column_major = false,
-		.matrix_mix_offset = 26, .matrix_mix_stride = 9, // XXX stride should be 7, bug in kernel-driver ?!
-		.matrix_in_offset = 25, .matrix_in_stride = 9,   // XXX stride should be 7, bug in kernel-driver ?!
-		.out_gain_map = { 1 /* Monitor */, 4 /* Headphone */, 7 /* SPDIF */, -1, -1, -1 , -1, -1, -1, -1 },
-		.out_gain_labels = { "Monitor", "Headphone", "SPDIF", "", "", "", "", "", "", "" },
-		.out_bus_map = { 2, 3, 5, 6, 8, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
-		.input_offset = 18,
-		.hiz_map = { 12, 14 },
-		.pad_map = { 13, 15, 16, 17 },
-	},
-	{
-		.name = "Scarlett 18i20 USB",
-		.smi = 18, .smo = 8,
-		.sin = 18, .sout = 20,
-		.smst = 10,
-		.samo = 0,
-		.num_hiz = 0,
-		.num_pad = 0,
-		.num_air = 0,
-		.pads_are_switches = false,
-		.matrix_mix_column_major = false,
-		.matrix_mix_offset = 50, .matrix_mix_stride = 9,
-		.matrix_in_offset = 49, .matrix_in_stride = 9,
-		.input_offset = 31,
-		.out_gain_map = { 1, 7, 10, 13, 16, 19, 22, 25, 28, 2  },
-		.out_gain_labels = { "Monitor", "Line 3/4", "Line 5/6", "Line 7/8", "Line 9/10" , "SPDIF", "ADAT 1/2", "ADAT 3/4", "ADAT 5/6", "ADAT 7/8" },
-		.out_bus_map = { 5, 6, 8, 9, 11, 12, 14, 15, 17, 18, 20, 21, 23, 24, 26, 27, 29, 30, 3, 4 },
-		.hiz_map = { -1, -1 },
-		.pad_map = { -1, -1, -1, -1 },
-	},
-	{
-		.name = "Scarlett 8i6 USB",
-		.smi = 8, .smo = 8,
-		.sin = 10, .sout = 6,
-		.smst = 0,
-		.samo = 4,
-		.num_hiz = 2,
-		.num_pad = 2, 
-		.num_air = 2, 
-		.pads_are_switches = true,
-		.matrix_mix_column_major = true,
-		.matrix_mix_offset = 20, .matrix_mix_stride = 8,
-		.matrix_in_offset = 84, .matrix_in_stride = 1,
-		.out_gain_map = { 10 /* Headphone 1 */, 11, 12 /* Headphone 2 */, 13, -1, -1 , -1, -1, -1, -1 },
-		.out_gain_labels = { "Headphone 1L", "Headphone 1R", "Headphone 2L", "Headphone 2R", "SPDIF/L", "SPDIF/R", "", "", "", "" },
-		.out_bus_map = { 92, 93, 94, 95, 97, 98, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
-		.input_offset = 0,
-		.hiz_map = { 15, 18 },
-		.pad_map = { 16, 19, -1, -1 },
-		.air_map = { 14, 17 },
-	},
-};
+	uint32_t magic;
+	uint32_t version;
+	uint32_t n_ctrl;
+	uint32_t entry_size; //< sizeof (ShmCtrl)
+	uint32_t seq;        //< seqlock, odd while an update is in progress
+	uint32_t online;     //< device is connected
+	uint64_t generation; //< incremented with every update
+	char     device[64];
+	ShmCtrl  ctrl[];
+} ShmHeader;
+
+/* state journal, see journal_update() */
+#define JOURNAL_BUF 512
+
+typedef struct {
+	uint16_t slot;
+	int16_t  value;
+	uint32_t check; //< detects torn records, see journal_check()
+} JournalRecord;
+
+typedef struct {
+	int           fd;       //< log file, -1: disabled
+	char*         log;
+	char*         snapshot;
+	Scene         shadow;   //< last committed state
+	uint32_t      layout;   //< hash of control names
+	JournalRecord buf[JOURNAL_BUF];
+	unsigned      n_buf;
+	unsigned      n_log;    //< records in log since last checkpoint
+	int64_t       t_pending;    //< time of the oldest unsynced record, 0: none
+	int64_t       t_checkpoint;
+	unsigned      n_commits;
+} Journal;
+
+/* MIDI control surface, see midi_thread() */
+#define MIDI_MAP_MAX 128
+
+typedef struct {
+	unsigned int        numid;
+	unsigned int        count;
+	snd_ctl_elem_type_t type;
+	long                min;
+	long                max;
+	unsigned int        tlv[SM_TLV_MAX];
+	bool                mute; //< playback switch, inverted
+	uint16_t            slot;
+} MidiTarget;
+
+typedef struct {
+	bool       nrpn;
+	uint8_t    channel;
+	uint16_t   param;
+	MidiTarget t;
+	int        value; //< 14 bit
+	bool       dirty;
+	bool       written; //< by the MIDI thread, see midi_batch_flush()
+} MidiMap;
+
+typedef struct {
+	snd_seq_t*      seq;
+	int             queue; //< timestamps incoming events, real-time
+	snd_ctl_t*      ctl;  //< own handle, only used by the MIDI thread
+	char*           card; //< own copy of ui->card, protected by lock
+	pthread_t       thread;
+	pthread_mutex_t lock; //< map and learn target
+	volatile bool   run;
+	const char*     map_file;
+	MidiMap         map[MIDI_MAP_MAX];
+	int             n_map;
+	bool            map_modified;
+	MidiTarget      learn;
+	bool            learn_armed;
+	uint16_t        nrpn_param[16];
+	int             nrpn_msb[16];
+	/* statistics */
+	unsigned        n_events;
+	unsigned        n_writes;
+	unsigned        n_batches;
+	int64_t         lat_sum; //< usec, from the oldest event of a batch
+	int64_t         lat_max; //< usec
+} Midi;
+
+/* see batch_flush() */
+typedef struct {
+	int16_t*  want;   //< per slot, value to write
+	uint16_t* dirty;  //< list of slots to write
+	bool*     queued; //< per slot, slot is in dirty list
+	unsigned  n_dirty;
+} WriteBatch;
+
+/* adaptive write limits, see throttle_update() */
+typedef struct {
+	double   target;    //< usec, write latency goal (90th percentile)
+	double   rate;      //< max. batched writes per second
+	double   tokens;
+	unsigned batch;     //< max. writes per flush
+	double   automation_max; //< user's automation budget
+	uint32_t lat_p90;   //< usec, last observed
+	uint64_t n_seen;    //< SmWriteStats.n_writes at the last update
+	int64_t  t_last;    //< token refill
+	int64_t  t_next;    //< next adaptation
+	unsigned n_backoff;
+} Throttle;
+
+/* undo history, see history_record() */
+#define HISTORY_SIZE 1024
+
+typedef struct {
+	uint16_t slot;
+	int16_t  from;
+	int16_t  to;
+	uint16_t group; //< entries of a group are undone together
+} Delta;
+
+typedef struct {
+	Delta    d[HISTORY_SIZE];
+	unsigned head;   //< position of the next entry
+	unsigned n_undo; //< entries before head
+	unsigned n_redo; //< entries from head on
+	uint16_t group;
+	int      depth;  //< history_begin() nesting
+	int64_t  t_last; //< time of the last foldable change
+} History;
+
+/* active cross-points, see routes_update() */
+#define ROUTE_NONE 0xffff
 
-#define NUM_DEVICES     (sizeof (devices) / sizeof (devices[0]))
+typedef struct {
+	uint16_t* xp;      //< active cross-points (input * smo + mix), unordered
+	uint16_t* pos;     //< per cross-point: index in xp or ROUTE_NONE
+	uint16_t* ctrl_xp; //< per control: cross-point or ROUTE_NONE
+	unsigned  n;
+	bool      dirty;   //< changed since the list view was updated
+} Routes;
+
+/* matrix tile cache, see tiles_update() */
+#define MTX_TILE          4 // cross-points per tile, in each direction
+#define TILE_MAX_WORKERS  8
+
+typedef struct {
+	float cur;
+	int   click_state;
+	bool  sensitive;
+} DialSig; //< visible state of a dial, all mtx_dial_paint() draws from (hover excluded)
+
+typedef struct {
+	cairo_surface_t* sf;
+	unsigned int     r0, c0; //< first cross-point
+	unsigned int     nr, nc; //< size in cross-points
+	bool             dirty;
+} MtxTile;
+
+typedef struct {
+	MtxTile*  tile;
+	unsigned  n_tiles;
+	unsigned  n_cols;   //< tiles per row
+	DialSig*  sig;      //< per cross-point
+	cairo_surface_t** face; //< per cross-point, faceplate as rendered
+	unsigned* queue;    //< tile indices to render
+	float     scale;    //< widget scale the tiles were rendered at
+	bool      full;     //< the whole view is to be exposed, refresh tiles
+
+	pthread_t       thread[TILE_MAX_WORKERS];
+	unsigned        n_workers; //< 0: render on the GUI thread
+	pthread_mutex_t lock;
+	pthread_cond_t  work;
+	pthread_cond_t  done;
+	unsigned        n_jobs;
+	unsigned        next;
+	unsigned        n_busy;
+	bool            run;
+
+	/* frame-time */
+	uint64_t  n_frames;
+	uint64_t  n_rendered; //< tiles
+	int64_t   t_total;    //< usec
+	int64_t   t_max;
+} TileRender;
+
+/* pending GUI updates, see redraw_tick() */
+typedef struct {
+	unsigned int r0, r1; //< damaged inputs [r0, r1), none if r0 >= r1
+	unsigned int c0, c1; //< damaged mixes [c0, c1)
+	bool         other;  //< any control besides the matrix gains
+	bool         hidden;
+	int64_t      interval; //< usec, min. time between frames
+	int64_t      t_next;
+
+	uint64_t     n_invalidations; //< changed controls
+	uint64_t     n_frames;
+} Redraw;
+
+/* device opened in the background, see loader_poll() */
+typedef struct {
+	pthread_t     thread;
+	bool          threaded; //< thread was started, join it
+	SmMixer       sm;
+	const char*   card;
+	int           opts;
+	int           rv;       //< sm_open() result
+	bool          active;   //< result is pending
+	bool          done;     //< atomic, release: sm and rv are set
+	int64_t       t0;
+} Loader;
+
+/* metrics exporter connection, see metrics_serve() */
+#define METRICS_CLIENTS 4
 
 typedef struct {
-	snd_mixer_elem_t* elem;
-	char* name;
-} Mctrl;
+	int     fd;  //< -1: unused
+	char    req[1024];
+	size_t  n_req;
+	char*   out; //< response, NULL while reading the request
+	size_t  n_out;
+	size_t  sent;
+	int64_t t0;
+} MetricsClient;
 
 typedef struct {
 	RobWidget*      rw;
 	RobWidget*      matrix;
 	RobWidget*      output;
-	RobTkSelect**   mtx_sel;
-	RobTkDial**     mtx_gain;
-	RobTkLbl**      mtx_lbl;
+	RobTkSelect**   mtx_sel;  //< per visible row
+	RobTkDial**     mtx_gain; //< per visible cross-point, see mtx_xp()
+	RobTkLbl**      mtx_lbl;  //< per visible column
+
+	/* matrix view */
+	unsigned int    vp_rows;
+	unsigned int    vp_cols;
+	unsigned int    vp_r0;    //< first visible input
+	unsigned int    vp_c0;    //< first visible mix
+	RobTkScale*     vp_hscroll; //< NULL if all mixes are visible
+	RobTkScale*     vp_vscroll; //< NULL if all inputs are visible
+	float*          mtx_val;  //< knob value per cross-point
+	int*            mtx_src;  //< matrix input source per row
+	unsigned int    mtx_kernel;  //< index in mtx_kernels[]
+	uint16_t*       mtx_idx;     //< control per cross-point, generic kernel
+	uint16_t*       mtx_sel_idx; //< control per matrix row, generic kernel
 
 	RobTkSep*       sep_h;
 	RobTkSep*       sep_v;
 	RobTkSep*       spc_v[2];
 
-	RobTkLbl**      src_lbl;
-	RobTkSelect**   src_sel;
+	RobTkLbl**      src_lbl;  //< per visible capture input
+	RobTkSelect**   src_sel;  //< per visible capture input
+	unsigned int    cap_rows; //< capture inputs in view
+	unsigned int    cap_r0;   //< first visible capture input
+	int*            cap_src;  //< capture source per input
 
 	RobTkSelect**   out_sel;
 	RobTkLbl*       out_mst;
@@ -217,919 +398,4064 @@ typedef struct {
 
 	PangoFontDescription* font;
 	cairo_surface_t*      mtx_sf[6];
+	float                 mtx_sf_scale; //< widget scale the faceplate was rendered at
 
-	Device*      device;
-	Mctrl*       ctrl;
-	unsigned int ctrl_cnt;
-	snd_mixer_t* mixer;
+	SmMixer      sm;         //< device, ctrl table and alsa handles
+	SmArena      gui_arena;  //< widget tables, per GUI instance
 
 	int nfds;
 	struct pollfd* pollfds;
 	bool disable_signals;
+
+	/* hot-plug */
+	char*   card;
+	bool    card_auto;      //< card was autodetected, re-lookup on re-attach
+	int     opts;
+	int64_t reconnect_next; //< monotonic usec of next presence check
+	int     reconnect_cnt;
+
+	/* instant-on */
+	char*   cache_path;     //< layout cache, NULL: disabled
+	Loader  loader;
+
+	Automation automation;
+
+	WriteBatch batch;
+	Throttle   throttle;
+	TileRender tiles;
+	Redraw     redraw;
+	History    history;
+	Journal    journal;
+	Midi       midi;
+	Routes     routes;
+
+	uint16_t*  ctrl_hash;      //< name index, see ctrl_by_name()
+	unsigned   ctrl_hash_size;
+
+	uint16_t*  changed;   //< control indices, see collect_changes()
+	unsigned   n_changed;
+	uint64_t   n_events;  //< total changes reported by the device
+
+	int        metrics_fd; //< listening socket, -1: disabled
+	char*      metrics_path;
+	MetricsClient metrics_client[METRICS_CLIENTS];
+
+	ShmHeader* shm;
+	size_t     shm_size;
+	char*      shm_name;
+
+	RobWidget*  tool_box;
+	RobTkPBtn*  btn_undo;
+	RobTkPBtn*  btn_redo;
+	RobTkCBtn*  btn_routes;
+	RobTkLbl*   routes_lbl; //< active routes list, shown with btn_routes
+
+	Morph       morph;
+	RobWidget*  morph_box;
+	RobTkLbl*   morph_lbl[2];
+	RobTkScale* morph_fader;
 } RobTkApp;
 
+static int verbose = 0;
+
+#define OPT_BENCH (1<<8) //< in addition to the SM_* open flags
+
+static int64_t mono_usec (void)
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
 
 /* *****************************************************************************
- * Mapping for the 18i6 and 18i8
- *
- * NOTE: these are numerically hardcoded. see `amixer -D hw:2 control`
- * and #if'd "Print Controls" debug dump below
+ * Helpers
  */
 
-/* mixer-matrix ; colums(src) x rows (dest) */
-static Mctrl* matrix_ctrl_cr (RobTkApp* ui, unsigned int c, unsigned int r)
+static float db_to_knob (float db)
 {
-	unsigned int ctrl_id;
-	/* Matrix 01 Mix A
-	 *  ..
-	 * Matrix 18 Mix F
-	 */
-	if (r >= ui->device->smi || c >= ui->device->smo) {
-		return NULL;
-	}
-	if (ui->device->matrix_mix_column_major) {
-		ctrl_id = ui->device->matrix_mix_offset + c * ui->device->matrix_mix_stride + r;
-	} else {
-		ctrl_id = ui->device->matrix_mix_offset + r * ui->device->matrix_mix_stride + c;
-	}
-	return &ui->ctrl[ctrl_id];
+	float k = (db + 128.f) / 228.75f;
+	float s = k * sqrt (0.5) / (1 - k);
+	return s * s;
 }
 
-/* wrapper to the above, linear lookup */
-static Mctrl* matrix_ctrl_n (RobTkApp* ui, unsigned int n)
+static float knob_to_db (float v)
 {
-	unsigned c = n % ui->device->smo;
-	unsigned r = n / ui->device->smo;
-	return matrix_ctrl_cr (ui, c, r);
+	// v = 0..1
+	float db = sqrtf (v) / (sqrtf (0.5) + sqrtf (v)) * 228.75f - 128.f;
+	if (db > 6.f) return 6.f;
+	return rint (db);
 }
 
-/* matrix input selector (per row)*/
-static Mctrl* matrix_sel (RobTkApp* ui, unsigned int r)
+static int cmp_u32 (const void* a, const void* b)
 {
-	if (r >= ui->device->smi) {
-		return NULL;
-	}
-	/* Matrix 01 Input, ENUM
-	 *  ..
-	 * Matrix 18 Input, ENUM
-	 */
-	unsigned int ctrl_id = ui->device->matrix_in_offset + r * ui->device->matrix_in_stride;
-	return &ui->ctrl[ctrl_id];
+	uint32_t const va = *(uint32_t const*)a;
+	uint32_t const vb = *(uint32_t const*)b;
+	return (va > vb) - (va < vb);
 }
 
-/* Input/Capture selector */
-static Mctrl* src_sel (RobTkApp* ui, unsigned int r)
+/* *****************************************************************************
+ * Gain Automation
+ *
+ * A timeline of moves, each ramps one gain control to a target value.
+ * Curves are evaluated per tick and quantised to whole dB. Only steps that
+ * change the written value are scheduled, earliest deadline first, limited
+ * by a token-bucket write budget. If a move falls behind, intermediate
+ * steps are coalesced into a single write of the current value.
+ */
+
+#define DEFAULT_WRITE_BUDGET 100 // writes per second
+#define GUI_FADE_TIME        2.0 // seconds
+#define DEFAULT_MAX_FPS      60
+
+static float automation_eval (AutoMove const* m, double t)
 {
-	if (r >= ui->device->sin) {
-		return NULL;
+	double p = m->duration > 0 ? (t - m->t_start) / m->duration : 1.0;
+	if (p < 0) p = 0;
+	if (p > 1) p = 1;
+	switch (m->curve) {
+		case CURVE_FADER:
+			{
+				float k0 = db_to_knob (m->from);
+				float k1 = db_to_knob (m->to);
+				return knob_to_db (k0 + (k1 - k0) * p);
+			}
+		case CURVE_SCURVE:
+			p = .5 - .5 * cos (M_PI * p);
+			/* fallthrough */
+		case CURVE_LIN:
+		default:
+			return m->from + (m->to - m->from) * p;
 	}
-	/* Input Source 01, ENUM
-	 *  ..
-	 * Input Source 18, ENUM
-	 */
-	unsigned int ctrl_id = ui->device->input_offset + r;
-	return &ui->ctrl[ctrl_id];
 }
 
-static int src_sel_default (unsigned int r, int max_values)
+static void automation_start (Automation* a)
 {
-	/* 0 <= r < ui->device->sin;  return 0 .. max_values - 1 */
-	return (r + 7) % max_values; // XXX hardcoded defaults. offset 7: "Analog 1"
+	a->t0 = a->t_last = mono_usec ();
+	a->tokens = 1;
 }
 
-/* Output Gains */
-static Mctrl* out_gain (RobTkApp* ui, unsigned int c)
+static void automation_stop (Automation* a)
 {
-	assert (c < MAX_GAINS);
-	return &ui->ctrl[ui->device->out_gain_map[c]];
+	a->t0 = 0;
+	a->n_moves = 0;
 }
 
-static const char* out_gain_label (RobTkApp *ui, int n)
+/* add a move, with `replace` a pending or running move on the same control is cancelled */
+static bool automation_add (Automation* a, AutoMove const* m, bool replace)
 {
-	return ui->device->out_gain_labels[n];
+	if (replace) {
+		for (int i = 0; i < a->n_moves; ++i) {
+			if (a->move[i].ctrl == m->ctrl) {
+				a->move[i].done = true;
+			}
+		}
+	}
+	/* reuse finished slots */
+	int n = 0;
+	for (int i = 0; i < a->n_moves; ++i) {
+		if (!a->move[i].done) {
+			a->move[n++] = a->move[i];
+		}
+	}
+	a->n_moves = n;
+	if (a->n_moves >= MAX_MOVES) {
+		return false;
+	}
+	a->move[a->n_moves++] = *m;
+	if (a->t0 == 0) {
+		automation_start (a);
+	}
+	return true;
 }
 
-static Mctrl* aux_gain (RobTkApp* ui, unsigned int c)
+/* fade a single control, starting now */
+static void automation_fade (Automation* a, SmCtrl* ctrl, float to, double duration)
 {
-	assert (c < MAX_GAINS);
-	return &ui->ctrl[ui->device->out_gain_map[c + ui->device->smst]];
+	AutoMove m;
+	memset (&m, 0, sizeof (AutoMove));
+	m.ctrl     = ctrl;
+	m.t_start  = a->t0 ? (mono_usec () - a->t0) / 1e6 : 0;
+	m.duration = duration;
+	m.from     = NAN;
+	m.to       = to;
+	m.curve    = CURVE_FADER;
+	automation_add (a, &m, true);
 }
 
-static const char* aux_gain_label (RobTkApp *ui, int n)
+static void automation_tick (Automation* a)
 {
-	return ui->device->out_gain_labels[n + ui->device->smst];
-}
+	if (a->t0 == 0) {
+		return;
+	}
+	const int64_t now = mono_usec ();
+	const double  t   = (now - a->t0) / 1e6;
 
-static const char* out_select_label (RobTkApp *ui, int n)
-{
-	return ui->device->out_gain_labels[n + ui->device->smst + ui->device->samo];
-}
+	a->tokens += a->budget * (now - a->t_last) / 1e6;
+	if (a->tokens > a->budget) {
+		a->tokens = a->budget; // at most one second worth of burst
+	}
+	a->t_last = now;
 
-/* Output Bus assignment (matrix-out to master) */
-static Mctrl* out_sel (RobTkApp* ui, unsigned int c)
-{
-	assert (c < MAX_BUSSES);
-	return &ui->ctrl[ui->device->out_bus_map[c]];
-}
+	bool active = false;
+	for (int i = 0; i < a->n_moves; ++i) {
+		AutoMove* m = &a->move[i];
+		if (m->done) {
+			continue;
+		}
+		active = true;
+		if (t < m->t_start) {
+			continue;
+		}
+		if (!m->started) {
+			m->started = true;
+			m->written = lrintf (sm_get_dB (m->ctrl));
+			if (isnan (m->from)) {
+				m->from = m->written;
+			}
+		}
+		const long want = lrintf (automation_eval (m, t));
+		if (want != m->written) {
+			if (!m->pending) {
+				m->pending = true;
+				m->due = t;
+			} else if (want != m->want) {
+				++a->n_coalesced;
+			}
+			m->want = want;
+		} else {
+			m->pending = false;
+		}
+		if (!m->pending && t >= m->t_start + m->duration) {
+			m->done = true;
+		}
+	}
 
-static int out_sel_default (unsigned int c)
-{
-	/* 0 <= c < ui->device->sout; */
-	return 25 + c; // XXX hardcoded defaults. offset 25: "Mix 1"
-}
+	/* earliest deadline first, within budget */
+	while (a->tokens >= 1) {
+		AutoMove* next = NULL;
+		for (int i = 0; i < a->n_moves; ++i) {
+			AutoMove* m = &a->move[i];
+			if (m->pending && (!next || m->due < next->due)) {
+				next = m;
+			}
+		}
+		if (!next) {
+			break;
+		}
+		sm_set_dB (next->ctrl, next->want);
+		next->written = next->want;
+		next->pending = false;
+		if (t >= next->t_start + next->duration) {
+			next->done = true;
+		}
+		a->tokens -= 1;
+		++a->n_writes;
+	}
 
-/* Hi-Z switches */
-static Mctrl* hiz (RobTkApp* ui, unsigned int c)
-{
-	assert (c < ui->device->num_hiz);
-	return &ui->ctrl[ui->device->hiz_map[c]];
+	if (!active) {
+		if (verbose) {
+			printf ("Automation done: %u writes, %u steps coalesced\n", a->n_writes, a->n_coalesced);
+		}
+		automation_stop (a);
+	}
 }
 
-/* Pad switches */
-static Mctrl* pad (RobTkApp *ui, unsigned c)
+/* *****************************************************************************
+ * Write throttle
+ *
+ * Batched writes are limited by a token bucket: `rate` writes per second,
+ * at most `batch` per flush. Both adapt to the write latency measured by
+ * the library (additive increase, multiplicative decrease): when the
+ * 90th percentile of recent writes exceeds the target the limits are
+ * halved, when it is well below they grow again. The automation budget
+ * follows the same rate, capped by --write-budget.
+ */
+
+#define THROTTLE_INTERVAL  250000 // usec between adaptations
+#define THROTTLE_SAMPLES   8      // min. writes per adaptation
+#define THROTTLE_RATE_MIN  10     // writes per second
+#define THROTTLE_RATE_MAX  1000
+#define THROTTLE_RATE_STEP 20     // writes per second, increase per adaptation
+#define THROTTLE_BATCH_MIN 4
+#define THROTTLE_BATCH_MAX 256
+#define DEFAULT_WRITE_LATENCY 4.0 // ms
+
+static void throttle_init (Throttle* th, double target_ms, double automation_max)
 {
-	assert (c < ui->device->num_pad);
-	return &ui->ctrl[ui->device->pad_map[c]];
+	th->target   = target_ms * 1000;
+	th->rate     = 250;
+	th->batch    = 64;
+	th->tokens   = th->batch;
+	th->automation_max = automation_max;
+	th->t_last   = mono_usec ();
+	th->n_seen   = sm_write_stats ()->n_writes;
 }
 
-/* Air switches */
-static Mctrl* air (RobTkApp *ui, unsigned c)
+/* number of the n queued writes that may be done now */
+static unsigned int throttle_grant (Throttle* th, unsigned int n)
 {
-	assert (c < ui->device->num_air);
-	return &ui->ctrl[ui->device->air_map[c]];
+	const int64_t now = mono_usec ();
+	th->tokens += th->rate * (now - th->t_last) / 1e6;
+	if (th->tokens > th->batch) {
+		th->tokens = th->batch;
+	}
+	th->t_last = now;
+	if (n > th->tokens) {
+		n = th->tokens;
+	}
+	th->tokens -= n;
+	return n;
 }
 
-/* master gain */
-static Mctrl* mst_gain (RobTkApp* ui)
+static void throttle_update (RobTkApp* ui)
 {
-	return &ui->ctrl[0]; /* Master, PBS */
-}
+	Throttle* th = &ui->throttle;
+	const int64_t now = mono_usec ();
+	if (now < th->t_next) {
+		return;
+	}
+	th->t_next = now + THROTTLE_INTERVAL;
 
+	SmWriteStats const* ws = sm_write_stats ();
+	uint64_t n = ws->n_writes - th->n_seen;
+	if (n < THROTTLE_SAMPLES) {
+		return;
+	}
+	th->n_seen = ws->n_writes;
+	if (n > SM_WSTAT_RING) {
+		n = SM_WSTAT_RING;
+	}
 
-/* *****************************************************************************
- * *****************************************************************************
- *
- * CODE FROM HERE ON SHOULD BE GENERIC
- *
- * *****************************************************************************
- * ****************************************************************************/
+	/* writes since the last update */
+	uint32_t lat[SM_WSTAT_RING];
+	for (uint64_t k = 0; k < n; ++k) {
+		lat[k] = ws->lat[(ws->n_writes - 1 - k) % SM_WSTAT_RING];
+	}
+	qsort (lat, n, sizeof (uint32_t), cmp_u32);
+	th->lat_p90 = lat[n * 9 / 10];
+
+	const double   rate  = th->rate;
+	const unsigned batch = th->batch;
+	if (th->lat_p90 > th->target) {
+		th->rate  *= .5;
+		th->batch /= 2;
+		++th->n_backoff;
+	} else if (th->lat_p90 < th->target / 2) {
+		th->rate  += THROTTLE_RATE_STEP;
+		th->batch += THROTTLE_BATCH_MIN;
+	}
+	if (th->rate < THROTTLE_RATE_MIN) th->rate = THROTTLE_RATE_MIN;
+	if (th->rate > THROTTLE_RATE_MAX) th->rate = THROTTLE_RATE_MAX;
+	if (th->batch < THROTTLE_BATCH_MIN) th->batch = THROTTLE_BATCH_MIN;
+	if (th->batch > THROTTLE_BATCH_MAX) th->batch = THROTTLE_BATCH_MAX;
 
-static int verbose = 0;
+	ui->automation.budget = th->rate < th->automation_max ? th->rate : th->automation_max;
 
-#define OPT_PROBE (1<<0)
-#define OPT_DETECT (1<<1)
-
-static void dump_device_desc (Device const* const d)
-{
-	printf ("--- Device: %s\n", d->name);
-	printf ("Matrix: in=%d, out=%d, off=%d, stride=%d\n",
-			d->smi, d->smo, d->matrix_mix_offset, d->matrix_mix_stride);
-	printf ("Matrix: input-select=%d, select-stride=%d\n",
-			d->matrix_in_offset, d->matrix_in_stride);
-	printf ("Inputs: ins=%d select-offset=%d\n",
-			d->sin, d->input_offset);
-	printf ("Masters: n_mst=%d n_out-select=%d\n",
-			d->smst, d->sout);
-	printf ("Switches: n_pad=%d, n_hiz=%d\n",
-			d->num_pad, d->num_hiz);
-
-#define DUMP_ARRAY(name, len, fmt)  \
-  printf (#name " = {");            \
-  for (int i = 0; i < len; ++i) {   \
-    printf (fmt ", ", d->name[i]);  \
-  }                                 \
-  printf ("};\n");
-
-	DUMP_ARRAY (hiz_map, MAX_HIZS, "%d");
-	DUMP_ARRAY (pad_map, MAX_PADS, "%d");
-	DUMP_ARRAY (out_gain_map, MAX_GAINS, "%d");
-	DUMP_ARRAY (out_gain_labels, MAX_GAINS, "%s");
-	DUMP_ARRAY (out_bus_map, MAX_BUSSES, "%d");
-	printf ("---\n");
+	if ((verbose && th->rate < rate) || (verbose > 1 && (th->rate != rate || th->batch != batch))) {
+		printf ("Writes: latency p90 %.2f ms (target %.2f ms), limit %.0f/s, batch %u\n",
+				th->lat_p90 / 1000.0, th->target / 1000.0, th->rate, th->batch);
+	}
 }
 
 /* *****************************************************************************
- * Alsa Mixer Interface
+ * Batched writes
+ *
+ * Every control has two slots: its gain in whole dB, and its enum item,
+ * capture switch or mute state. Values are queued per slot, the batch is
+ * flushed once and each slot written at most once, no matter how often it
+ * was queued. A flush writes what the throttle permits, the rest is
+ * written from port_event().
  */
 
-static int open_mixer (RobTkApp* ui, const char* card, int opts)
+#define SLOT_DB(i)  (2 * (i))
+#define SLOT_VAL(i) (2 * (i) + 1)
+
+static bool ctrl_has_db (SmCtrl const* c)
 {
-	int rv = 0;
-	int err;
-	snd_mixer_selem_id_t *sid;
-	snd_mixer_elem_t *elem;
-	snd_mixer_selem_id_alloca (&sid);
+	return c->caps & (SM_CAP_PVOL | SM_CAP_CVOL);
+}
 
-	snd_ctl_t *hctl;
-	snd_ctl_card_info_t *card_info;
-	snd_ctl_card_info_alloca (&card_info);
+static bool ctrl_has_val (SmCtrl const* c)
+{
+	return c->caps & (SM_CAP_ENUM | SM_CAP_CSW | SM_CAP_PSW);
+}
 
-	if ((err = snd_ctl_open (&hctl, card, 0)) < 0) {
-		fprintf (stderr, "Control device %s open error: %s\n", card, snd_strerror (err));
-		return err;
+static int ctrl_get_val (SmCtrl* c)
+{
+	if (c->caps & SM_CAP_ENUM) {
+		return sm_get_enum (c);
+	} else if (c->caps & SM_CAP_CSW) {
+		return sm_get_switch (c);
+	} else {
+		return sm_get_mute (c);
 	}
+}
 
-	if ((err = snd_ctl_card_info (hctl, card_info)) < 0) {
-		fprintf (stderr, "Control device %s hw info error: %s\n", card, snd_strerror (err));
-		return err;
+static void ctrl_set_val (SmCtrl* c, int v)
+{
+	if (c->caps & SM_CAP_ENUM) {
+		sm_set_enum (c, v);
+	} else if (c->caps & SM_CAP_CSW) {
+		sm_set_switch (c, v);
+	} else {
+		sm_set_mute (c, v);
 	}
+}
 
-	const char* card_name = snd_ctl_card_info_get_name (card_info);
-	snd_ctl_close (hctl);
-
-	if (!card_name) {
-		fprintf (stderr, "Device `%s' is unknown\n", card);
-		return -1;
+static const char* ctrl_val_kind (SmCtrl const* c)
+{
+	if (c->caps & SM_CAP_ENUM) {
+		return "enum";
+	} else if (c->caps & SM_CAP_CSW) {
+		return "switch";
+	} else {
+		return "mute";
 	}
+}
 
-	ui->device = NULL;
+static bool batch_alloc (RobTkApp* ui)
+{
+	WriteBatch* b = &ui->batch;
+	ui->changed = calloc (ui->sm.ctrl_cnt, sizeof (uint16_t));
+	b->want   = calloc (2 * ui->sm.ctrl_cnt, sizeof (int16_t));
+	b->dirty  = calloc (2 * ui->sm.ctrl_cnt, sizeof (uint16_t));
+	b->queued = calloc (2 * ui->sm.ctrl_cnt, sizeof (bool));
+	b->n_dirty = 0;
+	return ui->changed && b->want && b->dirty && b->queued;
+}
 
-	for (unsigned i = 0; i < NUM_DEVICES; i++) {
-		if (!strcmp (card_name, devices[i].name))
-			ui->device = &devices[i];
-	}
+static void batch_free (RobTkApp* ui)
+{
+	WriteBatch* b = &ui->batch;
+	free (ui->changed);
+	ui->changed = NULL;
+	free (b->want);
+	free (b->dirty);
+	free (b->queued);
+	b->want   = NULL;
+	b->dirty  = NULL;
+	b->queued = NULL;
+}
 
-	if (ui->device == NULL) {
-		fprintf (stderr, "Device `%s' is not supported\n", card);
-		rv = -1;
-		if ((opts & OPT_PROBE) == 0) {
-			return -1;
-		}
+static void batch_queue (WriteBatch* b, unsigned int slot, int16_t v)
+{
+	b->want[slot] = v;
+	if (!b->queued[slot]) {
+		b->queued[slot] = true;
+		b->dirty[b->n_dirty++] = slot;
 	}
+}
 
-	if ((err = snd_mixer_open (&ui->mixer, 0)) < 0) {
-		fprintf (stderr, "Mixer %s open error: %s\n", card, snd_strerror (err));
-		return err;
-	}
-	if ((err = snd_mixer_attach (ui->mixer, card)) < 0) {
-		fprintf (stderr, "Mixer attach %s error: %s\n", card, snd_strerror (err));
-		snd_mixer_close (ui->mixer);
-		return err;
-	}
-	if ((err = snd_mixer_selem_register (ui->mixer, NULL, NULL)) < 0) {
-		fprintf (stderr, "Mixer register error: %s\n", snd_strerror (err));
-		snd_mixer_close (ui->mixer);
-		return err;
+/* drop a queued write, the control was written directly */
+static void batch_cancel (WriteBatch* b, unsigned int slot)
+{
+	if (!b->queued[slot]) {
+		return;
 	}
-	err = snd_mixer_load (ui->mixer);
-	if (err < 0) {
-		fprintf (stderr, "Mixer %s load error: %s\n", card, snd_strerror (err));
-		snd_mixer_close (ui->mixer);
-		return err;
+	b->queued[slot] = false;
+	for (unsigned int i = 0; i < b->n_dirty; ++i) {
+		if (b->dirty[i] == slot) {
+			memmove (b->dirty + i, b->dirty + i + 1, (b->n_dirty - i - 1) * sizeof (uint16_t));
+			--b->n_dirty;
+			break;
+		}
 	}
+}
 
-	int cnt = 0;
+/* control values including queued writes */
+static int batch_get_dB (RobTkApp* ui, SmCtrl* c)
+{
+	const unsigned int slot = SLOT_DB (c - ui->sm.ctrl);
+	return ui->batch.queued[slot] ? ui->batch.want[slot] : lrintf (sm_get_dB (c));
+}
 
-	for (elem = snd_mixer_first_elem (ui->mixer); elem; elem = snd_mixer_elem_next (elem)) {
-		if (!snd_mixer_selem_is_active (elem)) {
-			continue;
+static int batch_get_val (RobTkApp* ui, SmCtrl* c)
+{
+	const unsigned int slot = SLOT_VAL (c - ui->sm.ctrl);
+	return ui->batch.queued[slot] ? ui->batch.want[slot] : ctrl_get_val (c);
+}
+
+/* write queued slots within the throttle's limits,
+ * returns the number of controls written or still queued */
+static unsigned int batch_flush (RobTkApp* ui)
+{
+	WriteBatch* b = &ui->batch;
+	const unsigned int n_queued = b->n_dirty;
+	const unsigned int n = throttle_grant (&ui->throttle, n_queued);
+	for (unsigned int i = 0; i < n; ++i) {
+		const unsigned int slot = b->dirty[i];
+		SmCtrl* c = &ui->sm.ctrl[slot / 2];
+		if (slot & 1) {
+			ctrl_set_val (c, b->want[slot]);
+		} else {
+			sm_set_dB (c, b->want[slot]);
 		}
-		++cnt;
+		b->queued[slot] = false;
 	}
+	memmove (b->dirty, b->dirty + n, (n_queued - n) * sizeof (uint16_t));
+	b->n_dirty = n_queued - n;
+	return n_queued;
+}
 
-	ui->ctrl_cnt = cnt;
-
-	if (cnt == 0) {
-		fprintf (stderr, "Mixer %s: no controls found\n", card);
-		return -1;
+/* gather controls flagged by the mixer (SmCtrl.changed) into ui->changed */
+static unsigned int collect_changes (RobTkApp* ui)
+{
+	ui->n_changed = 0;
+	for (unsigned int i = 0; i < ui->sm.ctrl_cnt; ++i) {
+		if (ui->sm.ctrl[i].changed) {
+			ui->sm.ctrl[i].changed = false;
+			ui->changed[ui->n_changed++] = i;
+		}
 	}
+	return ui->n_changed;
+}
+
+/* *****************************************************************************
+ * Active routes
+ *
+ * Sparse index of the cross-points above -128dB. It is built once and then
+ * kept up to date from the controls reported as changed (and from bulk
+ * writes), so listing, saving or editing routes costs O(active routes)
+ * rather than O(inputs * mixes).
+ */
 
-	if (opts & OPT_PROBE) {
-		fprintf (stderr, "Device `%s' has %d contols: \n", card_name, cnt);
+static void route_set (Routes* rt, unsigned int x, bool active)
+{
+	if (active && rt->pos[x] == ROUTE_NONE) {
+		rt->pos[x] = rt->n;
+		rt->xp[rt->n++] = x;
+		rt->dirty = true;
+	} else if (!active && rt->pos[x] != ROUTE_NONE) {
+		/* swap-remove */
+		const uint16_t last = rt->xp[--rt->n];
+		rt->xp[rt->pos[x]] = last;
+		rt->pos[last] = rt->pos[x];
+		rt->pos[x] = ROUTE_NONE;
+		rt->dirty = true;
+	} else if (active) {
+		rt->dirty = true; // gain change
 	}
+}
 
-	ui->ctrl = (Mctrl*)calloc (cnt, sizeof (Mctrl));
+static bool routes_init (RobTkApp* ui)
+{
+	Routes* rt = &ui->routes;
+	const unsigned int n_xp = ui->sm.device->smi * ui->sm.device->smo;
+	rt->xp      = calloc (n_xp, sizeof (uint16_t));
+	rt->pos     = calloc (n_xp, sizeof (uint16_t));
+	rt->ctrl_xp = calloc (ui->sm.ctrl_cnt, sizeof (uint16_t));
+	rt->n       = 0;
+	if (!rt->xp || !rt->pos || !rt->ctrl_xp) {
+		return false;
+	}
+	for (unsigned int i = 0; i < ui->sm.ctrl_cnt; ++i) {
+		rt->ctrl_xp[i] = ROUTE_NONE;
+	}
+	for (unsigned int x = 0; x < n_xp; ++x) {
+		SmCtrl* c = sm_matrix_ctrl_n (&ui->sm, x);
+		rt->pos[x] = ROUTE_NONE;
+		rt->ctrl_xp[c - ui->sm.ctrl] = x;
+		route_set (rt, x, sm_get_dB (c) > -128);
+	}
+	return true;
+}
 
-	Device d;
-	memset (&d, 0, sizeof (Device));
-	strncpy (d.name, card_name, 63);
-	for (int i = 0; i < MAX_GAINS; ++i) { d.out_gain_map[i] = -1; }
-	for (int i = 0; i < MAX_BUSSES; ++i) { d.out_bus_map[i] = -1; }
-	for (int i = 0; i < MAX_HIZS; ++i) { d.hiz_map[i] = -1; }
-	for (int i = 0; i < MAX_PADS; ++i) { d.pad_map[i] = -1; }
-	int obm = 0;
+static void routes_free (Routes* rt)
+{
+	free (rt->xp);
+	free (rt->pos);
+	free (rt->ctrl_xp);
+	memset (rt, 0, sizeof (Routes));
+}
 
-	int i = 0;
-	for (elem = snd_mixer_first_elem (ui->mixer); elem; elem = snd_mixer_elem_next (elem)) {
-		if (!snd_mixer_selem_is_active (elem)) {
-			continue;
+/* apply the changes gathered by collect_changes() */
+static void routes_update (RobTkApp* ui)
+{
+	Routes* rt = &ui->routes;
+	for (unsigned int k = 0; k < ui->n_changed; ++k) {
+		const uint16_t x = rt->ctrl_xp[ui->changed[k]];
+		if (x != ROUTE_NONE) {
+			route_set (rt, x, sm_get_dB (&ui->sm.ctrl[ui->changed[k]]) > -128);
 		}
+	}
+}
 
-		Mctrl* c = &ui->ctrl[i];
-		c->elem = elem;
-		c->name = strdup (snd_mixer_selem_get_name (elem));
-
-		if (opts & OPT_DETECT) {
-			if (snd_mixer_selem_is_enumerated (elem)) {
-				if (strstr (c->name, " Impedance") || strstr (c->name, " Level")) {
-					d.hiz_map[d.num_hiz++] = i;
-				}
-				if (strstr (c->name, " Pad")) {
-					d.pad_map[d.num_pad++] = i;
-				}
-				if (strstr (c->name, "Input Source 01") || strstr (c->name, "PCM 01")) {
-					assert (d.input_offset == 0);
-					d.input_offset = i;
-				}
-				if (strstr (c->name, "Input Source") || strstr (c->name, "PCM ")) {
-					++d.sin;
-				}
-				if (strstr (c->name, "Matrix 01 Input") || (strstr (c->name, "Mixer Input 01"))) {
-					assert (d.matrix_in_offset == 0);
-					d.matrix_in_offset = i;
-				}
-				if ((strstr (c->name, "Matrix ") || (strstr (c->name, "Mixer "))) && strstr (c->name, " Input")) {
-					++d.smi;
-					if (strstr(c->name, "Mixer ") && (d.smi == 2)) {
-						d.matrix_in_stride = i - d.matrix_in_offset;
-					}
-				}
-				if (strstr (c->name, "Master ") || strstr (c->name, " Output")) { // Source enum
-					char* t1 = strstr(c->name, " Output");
-					d.out_bus_map[obm++] = i;
-					if (t1 && (obm > d.samo + d.smst)) {
-						strncpy (d.out_gain_labels[obm - 1], c->name, t1 - c->name);
-						d.out_gain_labels[obm - 1][c->name - t1] = '\0';
-						d.sout++;
-					}
-				}
-			} else if (snd_mixer_selem_has_playback_switch (elem)) {
-				if (strstr (c->name, "Master ")) {
-					char* t1 = strchr (c->name, '(');
-					char* t2 = t1 ? strchr (t1, ')') : NULL;
-					if (t2) {
-						++t1;
-						strncpy (d.out_gain_labels[d.smst], t1, t2 - t1);
-						d.out_gain_labels[d.smst][t2 - t1] = '\0';
-					}
-					d.out_gain_map[d.smst++] = i;
-					d.sout = d.smst * 2;
-				} else if (strstr (c->name, " Output")) {
-					char* t1 = strstr(c->name, " Output");
-					char* t2 = t1 ? strchr (t1 + 1, ' ') : NULL;
-					if (t2) {
-						strncpy (d.out_gain_labels[d.smst], c->name, t1 - c->name);
-						d.out_gain_labels[d.smst][t1 - c->name + 1] = '\0';
-						strcat (d.out_gain_labels[d.smst], t2);
-					}
-					d.out_gain_map[d.smst++] = i;
-					d.sout = d.smst * 2;
-				}
-			} else if (snd_mixer_selem_has_capture_switch (elem)) {
-				if (strstr (c->name, " Pad")) {
-					d.pad_map[d.num_pad++] = i;
-					d.pads_are_switches = true;
-				} else if (strstr (c->name, " Air")) {
-					d.air_map[d.num_air++] = i;
-				}
-			} else {
-				if (strstr (c->name, "Line 0") || strstr (c->name, "Line 1")) {
-					char* t1 = c->name + 9;
-					char* t2 = strchr (t1 + 1, ')');
-					if (t2) {
-						strncpy (d.out_gain_labels[d.smst + d.samo], t1, t2 - t1);
-						d.out_gain_labels[d.smst + d.samo][t2 - t1 + 1] = '\0';
-					}
-					d.out_gain_map[d.smst + d.samo++] = i;
-					d.sout++;
-				}
-
-				if (strstr (c->name, "Matrix 01 Mix A") || strstr (c->name, "Mix A Input 01")) {
-					d.matrix_mix_offset = i;
-				}
-				if (strstr (c->name, "Matrix ") && strstr (c->name, " Mix ")) {
-					int last = c->name[strlen (c->name) - 1] - 'A' + 1;
-					assert (last > 0 && last <= 20);
-					if (last > d.smo) {
-						d.smo = last;
-
-						d.matrix_mix_stride = d.smo + 1;
-						d.matrix_in_stride = d.smo + 1;
-					}
-				} else if (strstr (c->name, "Mix ") && strstr (c->name, " Input ")) {
-					int last = c->name[4] - 'A' + 1;
-					assert (last > 0 && last <= 20);
-					if (last > d.smo) {
-						d.smo = last;
-
-						d.matrix_mix_stride = d.smo;
-						d.matrix_in_stride = d.smo + 1;
-					}
-					d.matrix_mix_column_major = true;
-				}
-			}
-		}
+static int cmp_u16 (const void* a, const void* b)
+{
+	return (int)*(const uint16_t*)a - (int)*(const uint16_t*)b;
+}
 
-		if (opts & OPT_PROBE) {
-			printf (" %d '%s'", i, c->name);
-			if (snd_mixer_selem_is_enumerated (elem)) { printf (", ENUM"); }
-			if (snd_mixer_selem_has_playback_switch (elem)) { printf (", PBS"); }
-			if (snd_mixer_selem_has_capture_switch (elem)) { printf (", CPS"); }
-			printf ("\n");
-		}
-		++i;
-		assert (i <= cnt);
+/* "In 3 -> Mix B  -6dB", one per line, in matrix order */
+static void routes_format (RobTkApp* ui, char* buf, size_t len, unsigned int max_lines)
+{
+	Routes* rt = &ui->routes;
+	const unsigned int smo = ui->sm.device->smo;
+	const unsigned int n = rt->n < max_lines ? rt->n : max_lines;
+	size_t off = 0;
+
+	buf[0] = '\0';
+	if (rt->n == 0) {
+		snprintf (buf, len, "No active routes");
+		return;
 	}
 
-	if ((opts & OPT_DETECT) && rv == 0 && ui->device) {
-		if (verbose > 1) {
-			printf ("CMP %d\n", memcmp (ui->device, &d, sizeof (Device)));
-			dump_device_desc (&d);
-			dump_device_desc (ui->device);
-		}
-	}
-	if ((opts & OPT_DETECT)
-	    /* test is all relevant offsets have been detected */
-	    && (   d.smi != 0 && d.smo != 0
-	        && d.sin != 0 && d.sout != 0
-	        && d.matrix_in_offset != 0 && d.matrix_mix_offset != 0
-	        && (d.smst != 0 || d.samo != 0)
-	       )
-	   )
-	{
-		if (verbose) {
-			printf ("Using autodetected mapping.\n");
-		}
-		if (NULL == ui->device)
-			ui->device = malloc(sizeof(Device));
-		if (NULL != ui->device) {
-			memcpy (ui->device, &d, sizeof (Device));
-			rv = 0;
-		}
+	uint16_t* xp = malloc (rt->n * sizeof (uint16_t));
+	if (!xp) {
+		return;
 	}
-	return rv;
-}
+	memcpy (xp, rt->xp, rt->n * sizeof (uint16_t));
+	qsort (xp, rt->n, sizeof (uint16_t), cmp_u16);
 
-static void close_mixer (RobTkApp* ui)
-{
-	for (unsigned int i = 0; i < ui->ctrl_cnt; ++i) {
-		free (ui->ctrl[i].name);
+	for (unsigned int k = 0; k < n && off < len; ++k) {
+		off += snprintf (buf + off, len - off, "%sIn %u -> Mix %c  %+3.0fdB",
+				k > 0 ? "\n" : "", xp[k] / smo + 1, 'A' + xp[k] % smo,
+				sm_get_dB (sm_matrix_ctrl_n (&ui->sm, xp[k])));
 	}
-	free (ui->ctrl);
-	if (ui->mixer) {
-		snd_mixer_close (ui->mixer);
+	if (rt->n > n && off < len) {
+		snprintf (buf + off, len - off, "\n... and %u more", rt->n - n);
 	}
+	free (xp);
 }
 
-static void set_mute (Mctrl* c, bool muted)
+/* *****************************************************************************
+ * Undo/Redo
+ *
+ * A fixed-size ring of deltas. Consecutive changes of the same control
+ * (dragging a knob) fold into one entry, changes made between
+ * history_begin() and history_end() share a group and are undone as one.
+ * When the ring is full, the oldest entries are dropped.
+ */
+
+#define HISTORY_FOLD 500000 // usec
+
+static void history_begin (History* h)
 {
-	int v = muted ? 0 : 1;
-	assert (c && snd_mixer_selem_has_playback_switch (c->elem));
-	for (int chn = 0; chn <= 2; ++chn) {
-		snd_mixer_selem_channel_id_t cid = (snd_mixer_selem_channel_id_t) chn;
-		if (snd_mixer_selem_has_playback_channel (c->elem, cid)) {
-			snd_mixer_selem_set_playback_switch (c->elem, cid, v);
-		}
+	if (h->depth++ == 0) {
+		++h->group;
 	}
+	h->t_last = 0;
 }
 
-static bool get_mute (Mctrl* c)
+static void history_end (History* h)
 {
-	int v = 0;
-	assert (c && snd_mixer_selem_has_playback_switch (c->elem));
-	snd_mixer_selem_get_playback_switch (c->elem, (snd_mixer_selem_channel_id_t)0, &v);
-	return v == 0;
+	assert (h->depth > 0);
+	--h->depth;
 }
 
-static float get_dB (Mctrl* c)
+static Delta* history_last (History* h)
 {
-	assert (c);
-	long val = 0;
-	snd_mixer_selem_get_playback_dB (c->elem, (snd_mixer_selem_channel_id_t)0, &val);
-	return val / 100.f;
+	return h->n_undo > 0 ? &h->d[(h->head + HISTORY_SIZE - 1) % HISTORY_SIZE] : NULL;
 }
 
-static void set_dB (Mctrl* c, float dB)
+static void history_record (History* h, unsigned int slot, int16_t from, int16_t to)
 {
-	long val = 100.f * dB;
-	for (int chn = 0; chn <= 2; ++chn) {
-		snd_mixer_selem_channel_id_t cid = (snd_mixer_selem_channel_id_t) chn;
-		if (snd_mixer_selem_has_playback_channel (c->elem, cid)) {
-			snd_mixer_selem_set_playback_dB (c->elem, cid, val, /*playback*/0);
-		}
-		if (snd_mixer_selem_has_capture_channel (c->elem, cid)) {
-			snd_mixer_selem_set_playback_dB (c->elem, cid, val, /*capture*/1);
+	if (from == to) {
+		return;
+	}
+	const int64_t now = mono_usec ();
+	Delta* last = history_last (h);
+
+	if (h->depth == 0 && last && last->slot == slot && now - h->t_last < HISTORY_FOLD) {
+		/* continuous drag */
+		last->to  = to;
+		h->t_last = now;
+		h->n_redo = 0;
+		if (last->from == last->to) {
+			h->head = (h->head + HISTORY_SIZE - 1) % HISTORY_SIZE;
+			--h->n_undo;
+			h->t_last = 0;
 		}
+		return;
 	}
-}
 
-static float get_dB_range (Mctrl* c, bool maximum)
-{
-	long min, max;
-	min = max = 0;
-	snd_mixer_selem_get_playback_dB_range (c->elem, &min, &max);
-	if (maximum) {
-		return max / 100.f;
-	} else {
-		return min / 100.f;
+	if (h->depth == 0) {
+		++h->group;
+		h->t_last = now;
+	}
+
+	Delta* d = &h->d[h->head];
+	d->slot  = slot;
+	d->from  = from;
+	d->to    = to;
+	d->group = h->group;
+
+	h->head = (h->head + 1) % HISTORY_SIZE;
+	h->n_redo = 0;
+	if (h->n_undo < HISTORY_SIZE) {
+		++h->n_undo;
 	}
 }
 
-static void set_enum (Mctrl* c, int v)
+static unsigned int history_undo (RobTkApp* ui)
 {
-	assert (snd_mixer_selem_is_enumerated (c->elem));
-	snd_mixer_selem_set_enum_item (c->elem, (snd_mixer_selem_channel_id_t)0, v);
+	History* h = &ui->history;
+	Delta* d = history_last (h);
+	if (!d) {
+		return 0;
+	}
+	const uint16_t group = d->group;
+	/* walk backwards, the oldest value of a slot is queued last */
+	while ((d = history_last (h)) && d->group == group) {
+		batch_queue (&ui->batch, d->slot, d->from);
+		h->head = (h->head + HISTORY_SIZE - 1) % HISTORY_SIZE;
+		--h->n_undo;
+		++h->n_redo;
+	}
+	h->t_last = 0;
+	return batch_flush (ui);
 }
 
-static int get_enum (Mctrl* c)
+static unsigned int history_redo (RobTkApp* ui)
 {
-	unsigned int idx = 0;
-	assert (snd_mixer_selem_is_enumerated (c->elem));
-	snd_mixer_selem_get_enum_item (c->elem, (snd_mixer_selem_channel_id_t)0, &idx);
-	return idx;
+	History* h = &ui->history;
+	if (h->n_redo == 0) {
+		return 0;
+	}
+	const uint16_t group = h->d[h->head].group;
+	while (h->n_redo > 0 && h->d[h->head].group == group) {
+		Delta const* d = &h->d[h->head];
+		batch_queue (&ui->batch, d->slot, d->to);
+		h->head = (h->head + 1) % HISTORY_SIZE;
+		++h->n_undo;
+		--h->n_redo;
+	}
+	h->t_last = 0;
+	return batch_flush (ui);
 }
 
-static void set_switch (Mctrl* c, bool on)
+/* user edits, recorded in the undo history */
+static void edit_dB (RobTkApp* ui, SmCtrl* c, float dB)
 {
-	int v = on ? 1 : 0;
-	assert (c && snd_mixer_selem_has_capture_switch (c->elem));
-	snd_mixer_selem_set_capture_switch (c->elem, 0, v);
+	const unsigned int slot = SLOT_DB (c - ui->sm.ctrl);
+	history_record (&ui->history, slot, batch_get_dB (ui, c), lrintf (dB));
+	batch_cancel (&ui->batch, slot);
+	sm_set_dB (c, dB);
 }
 
-static bool get_switch (Mctrl* c)
+static void edit_val (RobTkApp* ui, SmCtrl* c, int v)
 {
-	int v = 0;
-	assert (c && snd_mixer_selem_has_capture_switch (c->elem));
-	snd_mixer_selem_get_capture_switch (c->elem, (snd_mixer_selem_channel_id_t)0, &v);
-	return v == 1;
+	const unsigned int slot = SLOT_VAL (c - ui->sm.ctrl);
+	history_record (&ui->history, slot, batch_get_val (ui, c), v);
+	batch_cancel (&ui->batch, slot);
+	ctrl_set_val (c, v);
 }
 
 /* *****************************************************************************
- * Helpers
- */
+ * Bulk matrix operations
+ *
+ * Operations modify a copy of the complete matrix (smi * smo whole-dB
+ * gains, row-major by input). matrix_apply() then writes the difference
+ * as a single batch and records it as one undo transaction.
+ *
+ * Only active routes are read from the controls, inactive cross-points
+ * are known to be -128dB. Clearing, copying and trimming visit the active
+ * routes only.
+ */
 
-static float db_to_knob (float db)
+static int16_t* matrix_get (RobTkApp* ui)
 {
-	float k = (db + 128.f) / 228.75f;
-	float s = k * sqrt (0.5) / (1 - k);
-	return s * s;
+	const unsigned int n_xp = ui->sm.device->smi * ui->sm.device->smo;
+	int16_t* v = malloc (n_xp * sizeof (int16_t));
+	if (!v) {
+		return NULL;
+	}
+	for (unsigned int x = 0; x < n_xp; ++x) {
+		v[x] = -128;
+	}
+	for (unsigned int k = 0; k < ui->routes.n; ++k) {
+		const uint16_t x = ui->routes.xp[k];
+		v[x] = batch_get_dB (ui, sm_matrix_ctrl_n (&ui->sm, x));
+	}
+	return v;
 }
 
-static float knob_to_db (float v)
+/* returns number of controls written */
+static unsigned int matrix_apply (RobTkApp* ui, int16_t const* v)
 {
-	// v = 0..1
-	float db = sqrtf (v) / (sqrtf (0.5) + sqrtf (v)) * 228.75f - 128.f;
-	if (db > 6.f) return 6.f;
-	return rint (db);
+	const unsigned int n_xp = ui->sm.device->smi * ui->sm.device->smo;
+	history_begin (&ui->history);
+	for (unsigned int x = 0; x < n_xp; ++x) {
+		const bool active = ui->routes.pos[x] != ROUTE_NONE;
+		if (!active && v[x] <= -128) {
+			continue;
+		}
+		SmCtrl* ctrl = sm_matrix_ctrl_n (&ui->sm, x);
+		const int16_t cur = active ? batch_get_dB (ui, ctrl) : -128;
+		if (cur != v[x]) {
+			history_record (&ui->history, SLOT_DB (ctrl - ui->sm.ctrl), cur, v[x]);
+			batch_queue (&ui->batch, SLOT_DB (ctrl - ui->sm.ctrl), v[x]);
+			route_set (&ui->routes, x, v[x] > -128);
+		}
+	}
+	history_end (&ui->history);
+	return batch_flush (ui);
 }
 
-/* *****************************************************************************
- * Callbacks
- */
-
-static bool cb_btn_reset (RobWidget* w, void* handle) {
-	RobTkApp* ui = (RobTkApp*)handle;
-	/* toggle all values (force change) */
-
-	for (int r = 0; r < ui->device->sin; ++r) {
-		Mctrl* sctrl = src_sel (ui, r);
-		int mcnt = snd_mixer_selem_get_enum_items (sctrl->elem);
-		const int val = robtk_select_get_value (ui->src_sel[r]);
-		set_enum (sctrl, (val + 1) % mcnt);
-		set_enum (sctrl, val);
-	}
-	for (int r = 0; r < ui->device->smi; ++r) {
-		Mctrl* sctrl = matrix_sel (ui, r);
-		int mcnt = snd_mixer_selem_get_enum_items (sctrl->elem);
-		const int val = robtk_select_get_value (ui->mtx_sel[r]);
-		set_enum (sctrl, (val + 1) % mcnt);
-		set_enum (sctrl, val);
-	}
-	for (unsigned int o = 0; o < ui->device->sout; ++o) {
-		Mctrl* sctrl = out_sel (ui, o);
-		int mcnt = snd_mixer_selem_get_enum_items (sctrl->elem);
-		const int val = robtk_select_get_value (ui->out_sel[o]);
-		set_enum (sctrl, (val + 1) % mcnt);
-		set_enum (sctrl, val);
+static void matrix_clear_mix (RobTkApp* ui, int16_t* v, unsigned int mix)
+{
+	for (unsigned int k = 0; k < ui->routes.n; ++k) {
+		const uint16_t x = ui->routes.xp[k];
+		if (x % ui->sm.device->smo == mix) {
+			v[x] = -128;
+		}
 	}
+}
 
-	for (int r = 0; r < ui->device->smi; ++r) {
-		for (unsigned int c = 0; c < ui->device->smo; ++c) {
-			unsigned int n = r * ui->device->smo + c;
-			Mctrl* ctrl = matrix_ctrl_cr (ui, c, r);
-			const float val = knob_to_db (robtk_dial_get_value (ui->mtx_gain[n]));
-			if (val == -128) {
-				set_dB (ctrl, 127);
-			} else {
-				set_dB (ctrl, -128);
-			}
-			set_dB (ctrl, val);
+static void matrix_clear_input (RobTkApp* ui, int16_t* v, unsigned int in)
+{
+	for (unsigned int k = 0; k < ui->routes.n; ++k) {
+		const uint16_t x = ui->routes.xp[k];
+		if (x / ui->sm.device->smo == in) {
+			v[x] = -128;
 		}
 	}
-	for (unsigned int n = 0; n < ui->device->smst; ++n) {
-		Mctrl* ctrl = out_gain (ui, n);
-		const bool mute = robtk_dial_get_state (ui->out_gain[n]) == 1;
-		const float val = knob_to_db (robtk_dial_get_value (ui->out_gain[n]));
-		set_mute (ctrl, !mute);
-		set_mute (ctrl, mute);
-		if (val == -128) {
-			set_dB (ctrl, 127);
-		} else {
-			set_dB (ctrl, -128);
+}
+
+/* v still matches the device for the mixes involved, see matrix_get() */
+static void matrix_copy_mix (RobTkApp* ui, int16_t* v, unsigned int from, unsigned int to)
+{
+	const unsigned int smo = ui->sm.device->smo;
+	if (from == to) {
+		return;
+	}
+	for (unsigned int k = 0; k < ui->routes.n; ++k) {
+		const uint16_t x = ui->routes.xp[k];
+		if (x % smo == to) {
+			v[x] = -128;
 		}
-		set_dB (ctrl, val);
 	}
-	for (unsigned int n = 0; n < ui->device->samo; ++n) {
-		Mctrl* ctrl = aux_gain (ui, n);
-		const float val = knob_to_db (robtk_dial_get_value (ui->aux_gain[n]));
-		if (val == -128) {
-			set_dB (ctrl, 127);
-		} else {
-			set_dB (ctrl, -128);
+	for (unsigned int k = 0; k < ui->routes.n; ++k) {
+		const uint16_t x = ui->routes.xp[k];
+		if (x % smo == from) {
+			v[x - from + to] = v[x];
 		}
-		set_dB (ctrl, val);
 	}
-	return TRUE;
 }
 
-static bool cb_set_hiz (RobWidget* w, void* handle) {
-	RobTkApp* ui = (RobTkApp*)handle;
-	if (ui->disable_signals) return TRUE;
-	for (uint32_t i = 0; i < ui->device->num_hiz; ++i) {
-		int val = robtk_cbtn_get_active (ui->btn_hiz[i]) ? 1 : 0;
-		set_enum (hiz (ui, i), val);
+/* odd inputs to the left, even inputs to the right mix of the pair at 0dB */
+static void matrix_stereo_pair (RobTkApp* ui, int16_t* v, unsigned int mix)
+{
+	const unsigned int ml = mix & ~1u;
+	const unsigned int mr = ml + 1;
+	if (mr >= ui->sm.device->smo) {
+		return;
+	}
+	for (unsigned int r = 0; r < ui->sm.device->smi; ++r) {
+		v[r * ui->sm.device->smo + ml] = (r & 1) ? -128 : 0;
+		v[r * ui->sm.device->smo + mr] = (r & 1) ? 0 : -128;
 	}
-	return TRUE;
 }
 
-static bool cb_set_pad (RobWidget* w, void* handle) {
-	RobTkApp* ui = (RobTkApp*)handle;
-	if (ui->disable_signals) return TRUE;
-	for (uint32_t i = 0; i < ui->device->num_pad; ++i) {
-		if (ui->device->pads_are_switches)
-			set_switch (pad (ui, i), robtk_cbtn_get_active (ui->btn_pad[i]));
-		else {
-			int val = robtk_cbtn_get_active (ui->btn_pad[i]) ? 1 : 0;
-			set_enum (pad (ui, i), val);
+/* VCA-style offset, unused cross-points stay off */
+static void matrix_trim_mix (RobTkApp* ui, int16_t* v, unsigned int mix, int dB)
+{
+	/* user input, any trim beyond the range mutes or maxes out */
+	if (dB > 256) dB = 256;
+	if (dB < -256) dB = -256;
+	for (unsigned int k = 0; k < ui->routes.n; ++k) {
+		const uint16_t x = ui->routes.xp[k];
+		if (x % ui->sm.device->smo != mix) {
+			continue;
+		}
+		if (v[x] <= -128) {
+			continue;
 		}
+		/* sum and clamp in int, not in the int16_t gain */
+		SmCtrl* ctrl = sm_matrix_ctrl_n (&ui->sm, x);
+		const int lo = lrintf (sm_get_dB_range (ctrl, false));
+		const int hi = lrintf (sm_get_dB_range (ctrl, true));
+		const int g  = v[x] + dB;
+		v[x] = g > hi ? hi : g < lo ? lo : g;
 	}
-	return TRUE;
 }
 
-static bool cb_set_air (RobWidget* w, void* handle) {
-	RobTkApp* ui = (RobTkApp*)handle;
-	if (ui->disable_signals) return TRUE;
-	for (uint32_t i = 0; i < ui->device->num_air; ++i) {
-		set_switch (air (ui, i), robtk_cbtn_get_active (ui->btn_air[i]));
+/* parse and apply an operation, see usage() */
+static bool matrix_op (RobTkApp* ui, const char* op)
+{
+	const unsigned int smo = ui->sm.device->smo;
+	char a, b;
+	unsigned int in;
+	int dB;
+	bool ok = true;
+
+	int16_t* v = matrix_get (ui);
+	if (!v) {
+		return false;
 	}
-	return TRUE;
+	if (sscanf (op, "clear-mix:%c", &a) == 1 && (unsigned)(toupper (a) - 'A') < smo) {
+		matrix_clear_mix (ui, v, toupper (a) - 'A');
+	} else if (sscanf (op, "clear-input:%u", &in) == 1 && in > 0 && in <= ui->sm.device->smi) {
+		matrix_clear_input (ui, v, in - 1);
+	} else if (sscanf (op, "copy:%c:%c", &a, &b) == 2 && (unsigned)(toupper (a) - 'A') < smo && (unsigned)(toupper (b) - 'A') < smo) {
+		matrix_copy_mix (ui, v, toupper (a) - 'A', toupper (b) - 'A');
+	} else if (sscanf (op, "stereo:%c", &a) == 1 && (unsigned)(toupper (a) - 'A') < smo) {
+		matrix_stereo_pair (ui, v, toupper (a) - 'A');
+	} else if (sscanf (op, "trim:%c:%d", &a, &dB) == 2 && (unsigned)(toupper (a) - 'A') < smo) {
+		matrix_trim_mix (ui, v, toupper (a) - 'A', dB);
+	} else {
+		fprintf (stderr, "Matrix: invalid operation '%s'\n", op);
+		ok = false;
+	}
+	if (ok) {
+		unsigned int n = matrix_apply (ui, v);
+		if (verbose) {
+			printf ("Matrix: '%s' changed %u cross-points.\n", op, n);
+		}
+	}
+	free (v);
+	return ok;
 }
 
-static bool cb_src_sel (RobWidget* w, void* handle) {
-	RobTkApp* ui = (RobTkApp*)handle;
-	if (ui->disable_signals) return TRUE;
-	unsigned int n;
-	memcpy (&n, w->name, sizeof (unsigned int));
-	const float val = robtk_select_get_value (ui->src_sel[n]);
-	set_enum (src_sel (ui, n), val);
-	return TRUE;
-}
+/* *****************************************************************************
+ * Scenes
+ *
+ * A scene is the state of all controls, stored one per line as
+ * "dB <value> <name>", "enum <item> <name>", "switch <0|1> <name>"
+ * or "mute <0|1> <name>". Controls not mentioned keep the current value.
+ *
+ * Scenes are written with a leading "matrix sparse" line, and only list
+ * the active matrix routes. The line turns all other cross-points off.
+ */
 
-static bool cb_mtx_src (RobWidget* w, void* handle) {
-	RobTkApp* ui = (RobTkApp*)handle;
-	if (ui->disable_signals) return TRUE;
-	unsigned int n;
-	memcpy (&n, w->name, sizeof (unsigned int));
-	const float val = robtk_select_get_value (ui->mtx_sel[n]);
-	set_enum (matrix_sel (ui, n), val);
-	return TRUE;
+/* control name index, open addressing, slots hold the control index + 1 */
+static uint32_t name_hash (const char* name, size_t len)
+{
+	uint32_t h = 2166136261u; // FNV-1a
+	for (size_t i = 0; i < len; ++i) {
+		h = (h ^ (unsigned char)name[i]) * 16777619u;
+	}
+	return h;
 }
 
-static bool cb_mtx_gain (RobWidget* w, void* handle) {
-	RobTkApp* ui = (RobTkApp*)handle;
-	unsigned int n;
-	memcpy (&n, w->name, sizeof (unsigned int));
-	const float val = knob_to_db (robtk_dial_get_value (ui->mtx_gain[n]));
-	if (val == -128) {
-		ui->mtx_gain[n]->click_state = 1;
-	} else if (val == 0) {
-		ui->mtx_gain[n]->click_state = 2;
-	} else {
-		ui->mtx_gain[n]->click_state = 0;
+static bool ctrl_index_init (RobTkApp* ui)
+{
+	unsigned int size = 16;
+	while (size < 2 * ui->sm.ctrl_cnt) {
+		size *= 2;
 	}
-	if (ui->disable_signals) return TRUE;
-	set_dB (matrix_ctrl_n (ui, n), val);
-	return TRUE;
+	ui->ctrl_hash = calloc (size, sizeof (uint16_t));
+	if (!ui->ctrl_hash) {
+		return false;
+	}
+	ui->ctrl_hash_size = size;
+	for (unsigned int i = 0; i < ui->sm.ctrl_cnt; ++i) {
+		const char* name = ui->sm.ctrl[i].name;
+		unsigned int h = name_hash (name, strlen (name)) & (size - 1);
+		while (ui->ctrl_hash[h]) {
+			h = (h + 1) & (size - 1);
+		}
+		ui->ctrl_hash[h] = i + 1;
+	}
+	return true;
 }
 
-static bool cb_out_src (RobWidget* w, void* handle) {
-	RobTkApp* ui = (RobTkApp*)handle;
-	if (ui->disable_signals) return TRUE;
-	unsigned int n;
-	memcpy (&n, w->name, sizeof (unsigned int));
-	const float val = robtk_select_get_value (ui->out_sel[n]);
-	set_enum (out_sel (ui, n), val);
-	return TRUE;
+/* control by the first len bytes of name, NULL if unknown */
+static SmCtrl* ctrl_by_name_n (RobTkApp* ui, const char* name, size_t len)
+{
+	if (!ui->ctrl_hash && !ctrl_index_init (ui)) {
+		return NULL;
+	}
+	const unsigned int mask = ui->ctrl_hash_size - 1;
+	for (unsigned int h = name_hash (name, len) & mask; ui->ctrl_hash[h]; h = (h + 1) & mask) {
+		SmCtrl* c = &ui->sm.ctrl[ui->ctrl_hash[h] - 1];
+		if (!strncmp (c->name, name, len) && c->name[len] == '\0') {
+			return c;
+		}
+	}
+	return NULL;
 }
 
-static bool cb_out_gain (RobWidget* w, void* handle) {
-	RobTkApp* ui = (RobTkApp*)handle;
-	if (ui->disable_signals) return TRUE;
-	unsigned int n;
-	memcpy (&n, w->name, sizeof (unsigned int));
-	const bool mute = robtk_dial_get_state (ui->out_gain[n]) == 1;
-	const float val = robtk_dial_get_value (ui->out_gain[n]);
-	set_mute (out_gain (ui, n), mute);
-	set_dB (out_gain (ui, n), knob_to_db (val));
-	return TRUE;
+static SmCtrl* ctrl_by_name (RobTkApp* ui, const char* name)
+{
+	return ctrl_by_name_n (ui, name, strlen (name));
 }
 
-static bool cb_aux_gain (RobWidget* w, void* handle) {
-	RobTkApp* ui = (RobTkApp*)handle;
-	if (ui->disable_signals) return TRUE;
-	unsigned int n;
-	memcpy (&n, w->name, sizeof (unsigned int));
-	const float val = robtk_dial_get_value (ui->aux_gain[n]);
-	set_dB (aux_gain (ui, n), knob_to_db (val));
-	return TRUE;
+static bool scene_alloc (RobTkApp* ui, Scene* s)
+{
+	s->db  = calloc (ui->sm.ctrl_cnt, sizeof (int16_t));
+	s->val = calloc (ui->sm.ctrl_cnt, sizeof (int16_t));
+	return s->db && s->val;
 }
 
-static bool cb_mst_gain (RobWidget* w, void* handle) {
-	RobTkApp* ui = (RobTkApp*)handle;
-	if (ui->disable_signals) return TRUE;
-	const bool mute = robtk_dial_get_state (ui->mst_gain) == 1;
-	const float val = robtk_dial_get_value (ui->mst_gain);
-	set_mute (mst_gain (ui), mute);
-	set_dB (mst_gain (ui), knob_to_db (val));
-	return TRUE;
+static void scene_free (Scene* s)
+{
+	free (s->db);
+	free (s->val);
+	s->db = s->val = NULL;
 }
 
-/* *****************************************************************************
- * GUI Helpers
- */
+static void scene_capture (RobTkApp* ui, Scene* s)
+{
+	for (unsigned int i = 0; i < ui->sm.ctrl_cnt; ++i) {
+		SmCtrl* c = &ui->sm.ctrl[i];
+		if (ctrl_has_db (c)) {
+			s->db[i] = batch_get_dB (ui, c);
+		}
+		if (ctrl_has_val (c)) {
+			s->val[i] = batch_get_val (ui, c);
+		}
+	}
+}
 
-static void set_select_values (RobTkSelect* s,  Mctrl* ctrl)
+/* write the controls that differ from the scene, returns their number */
+static unsigned int scene_apply (RobTkApp* ui, Scene const* s)
 {
-	if (!ctrl) return;
-	assert (ctrl);
+	for (unsigned int i = 0; i < ui->sm.ctrl_cnt; ++i) {
+		SmCtrl* c = &ui->sm.ctrl[i];
+		if (ctrl_has_db (c) && batch_get_dB (ui, c) != s->db[i]) {
+			batch_queue (&ui->batch, SLOT_DB (i), s->db[i]);
+		}
+		if (ctrl_has_val (c) && batch_get_val (ui, c) != s->val[i]) {
+			batch_queue (&ui->batch, SLOT_VAL (i), s->val[i]);
+		}
+	}
+	return batch_flush (ui);
+}
 
-	int mcnt = snd_mixer_selem_get_enum_items (ctrl->elem);
-	for (int i = 0; i < mcnt; ++i) {
-		char name[64];
-		if (snd_mixer_selem_get_enum_item_name (ctrl->elem, i, sizeof (name) - 1, name) < 0) {
+static void scene_write (RobTkApp* ui, FILE* f, Scene const* s)
+{
+	fprintf (f, "# scarlett-mixer scene, %s\n", ui->sm.device->name);
+	fprintf (f, "matrix sparse\n");
+	for (unsigned int i = 0; i < ui->sm.ctrl_cnt; ++i) {
+		SmCtrl* c = &ui->sm.ctrl[i];
+		if (ui->routes.ctrl_xp[i] != ROUTE_NONE && s->db[i] <= -128) {
 			continue;
 		}
-		robtk_select_add_item (s, i, name);
+		if (ctrl_has_db (c)) {
+			fprintf (f, "dB %d %s\n", s->db[i], c->name);
+		}
+		if (ctrl_has_val (c)) {
+			fprintf (f, "%s %d %s\n", ctrl_val_kind (c), s->val[i], c->name);
+		}
 	}
-	robtk_select_set_value (s, get_enum (ctrl));
 }
 
-static void dial_annotation_db (RobTkDial* d, cairo_t* cr, void* data)
+static bool scene_save (RobTkApp* ui, const char* path)
 {
-	RobTkApp* ui = (RobTkApp*)data;
-	char txt[16];
-	snprintf (txt, 16, "%+3.0fdB", knob_to_db (d->cur));
+	Scene s;
+	FILE* f = fopen (path, "w");
+	if (!f) {
+		fprintf (stderr, "Scene: cannot write '%s'\n", path);
+		return false;
+	}
+	if (!scene_alloc (ui, &s)) {
+		scene_free (&s);
+		fclose (f);
+		return false;
+	}
+	scene_capture (ui, &s);
+	scene_write (ui, f, &s);
+	scene_free (&s);
+	return 0 == fclose (f);
+}
 
-	int tw, th;
-	cairo_save (cr);
-	PangoLayout * pl = pango_cairo_create_layout (cr);
-	pango_layout_set_font_description (pl, ui->font);
-	pango_layout_set_text (pl, txt, -1);
-	pango_layout_get_pixel_size (pl, &tw, &th);
-	cairo_translate (cr, d->w_width / 2, d->w_height - 0);
-	cairo_translate (cr, -tw / 2.0 , -th);
-	cairo_set_source_rgba (cr, .0, .0, .0, .5);
-	rounded_rectangle (cr, -1, -1, tw+3, th+1, 3);
-	cairo_fill (cr);
-	CairoSetSouerceRGBA (c_wht);
-	pango_cairo_show_layout (cr, pl);
-	g_object_unref (pl);
-	cairo_restore (cr);
-	cairo_new_path (cr);
+static bool scene_load (RobTkApp* ui, const char* path, Scene* s)
+{
+	FILE* f = fopen (path, "r");
+	if (!f) {
+		fprintf (stderr, "Scene: cannot open '%s'\n", path);
+		return false;
+	}
+	scene_capture (ui, s);
+
+	char line[256];
+	char kind[8];
+	int  v, off;
+	while (fgets (line, sizeof (line), f)) {
+		if (!strncmp (line, "matrix sparse", 13)) {
+			/* inactive cross-points are -128dB in the captured state */
+			for (unsigned int k = 0; k < ui->routes.n; ++k) {
+				s->db[sm_matrix_ctrl_n (&ui->sm, ui->routes.xp[k]) - ui->sm.ctrl] = -128;
+			}
+			continue;
+		}
+		if (line[0] == '#' || sscanf (line, "%7s %d %n", kind, &v, &off) < 2) {
+			continue;
+		}
+		line[strcspn (line, "\n")] = '\0';
+		SmCtrl* c = ctrl_by_name (ui, line + off);
+		if (!c) {
+			if (verbose) {
+				fprintf (stderr, "Scene: unknown control '%s'\n", line + off);
+			}
+			continue;
+		}
+		if (!strcmp (kind, "dB") && ctrl_has_db (c)) {
+			s->db[c - ui->sm.ctrl] = v;
+		} else if (ctrl_has_val (c)) {
+			s->val[c - ui->sm.ctrl] = v;
+		}
+	}
+	fclose (f);
+	return true;
 }
 
-static void create_faceplate (RobTkApp *ui) {
-	cairo_t* cr;
-	float c_bg[4]; get_color_from_theme (1, c_bg);
+/* *****************************************************************************
+ * alsactl state files
+ *
+ * Import reads the state of this card (the "state.<card id>" block) from an
+ * asound.state file with a streaming tokenizer; nothing but the current
+ * control is kept in memory. Element names are mapped to mixer controls
+ * by stripping the kernel suffix (" Playback Volume", ...) and looking
+ * up the remaining name. The result is applied as a minimal diff.
+ *
+ * Export writes the card's elements in the same format, the file can
+ * be used with "alsactl restore". Byte and IEC958 elements are skipped.
+ */
 
-#define MTX_SF(SF)                                                             \
-	SF = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, GD_WIDTH, GED_HEIGHT); \
-	cr = cairo_create (SF);                                                      \
-	cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);                              \
-	cairo_rectangle (cr, 0, 0, GD_WIDTH, GED_HEIGHT);                            \
-	CairoSetSouerceRGBA (c_bg);                                                  \
-	cairo_fill (cr);                                                             \
-	CairoSetSouerceRGBA (c_g60);                                                 \
-	cairo_set_line_cap (cr, CAIRO_LINE_CAP_BUTT);                                \
-	cairo_set_line_width (cr, 1.0);
+#define AS_DEPTH 8 // max. nesting
 
-#define MTX_ARROW_H               \
-	cairo_move_to (cr, 5, GD_CY);   \
-	cairo_rel_line_to (cr, -5, -4); \
-	cairo_rel_line_to (cr, 0, 8);   \
-	cairo_close_path (cr);          \
-	cairo_fill (cr);
+typedef struct {
+	char name[128];
+	char value[64];   //< first value
+	bool has_value;
+	bool value_str;   //< not a number or boolean: enum item name
+	bool mixer;       //< iface MIXER
+	bool has_db;
+	long db;          //< comment dbvalue.0, dB * 100
+} AsEntry;
+
+/* next token, returns '{', '}', '[', ']', 'w' (word in tok), 's' (quoted string in tok), or 0 at EOF */
+static int as_token (FILE* f, char* tok, size_t len)
+{
+	int ch;
+	size_t n = 0;
+	for (;;) {
+		ch = getc (f);
+		if (ch == EOF) {
+			return 0;
+		} else if (ch == '#') {
+			while ((ch = getc (f)) != EOF && ch != '\n') ;
+		} else if (!isspace (ch) && ch != ';' && ch != ',' && ch != '=') {
+			break;
+		}
+	}
+	if (ch == '{' || ch == '}' || ch == '[' || ch == ']') {
+		return ch;
+	}
+	if (ch == '\'' || ch == '"') {
+		const int q = ch;
+		while ((ch = getc (f)) != EOF && ch != q) {
+			if (ch == '\\' && (ch = getc (f)) == EOF) {
+				break;
+			}
+			if (n < len - 1) {
+				tok[n++] = ch;
+			}
+		}
+		tok[n] = '\0';
+		return 's';
+	}
+	do {
+		if (n < len - 1) {
+			tok[n++] = ch;
+		}
+		ch = getc (f);
+	} while (ch != EOF && !isspace (ch) && !strchr ("{}[];,=#'\"", ch));
+	if (ch != EOF) {
+		ungetc (ch, f);
+	}
+	tok[n] = '\0';
+	return 'w';
+}
 
-#define MTX_ARROW_V                      \
-	cairo_move_to (cr, GD_CX, GED_HEIGHT); \
-	cairo_rel_line_to (cr, -4, -5);        \
-	cairo_rel_line_to (cr, 8, 0);          \
-	cairo_close_path (cr);                 \
-	cairo_fill (cr);
+static bool as_suffix (const char* name, size_t len, const char* sfx, size_t* base)
+{
+	const size_t n = strlen (sfx);
+	if (len < n || strcmp (name + len - n, sfx)) {
+		return false;
+	}
+	*base = len - n;
+	return true;
+}
 
-	MTX_SF (ui->mtx_sf[0]);
-	MTX_ARROW_H;
-	MTX_ARROW_V;
+static int as_enum_item (SmCtrl* c, const char* item)
+{
+	char name[64];
+	for (int i = 0; i < c->n_items; ++i) {
+		if (sm_get_enum_name (c, i, name, sizeof (name)) == 0 && !strcmp (name, item)) {
+			return i;
+		}
+	}
+	return -1;
+}
 
-	cairo_move_to (cr, 0, GD_CY);
-	cairo_line_to (cr, GD_WIDTH, GD_CY);
-	cairo_stroke (cr);
-	cairo_move_to (cr, GD_CX, 0);
-	cairo_line_to (cr, GD_CX, GED_HEIGHT);
-	cairo_stroke (cr);
-	cairo_destroy (cr);
+/* store a parsed element in the scene, returns false if it is unknown */
+static bool as_entry_apply (RobTkApp* ui, AsEntry const* e, Scene* s)
+{
+	static const char* const vol[] = { " Playback Volume", " Capture Volume", " Volume", NULL };
+	static const char* const val[] = {
+		" Playback Switch", " Capture Switch", " Switch",
+		" Playback Enum", " Capture Enum", " Enum",
+		" Playback Route", " Capture Route", " Route",
+		"", NULL
+	};
+
+	if (!e->mixer || !e->has_value) {
+		return false;
+	}
 
-	// top-row
-	MTX_SF (ui->mtx_sf[1]);
-	MTX_ARROW_H;
-	MTX_ARROW_V;
+	const size_t len = strlen (e->name);
+	size_t base;
+	SmCtrl* c = NULL;
 
-	cairo_move_to (cr, 0, GD_CY);
-	cairo_line_to (cr, GD_WIDTH, GD_CY);
-	cairo_stroke (cr);
-	cairo_move_to (cr, GD_CX, GD_CY);
-	cairo_line_to (cr, GD_CX, GED_HEIGHT);
-	cairo_stroke (cr);
+	for (const char* const* sfx = vol; *sfx && !c; ++sfx) {
+		if (as_suffix (e->name, len, *sfx, &base) && (c = ctrl_by_name_n (ui, e->name, base)) && !ctrl_has_db (c)) {
+			c = NULL;
+		}
+	}
+	const bool is_vol = c != NULL;
+	for (const char* const* sfx = val; *sfx && !c; ++sfx) {
+		if (as_suffix (e->name, len, *sfx, &base) && (c = ctrl_by_name_n (ui, e->name, base)) && !ctrl_has_val (c)) {
+			c = NULL;
+		}
+	}
+	if (!c) {
+		return false;
+	}
+	const unsigned int i = c - ui->sm.ctrl;
+
+	if (is_vol) {
+		long dB;
+		if (!e->value_str && sm_raw_to_dB (c, atol (e->value), &dB)) {
+			;
+		} else if (e->has_db) {
+			dB = e->db;
+		} else {
+			return false;
+		}
+		const long lo = lrintf (sm_get_dB_range (c, false));
+		const long hi = lrintf (sm_get_dB_range (c, true));
+		dB = lrint (dB / 100.0);
+		s->db[i] = dB < lo ? lo : dB > hi ? hi : dB;
+	} else if (c->caps & SM_CAP_ENUM) {
+		const int v = e->value_str ? as_enum_item (c, e->value) : atoi (e->value);
+		if (v < 0 || v >= c->n_items) {
+			return false;
+		}
+		s->val[i] = v;
+	} else {
+		const bool on = !strcmp (e->value, "true") || atoi (e->value) != 0;
+		s->val[i] = (c->caps & SM_CAP_CSW) ? on : !on; // switch or mute
+	}
+	return true;
+}
+
+/* "state.<card id>" */
+static bool as_block_name (const char* card, char* id, size_t len)
+{
+	snd_ctl_t* ctl;
+	snd_ctl_card_info_t* info;
+	snd_ctl_card_info_alloca (&info);
+	if (snd_ctl_open (&ctl, card, SND_CTL_READONLY) < 0) {
+		return false;
+	}
+	const bool ok = snd_ctl_card_info (ctl, info) >= 0;
+	if (ok) {
+		snprintf (id, len, "state.%s", snd_ctl_card_info_get_id (info));
+	}
+	snd_ctl_close (ctl);
+	return ok;
+}
+
+static bool alsactl_import (RobTkApp* ui, const char* path)
+{
+	char block[80] = "";
+	char key[AS_DEPTH][64];
+	bool array[AS_DEPTH];
+	char tok[128];
+	char cur[64];
+	unsigned int depth = 0;
+	bool have_key = false;
+	unsigned int n_ctrl = 0, n_known = 0;
+	AsEntry e;
+	Scene s;
+	int t;
+
+	if (!ui->sm.mixer) {
+		return false;
+	}
+	if (!as_block_name (ui->card, block, sizeof (block))) {
+		fprintf (stderr, "alsactl: cannot query card '%s'\n", ui->card);
+		return false;
+	}
+	FILE* f = fopen (path, "r");
+	if (!f) {
+		fprintf (stderr, "alsactl: cannot open '%s'\n", path);
+		return false;
+	}
+	if (!scene_alloc (ui, &s)) {
+		scene_free (&s);
+		fclose (f);
+		return false;
+	}
+	const int64_t t0 = mono_usec ();
+	scene_capture (ui, &s);
+	memset (&e, 0, sizeof (AsEntry));
+
+	/* key [value | { ... } | [ ... ]], depth 0: state.<id>, 1: control.N, 2: its fields, 3: comment */
+	while ((t = as_token (f, tok, sizeof (tok)))) {
+		if (t == '{' || t == '[') {
+			if (depth < AS_DEPTH) {
+				snprintf (key[depth], sizeof (key[0]), "%s", have_key ? cur : "");
+				array[depth] = t == '[';
+			}
+			if (depth == 1 && !strncmp (cur, "control.", 8)) {
+				memset (&e, 0, sizeof (AsEntry));
+				e.mixer = true;
+			}
+			++depth;
+			have_key = false;
+			continue;
+		}
+		if (t == '}' || t == ']') {
+			if (depth == 0) {
+				break;
+			}
+			if (--depth == 1 && !strncmp (key[1], "control.", 8)
+			    && !strcmp (key[0], block)) {
+				++n_ctrl;
+				n_known += as_entry_apply (ui, &e, &s);
+			}
+			have_key = false;
+			continue;
+		}
+		const bool in_array = depth > 0 && depth <= AS_DEPTH && array[depth - 1];
+		if (!have_key && !in_array) {
+			snprintf (cur, sizeof (cur), "%s", tok);
+			have_key = true;
+			continue;
+		}
+		/* value of key `k` at the given depth */
+		const char* k = in_array ? key[depth - 1] : cur;
+		const unsigned int d = in_array ? depth - 1 : depth;
+		have_key = false;
+
+		if (d == 2 && !strcmp (k, "name")) {
+			snprintf (e.name, sizeof (e.name), "%s", tok);
+		} else if (d == 2 && !strcmp (k, "iface")) {
+			e.mixer = !strcmp (tok, "MIXER");
+		} else if (d == 2 && !strncmp (k, "value", 5) && !e.has_value) {
+			char* end;
+			snprintf (e.value, sizeof (e.value), "%s", tok);
+			strtol (tok, &end, 10);
+			e.value_str = (end == tok || *end) && strcmp (tok, "true") && strcmp (tok, "false");
+			e.has_value = true;
+		} else if (d == 3 && !strcmp (key[2], "comment") && !strcmp (k, "dbvalue.0")) {
+			e.db = atol (tok);
+			e.has_db = true;
+		}
+	}
+	fclose (f);
+
+	const int64_t t1 = mono_usec ();
+	const unsigned int n_mod = scene_apply (ui, &s);
+	const int64_t t2 = mono_usec ();
+	scene_free (&s);
+
+	if (n_ctrl == 0) {
+		fprintf (stderr, "alsactl: no state for this card in '%s'\n", path);
+		return false;
+	}
+	if (verbose) {
+		printf ("alsactl: %u elements, %u known, %u changed (parse %.2f ms, apply %.2f ms)\n",
+				n_ctrl, n_known, n_mod, (t1 - t0) / 1000.0, (t2 - t1) / 1000.0);
+	}
+	return true;
+}
+
+static void as_write_str (FILE* f, const char* str)
+{
+	fputc ('\'', f);
+	for (; *str; ++str) {
+		if (*str == '\'' || *str == '\\') {
+			fputc ('\\', f);
+		}
+		fputc (*str, f);
+	}
+	fputc ('\'', f);
+}
+
+static bool alsactl_export (RobTkApp* ui, const char* path)
+{
+	char block[80];
+	snd_hctl_t* hctl;
+	snd_ctl_elem_id_t* id;
+	snd_ctl_elem_info_t* info;
+	snd_ctl_elem_value_t* val;
+	snd_ctl_elem_id_alloca (&id);
+	snd_ctl_elem_info_alloca (&info);
+	snd_ctl_elem_value_alloca (&val);
+
+	if (!as_block_name (ui->card, block, sizeof (block)) || snd_hctl_open (&hctl, ui->card, 0) < 0) {
+		fprintf (stderr, "alsactl: cannot open '%s'\n", ui->card);
+		return false;
+	}
+	if (snd_hctl_load (hctl) < 0) {
+		snd_hctl_close (hctl);
+		return false;
+	}
+	FILE* f = fopen (path, "w");
+	if (!f) {
+		fprintf (stderr, "alsactl: cannot write '%s'\n", path);
+		snd_hctl_close (hctl);
+		return false;
+	}
+
+	fprintf (f, "%s {\n", block);
+	for (snd_hctl_elem_t* elem = snd_hctl_first_elem (hctl); elem; elem = snd_hctl_elem_next (elem)) {
+		if (snd_hctl_elem_info (elem, info) < 0 || !snd_ctl_elem_info_is_readable (info)) {
+			continue;
+		}
+		const snd_ctl_elem_type_t type = snd_ctl_elem_info_get_type (info);
+		if (type != SND_CTL_ELEM_TYPE_BOOLEAN && type != SND_CTL_ELEM_TYPE_INTEGER && type != SND_CTL_ELEM_TYPE_ENUMERATED) {
+			continue;
+		}
+		snd_hctl_elem_get_id (elem, id);
+		if (snd_hctl_elem_read (elem, val) < 0) {
+			continue;
+		}
+		const unsigned int count = snd_ctl_elem_info_get_count (info);
+
+		fprintf (f, "\tcontrol.%u {\n", snd_hctl_elem_get_numid (elem));
+		fprintf (f, "\t\tiface %s\n\t\tname ", snd_ctl_elem_iface_name (snd_ctl_elem_id_get_interface (id)));
+		as_write_str (f, snd_ctl_elem_id_get_name (id));
+		fprintf (f, "\n");
+		if (snd_ctl_elem_id_get_index (id) > 0) {
+			fprintf (f, "\t\tindex %u\n", snd_ctl_elem_id_get_index (id));
+		}
+		for (unsigned int i = 0; i < count; ++i) {
+			if (count > 1) {
+				fprintf (f, "\t\tvalue.%u ", i);
+			} else {
+				fprintf (f, "\t\tvalue ");
+			}
+			switch (type) {
+				case SND_CTL_ELEM_TYPE_BOOLEAN:
+					fprintf (f, "%s\n", snd_ctl_elem_value_get_boolean (val, i) ? "true" : "false");
+					break;
+				case SND_CTL_ELEM_TYPE_ENUMERATED:
+					snd_ctl_elem_info_set_item (info, snd_ctl_elem_value_get_enumerated (val, i));
+					if (snd_hctl_elem_info (elem, info) < 0) {
+						fprintf (f, "%u\n", snd_ctl_elem_value_get_enumerated (val, i));
+					} else {
+						as_write_str (f, snd_ctl_elem_info_get_item_name (info));
+						fprintf (f, "\n");
+					}
+					break;
+				default:
+					fprintf (f, "%ld\n", snd_ctl_elem_value_get_integer (val, i));
+					break;
+			}
+		}
+		fprintf (f, "\t\tcomment {\n\t\t\taccess '%s'\n\t\t\ttype %s\n\t\t\tcount %u\n",
+				snd_ctl_elem_info_is_writable (info) ? "read write" : "read",
+				snd_ctl_elem_type_name (type), count);
+		if (type == SND_CTL_ELEM_TYPE_INTEGER) {
+			fprintf (f, "\t\t\trange '%ld - %ld'\n", snd_ctl_elem_info_get_min (info), snd_ctl_elem_info_get_max (info));
+		}
+		fprintf (f, "\t\t}\n\t}\n");
+	}
+	fprintf (f, "}\n");
+
+	snd_hctl_close (hctl);
+	return 0 == fclose (f);
+}
+
+/* *****************************************************************************
+ * State Journal
+ *
+ * Committed changes (as reported by the device) are appended to a log.
+ * Records are buffered and written with a single fdatasync() once the
+ * oldest one is JOURNAL_COMMIT old, so a knob drag costs one sync. The log
+ * is periodically compacted into a snapshot (a scene file, replaced
+ * atomically) after which the log is truncated. On startup snapshot and
+ * log are replayed into the shadow state, and only controls that differ
+ * are written to the device.
+ */
+
+#define JOURNAL_MAGIC      0x314a4d53 // "SMJ1"
+#define JOURNAL_COMMIT     250000     // usec
+#define JOURNAL_CHECKPOINT 60000000   // usec
+#define JOURNAL_COMPACT    8192       // records
+
+static uint32_t journal_layout (RobTkApp* ui)
+{
+	uint32_t h = 2166136261u; // FNV-1a
+	for (unsigned int i = 0; i < ui->sm.ctrl_cnt; ++i) {
+		for (const char* p = ui->sm.ctrl[i].name; *p; ++p) {
+			h = (h ^ (uint8_t)*p) * 16777619u;
+		}
+		h = (h ^ 0xff) * 16777619u;
+	}
+	return h;
+}
+
+static uint32_t journal_check (Journal const* j, JournalRecord const* r)
+{
+	return j->layout ^ (((uint32_t)r->slot << 16) | (uint16_t)r->value) ^ 0x5a5a5a5a;
+}
+
+static bool journal_write_header (Journal* j)
+{
+	uint32_t hdr[2] = { JOURNAL_MAGIC, j->layout };
+	return ftruncate (j->fd, 0) == 0
+		&& lseek (j->fd, 0, SEEK_SET) == 0
+		&& write (j->fd, hdr, sizeof (hdr)) == sizeof (hdr);
+}
+
+/* write buffered records, group commit */
+static void journal_sync (Journal* j)
+{
+	if (j->n_buf == 0) {
+		return;
+	}
+	const ssize_t len = j->n_buf * sizeof (JournalRecord);
+	if (write (j->fd, j->buf, len) != len) {
+		fprintf (stderr, "Journal: write failed: %s\n", strerror (errno));
+	}
+	fdatasync (j->fd);
+	j->n_log += j->n_buf;
+	j->n_buf = 0;
+	j->t_pending = 0;
+	++j->n_commits;
+}
+
+/* replace the snapshot with the shadow state and truncate the log */
+static bool journal_checkpoint (RobTkApp* ui)
+{
+	Journal* j = &ui->journal;
+	journal_sync (j);
+
+	char* tmp = malloc (strlen (j->snapshot) + 5);
+	sprintf (tmp, "%s.tmp", j->snapshot);
+	FILE* f = fopen (tmp, "w");
+	if (!f) {
+		fprintf (stderr, "Journal: cannot write '%s'\n", tmp);
+		free (tmp);
+		return false;
+	}
+	scene_write (ui, f, &j->shadow);
+	bool ok = fflush (f) == 0 && fsync (fileno (f)) == 0;
+	ok &= fclose (f) == 0;
+	/* the log is only truncated once the snapshot is durable */
+	ok = ok && rename (tmp, j->snapshot) == 0 && journal_write_header (j) && fdatasync (j->fd) == 0;
+	free (tmp);
+
+	j->n_log = 0;
+	j->t_checkpoint = mono_usec ();
+	if (verbose > 1) {
+		printf ("Journal: checkpoint %s\n", ok ? "done" : "failed");
+	}
+	return ok;
+}
+
+static void journal_append (Journal* j, unsigned int slot, int16_t value)
+{
+	if (j->n_buf == JOURNAL_BUF) {
+		journal_sync (j);
+	}
+	JournalRecord* r = &j->buf[j->n_buf++];
+	r->slot  = slot;
+	r->value = value;
+	r->check = journal_check (j, r);
+	if (j->t_pending == 0) {
+		j->t_pending = mono_usec ();
+	}
+}
+
+/* record changed controls, called from port_event() */
+static void journal_update (RobTkApp* ui)
+{
+	Journal* j = &ui->journal;
+	if (j->fd < 0) {
+		return;
+	}
+	for (unsigned int k = 0; k < ui->n_changed; ++k) {
+		const unsigned int i = ui->changed[k];
+		SmCtrl* c = &ui->sm.ctrl[i];
+		if (ctrl_has_db (c)) {
+			int16_t v = lrintf (sm_get_dB (c));
+			if (v != j->shadow.db[i]) {
+				j->shadow.db[i] = v;
+				journal_append (j, SLOT_DB (i), v);
+			}
+		}
+		if (ctrl_has_val (c)) {
+			int16_t v = ctrl_get_val (c);
+			if (v != j->shadow.val[i]) {
+				j->shadow.val[i] = v;
+				journal_append (j, SLOT_VAL (i), v);
+			}
+		}
+	}
+
+	const int64_t now = mono_usec ();
+	if (j->t_pending && now - j->t_pending >= JOURNAL_COMMIT) {
+		journal_sync (j);
+	}
+	if (j->n_log >= JOURNAL_COMPACT || (j->n_log > 0 && now - j->t_checkpoint >= JOURNAL_CHECKPOINT)) {
+		journal_checkpoint (ui);
+	}
+}
+
+/* replay log records into the shadow state, returns number of records */
+static unsigned int journal_replay (RobTkApp* ui, int fd)
+{
+	Journal* j = &ui->journal;
+	uint32_t hdr[2];
+	if (read (fd, hdr, sizeof (hdr)) != sizeof (hdr) || hdr[0] != JOURNAL_MAGIC || hdr[1] != j->layout) {
+		return 0;
+	}
+	unsigned int n = 0;
+	JournalRecord r;
+	while (read (fd, &r, sizeof (r)) == sizeof (r)) {
+		if (r.check != journal_check (j, &r) || r.slot >= 2 * ui->sm.ctrl_cnt) {
+			break; // torn write
+		}
+		if (r.slot & 1) {
+			j->shadow.val[r.slot / 2] = r.value;
+		} else {
+			j->shadow.db[r.slot / 2] = r.value;
+		}
+		++n;
+	}
+	return n;
+}
+
+static bool journal_open (RobTkApp* ui, const char* dir)
+{
+	Journal* j = &ui->journal;
+	char name[64];
+	size_t len = strlen (dir) + sizeof (name) + 16;
+
+	/* one journal per model */
+	snprintf (name, sizeof (name), "%s", ui->sm.device->name);
+	for (char* p = name; *p; ++p) {
+		if (*p == ' ' || *p == '/') {
+			*p = '_';
+		}
+	}
+	j->log      = malloc (len);
+	j->snapshot = malloc (len);
+	snprintf (j->log, len, "%s/%s.journal", dir, name);
+	snprintf (j->snapshot, len, "%s/%s.snapshot", dir, name);
+	j->layout = journal_layout (ui);
+
+	if (!scene_alloc (ui, &j->shadow)) {
+		return false;
+	}
+
+	/* shadow = device < snapshot < log */
+	if (access (j->snapshot, R_OK) == 0) {
+		scene_load (ui, j->snapshot, &j->shadow);
+	} else {
+		scene_capture (ui, &j->shadow);
+	}
+	unsigned int n_replay = 0;
+	int fd = open (j->log, O_RDONLY);
+	if (fd >= 0) {
+		n_replay = journal_replay (ui, fd);
+		close (fd);
+	}
+
+	/* apply minimal diff */
+	unsigned int n_mod = scene_apply (ui, &j->shadow);
+
+	j->fd = open (j->log, O_WRONLY | O_CREAT, 0644);
+	if (j->fd < 0) {
+		fprintf (stderr, "Journal: cannot open '%s': %s\n", j->log, strerror (errno));
+		return false;
+	}
+	/* start with a compacted log */
+	journal_checkpoint (ui);
+	lseek (j->fd, 0, SEEK_END);
+
+	if (verbose) {
+		printf ("Journal: replayed %u records, restored %u controls.\n", n_replay, n_mod);
+	}
+	return true;
+}
+
+static void journal_close (RobTkApp* ui)
+{
+	Journal* j = &ui->journal;
+	if (j->fd >= 0) {
+		if (j->n_log > 0 || j->n_buf > 0) {
+			journal_checkpoint (ui);
+		}
+		close (j->fd);
+		if (verbose) {
+			printf ("Journal: %u commits.\n", j->n_commits);
+		}
+	}
+	j->fd = -1;
+	scene_free (&j->shadow);
+	free (j->log);
+	free (j->snapshot);
+	j->log = j->snapshot = NULL;
+}
+
+/* *****************************************************************************
+ * Scene Morphing
+ *
+ * For every control that differs between scene A and B the whole-dB steps
+ * (gains, interpolated in knob position) or the flip (enum, switch) are
+ * precomputed as a list of fader positions. Moving the fader only visits
+ * the steps between the old and new position, so cost is proportional to
+ * the number of changed values, not to the size of the matrix.
+ */
+
+static int morph_step_cmp (const void* a, const void* b)
+{
+	const float pa = ((MorphStep const*)a)->pos;
+	const float pb = ((MorphStep const*)b)->pos;
+	return (pa > pb) - (pa < pb);
+}
+
+static void morph_free (Morph* m)
+{
+	scene_free (&m->scene[0]);
+	scene_free (&m->scene[1]);
+	free (m->step);
+	m->step    = NULL;
+	m->n_steps = 0;
+}
+
+static bool morph_build (RobTkApp* ui, Morph* m)
+{
+	Scene const* a = &m->scene[0];
+	Scene const* b = &m->scene[1];
+	size_t n = 0;
+
+	for (unsigned int i = 0; i < ui->sm.ctrl_cnt; ++i) {
+		SmCtrl const* c = &ui->sm.ctrl[i];
+		if (ctrl_has_db (c)) {
+			n += abs (b->db[i] - a->db[i]);
+		}
+		if (ctrl_has_val (c) && a->val[i] != b->val[i]) {
+			++n;
+		}
+	}
+
+	m->step = malloc ((n ? n : 1) * sizeof (MorphStep));
+	if (!m->step) {
+		return false;
+	}
+
+	MorphStep* s = m->step;
+	for (unsigned int i = 0; i < ui->sm.ctrl_cnt; ++i) {
+		SmCtrl const* c = &ui->sm.ctrl[i];
+		if (ctrl_has_db (c) && a->db[i] != b->db[i]) {
+			const int   lo = a->db[i] < b->db[i] ? a->db[i] : b->db[i];
+			const int   hi = a->db[i] < b->db[i] ? b->db[i] : a->db[i];
+			const float ka = db_to_knob (a->db[i]);
+			const float kb = db_to_knob (b->db[i]);
+			for (int d = lo; d < hi; ++d) {
+				/* knob_to_db() rounds, the value changes half-way between steps */
+				s->pos  = (db_to_knob (d + .5f) - ka) / (kb - ka);
+				s->slot = SLOT_DB (i);
+				s->lo   = a->db[i] < b->db[i] ? d : d + 1;
+				s->hi   = a->db[i] < b->db[i] ? d + 1 : d;
+				++s;
+			}
+		}
+		if (ctrl_has_val (c) && a->val[i] != b->val[i]) {
+			s->pos  = m->flip;
+			s->slot = SLOT_VAL (i);
+			s->lo   = a->val[i];
+			s->hi   = b->val[i];
+			++s;
+		}
+	}
+	m->n_steps = s - m->step;
+	qsort (m->step, m->n_steps, sizeof (MorphStep), morph_step_cmp);
+	return true;
+}
+
+/* index of the first step with pos > p */
+static size_t morph_bound (Morph const* m, float p)
+{
+	size_t lo = 0, hi = m->n_steps;
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		if (m->step[mid].pos > p) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+	return lo;
+}
+
+/* move the morph fader, returns the number of controls written */
+static unsigned int morph_set (RobTkApp* ui, float pos)
+{
+	Morph* m = &ui->morph;
+	if (!m->step || pos == m->pos) {
+		return 0;
+	}
+	size_t from = morph_bound (m, m->pos);
+	size_t to   = morph_bound (m, pos);
+
+	if (pos > m->pos) {
+		for (size_t i = from; i < to; ++i) {
+			batch_queue (&ui->batch, m->step[i].slot, m->step[i].hi);
+		}
+	} else {
+		for (size_t i = from; i > to; --i) {
+			batch_queue (&ui->batch, m->step[i - 1].slot, m->step[i - 1].lo);
+		}
+	}
+	m->pos = pos;
+
+	/* only the last value per control is written */
+	const unsigned int n_written = batch_flush (ui);
+
+	if (verbose > 1) {
+		printf ("Morph %.3f: %u controls, %zu steps\n", pos, n_written, to > from ? to - from : from - to);
+	}
+	return n_written;
+}
+
+/* load scenes, and recall scene A */
+static bool morph_init (RobTkApp* ui, const char* path_a, const char* path_b, float flip)
+{
+	Morph* m = &ui->morph;
+	m->flip = fmaxf (flip, 1e-6f); // steps apply once the fader moves past them
+	if (!scene_alloc (ui, &m->scene[0]) || !scene_alloc (ui, &m->scene[1])
+	    || !scene_load (ui, path_a, &m->scene[0]) || !scene_load (ui, path_b, &m->scene[1])
+	    || !morph_build (ui, m)) {
+		morph_free (m);
+		return false;
+	}
+
+	unsigned int n_mod = 0;
+	for (unsigned int i = 0; i < ui->sm.ctrl_cnt; ++i) {
+		SmCtrl* c = &ui->sm.ctrl[i];
+		if (ctrl_has_db (c) && lrintf (sm_get_dB (c)) != m->scene[0].db[i]) {
+			sm_set_dB (c, m->scene[0].db[i]);
+			++n_mod;
+		}
+		if (ctrl_has_val (c) && ctrl_get_val (c) != m->scene[0].val[i]) {
+			ctrl_set_val (c, m->scene[0].val[i]);
+			++n_mod;
+		}
+	}
+	m->pos = 0;
+
+	if (verbose) {
+		printf ("Morph: %zu steps, recalled scene A with %u changes.\n", m->n_steps, n_mod);
+	}
+	return true;
+}
+
+/* *****************************************************************************
+ * MIDI Control Surface
+ *
+ * An ALSA sequencer client with a learnable CC/NRPN to control map.
+ * Events are handled on a dedicated thread which writes controls by numid
+ * using its own control handle; pending events are drained first so each
+ * mapped control is written once per wakeup. The GUI is not involved, it
+ * picks up the change notification from the device like any other change.
+ *
+ * Map file, one per line: <cc|nrpn> <channel> <param> <dB|mute> <control name>
+ */
+
+static bool midi_target (RobTkApp* ui, MidiTarget* t, SmCtrl const* c, bool mute)
+{
+	SmCtlElem const* e = mute ? &c->cs : &c->cv;
+	if (!e->numid || (mute && !(c->caps & SM_CAP_PSW)) || (!mute && !ctrl_has_db (c))) {
+		return false;
+	}
+	t->numid = e->numid;
+	t->count = e->count;
+	t->type  = e->type;
+	t->min   = e->min;
+	t->max   = e->max;
+	t->mute  = mute;
+	t->slot  = mute ? SLOT_VAL (c - ui->sm.ctrl) : SLOT_DB (c - ui->sm.ctrl);
+	if (e->tlv) {
+		memcpy (t->tlv, e->tlv, sizeof (t->tlv));
+	}
+	return true;
+}
+
+/* arm MIDI learn, the next CC or NRPN is mapped to the given control */
+static void midi_learn (RobTkApp* ui, SmCtrl const* c, bool mute)
+{
+	Midi* m = &ui->midi;
+	if (!m->seq) {
+		return;
+	}
+	pthread_mutex_lock (&m->lock);
+	m->learn_armed = midi_target (ui, &m->learn, c, mute);
+	pthread_mutex_unlock (&m->lock);
+	if (verbose) {
+		printf ("MIDI learn: %s%s\n", c->name, m->learn_armed ? (mute ? " (mute)" : "") : " -- not available");
+	}
+}
+
+static MidiMap* midi_map_find (Midi* m, bool nrpn, unsigned int chn, unsigned int param)
+{
+	for (int i = 0; i < m->n_map; ++i) {
+		MidiMap* mm = &m->map[i];
+		if (mm->nrpn == nrpn && mm->channel == chn && mm->param == param) {
+			return mm;
+		}
+	}
+	return NULL;
+}
+
+static MidiMap* midi_map_add (Midi* m, bool nrpn, unsigned int chn, unsigned int param, MidiTarget const* t)
+{
+	MidiMap* mm = midi_map_find (m, nrpn, chn, param);
+	if (!mm) {
+		if (m->n_map >= MIDI_MAP_MAX) {
+			return NULL;
+		}
+		mm = &m->map[m->n_map++];
+		mm->nrpn    = nrpn;
+		mm->channel = chn;
+		mm->param   = param;
+	}
+	mm->t     = *t;
+	mm->dirty = false;
+	return mm;
+}
+
+static void midi_dispatch (Midi* m, bool nrpn, unsigned int chn, unsigned int param, int value)
+{
+	if (m->learn_armed) {
+		m->learn_armed = false;
+		if (midi_map_add (m, nrpn, chn, param, &m->learn)) {
+			m->map_modified = true;
+		}
+	}
+	MidiMap* mm = midi_map_find (m, nrpn, chn, param);
+	if (mm) {
+		mm->value = value;
+		mm->dirty = true;
+	}
+}
+
+static void midi_event (Midi* m, snd_seq_event_t const* ev)
+{
+	snd_seq_ev_ctrl_t const* cc = &ev->data.control;
+	const unsigned int chn = cc->channel & 15;
+	++m->n_events;
+
+	if (ev->type == SND_SEQ_EVENT_NONREGPARAM) {
+		midi_dispatch (m, true, chn, cc->param & 0x3fff, cc->value & 0x3fff);
+		return;
+	}
+	if (ev->type != SND_SEQ_EVENT_CONTROLLER) {
+		return;
+	}
+	/* NRPN sent as plain CCs */
+	switch (cc->param) {
+		case 99:
+			m->nrpn_param[chn] = (m->nrpn_param[chn] & 0x7f) | ((cc->value & 0x7f) << 7);
+			return;
+		case 98:
+			m->nrpn_param[chn] = (m->nrpn_param[chn] & 0x3f80) | (cc->value & 0x7f);
+			return;
+		case 6:
+			m->nrpn_msb[chn] = cc->value & 0x7f;
+			midi_dispatch (m, true, chn, m->nrpn_param[chn], m->nrpn_msb[chn] << 7);
+			return;
+		case 38:
+			midi_dispatch (m, true, chn, m->nrpn_param[chn], (m->nrpn_msb[chn] << 7) | (cc->value & 0x7f));
+			return;
+		default:
+			break;
+	}
+	midi_dispatch (m, false, chn, cc->param & 0x7f, (cc->value & 0x7f) * 16383 / 127);
+}
+
+/* write all pending mapped controls, returns number of writes */
+static unsigned int midi_flush (Midi* m)
+{
+	snd_ctl_elem_value_t* val;
+	snd_ctl_elem_value_alloca (&val);
+	unsigned int n = 0;
+
+	if (!m->ctl && snd_ctl_open (&m->ctl, m->card, 0) < 0) {
+		m->ctl = NULL;
+		return 0;
+	}
+
+	for (int i = 0; i < m->n_map; ++i) {
+		MidiMap* mm = &m->map[i];
+		if (!mm->dirty) {
+			continue;
+		}
+		mm->dirty = false;
+
+		long raw;
+		if (mm->t.mute) {
+			raw = mm->value >= 8192 ? 0 : 1;
+		} else {
+			const long dB = 100 * knob_to_db (mm->value / 16383.f);
+			if (snd_tlv_convert_from_dB (mm->t.tlv, mm->t.min, mm->t.max, dB, 0, &raw) < 0) {
+				continue;
+			}
+		}
+
+		memset (val, 0, snd_ctl_elem_value_sizeof ());
+		snd_ctl_elem_value_set_numid (val, mm->t.numid);
+		for (unsigned int c = 0; c < mm->t.count; ++c) {
+			if (mm->t.type == SND_CTL_ELEM_TYPE_BOOLEAN) {
+				snd_ctl_elem_value_set_boolean (val, c, raw);
+			} else {
+				snd_ctl_elem_value_set_integer (val, c, raw);
+			}
+		}
+		if (snd_ctl_elem_write (m->ctl, val) < 0) {
+			/* device gone, re-open on next event */
+			snd_ctl_close (m->ctl);
+			m->ctl = NULL;
+			break;
+		}
+		mm->written = true;
+		++n;
+	}
+	return n;
+}
+
+static int64_t seq_usec (snd_seq_real_time_t const* t)
+{
+	return t->tv_sec * (int64_t)1000000 + t->tv_nsec / 1000;
+}
+
+/* latency is measured from the sequencer timestamp of the oldest event in a
+ * batch, i.e. includes the time spent queued before the thread woke up */
+static void* midi_thread (void* arg)
+{
+	RobTkApp* ui = (RobTkApp*)arg;
+	Midi*     m  = &ui->midi;
+
+	int nfds = snd_seq_poll_descriptors_count (m->seq, POLLIN);
+	struct pollfd* pfd = (struct pollfd*)calloc (nfds, sizeof (struct pollfd));
+	snd_seq_poll_descriptors (m->seq, pfd, nfds, POLLIN);
+
+	snd_seq_queue_status_t* qs;
+	snd_seq_queue_status_alloca (&qs);
+
+	while (m->run) {
+		if (poll (pfd, nfds, 100) <= 0) {
+			continue;
+		}
+		snd_seq_event_t* ev;
+		int64_t t0 = -1;
+
+		pthread_mutex_lock (&m->lock);
+		while (snd_seq_event_input (m->seq, &ev) >= 0 && ev) {
+			if ((ev->flags & SND_SEQ_TIME_STAMP_MASK) == SND_SEQ_TIME_STAMP_REAL) {
+				const int64_t t = seq_usec (&ev->time.time);
+				if (t0 < 0 || t < t0) {
+					t0 = t;
+				}
+			}
+			midi_event (m, ev);
+		}
+		const unsigned int n = midi_flush (m);
+		pthread_mutex_unlock (&m->lock);
+
+		m->n_writes += n;
+		if (n > 0 && t0 >= 0 && snd_seq_get_queue_status (m->seq, m->queue, qs) == 0) {
+			const int64_t lat = seq_usec (snd_seq_queue_status_get_real_time (qs)) - t0;
+			++m->n_batches;
+			m->lat_sum += lat;
+			if (lat > m->lat_max) {
+				m->lat_max = lat;
+			}
+			if (verbose > 1) {
+				printf ("MIDI: %u writes, %.3f ms after the event\n", n, lat / 1000.0);
+			}
+		}
+	}
+	free (pfd);
+	return NULL;
+}
+
+static void midi_map_load (RobTkApp* ui, const char* path)
+{
+	Midi* m = &ui->midi;
+	FILE* f = fopen (path, "r");
+	if (!f) {
+		return; // created when something is learned
+	}
+	char line[256];
+	char type[8], kind[8];
+	unsigned int chn, param;
+	int off;
+	while (fgets (line, sizeof (line), f)) {
+		if (line[0] == '#' || sscanf (line, "%7s %u %u %7s %n", type, &chn, &param, kind, &off) < 4) {
+			continue;
+		}
+		line[strcspn (line, "\n")] = '\0';
+		SmCtrl* c = ctrl_by_name (ui, line + off);
+		MidiTarget t;
+		if (!c || chn < 1 || chn > 16 || !midi_target (ui, &t, c, !strcmp (kind, "mute"))) {
+			fprintf (stderr, "MIDI: invalid mapping '%s'\n", line);
+			continue;
+		}
+		midi_map_add (m, !strcmp (type, "nrpn"), chn - 1, param, &t);
+	}
+	fclose (f);
+}
+
+static void midi_map_save (RobTkApp* ui, const char* path)
+{
+	Midi* m = &ui->midi;
+	FILE* f = fopen (path, "w");
+	if (!f) {
+		fprintf (stderr, "MIDI: cannot write '%s'\n", path);
+		return;
+	}
+	fprintf (f, "# scarlett-mixer MIDI map, %s\n", ui->sm.device->name);
+	for (int i = 0; i < m->n_map; ++i) {
+		MidiMap const* mm = &m->map[i];
+		fprintf (f, "%s %u %u %s %s\n", mm->nrpn ? "nrpn" : "cc", mm->channel + 1, mm->param,
+		         mm->t.mute ? "mute" : "dB", ui->sm.ctrl[mm->t.slot / 2].name);
+	}
+	fclose (f);
+}
+
+/* flush queued GUI writes, minus those superseded by MIDI writes since the
+ * last call. The map lock keeps MIDI writes from landing in between */
+static void midi_batch_flush (RobTkApp* ui)
+{
+	Midi* m = &ui->midi;
+	if (!m->seq) {
+		if (ui->batch.n_dirty > 0) {
+			batch_flush (ui);
+		}
+		return;
+	}
+	pthread_mutex_lock (&m->lock);
+	for (int i = 0; i < m->n_map; ++i) {
+		MidiMap* mm = &m->map[i];
+		if (mm->written) {
+			mm->written = false;
+			batch_cancel (&ui->batch, mm->t.slot);
+		}
+	}
+	if (ui->batch.n_dirty > 0) {
+		batch_flush (ui);
+	}
+	pthread_mutex_unlock (&m->lock);
+}
+
+static bool midi_start (RobTkApp* ui, const char* map_file)
+{
+	Midi* m = &ui->midi;
+	/* duplex, starting the queue is an output event */
+	if (snd_seq_open (&m->seq, "default", SND_SEQ_OPEN_DUPLEX, SND_SEQ_NONBLOCK) < 0) {
+		fprintf (stderr, "MIDI: cannot open ALSA sequencer\n");
+		m->seq = NULL;
+		return false;
+	}
+	snd_seq_set_client_name (m->seq, "Scarlett Mixer");
+
+	m->queue = snd_seq_alloc_named_queue (m->seq, "Scarlett Mixer");
+
+	snd_seq_port_info_t* pi;
+	snd_seq_port_info_alloca (&pi);
+	snd_seq_port_info_set_name (pi, "control");
+	snd_seq_port_info_set_capability (pi, SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE);
+	snd_seq_port_info_set_type (pi, SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION);
+	snd_seq_port_info_set_timestamping (pi, 1);
+	snd_seq_port_info_set_timestamp_real (pi, 1);
+	snd_seq_port_info_set_timestamp_queue (pi, m->queue);
+
+	if (m->queue < 0
+	    || snd_seq_create_port (m->seq, pi) < 0
+	    || snd_seq_start_queue (m->seq, m->queue, NULL) < 0
+	    || snd_seq_drain_output (m->seq) < 0) {
+		fprintf (stderr, "MIDI: cannot create sequencer port\n");
+		snd_seq_close (m->seq);
+		m->seq = NULL;
+		return false;
+	}
+
+	pthread_mutex_init (&m->lock, NULL);
+	m->card     = strdup (ui->card);
+	m->map_file = map_file;
+	midi_map_load (ui, map_file);
+
+	m->run = true;
+	if (pthread_create (&m->thread, NULL, midi_thread, ui)) {
+		fprintf (stderr, "MIDI: cannot start thread\n");
+		m->run = false;
+		pthread_mutex_destroy (&m->lock);
+		free (m->card);
+		snd_seq_close (m->seq);
+		m->seq  = NULL;
+		m->card = NULL;
+		return false;
+	}
+	if (verbose) {
+		printf ("MIDI: sequencer client %d, %d mappings.\n", snd_seq_client_id (m->seq), m->n_map);
+	}
+	return true;
+}
+
+static void midi_stop (RobTkApp* ui)
+{
+	Midi* m = &ui->midi;
+	if (!m->seq) {
+		return;
+	}
+	m->run = false;
+	pthread_join (m->thread, NULL);
+
+	if (m->map_modified) {
+		midi_map_save (ui, m->map_file);
+	}
+	if (verbose && m->n_batches > 0) {
+		printf ("MIDI: %u events, %u writes, latency avg %.3f ms, max %.3f ms\n",
+				m->n_events, m->n_writes,
+				m->lat_sum / (1000.0 * m->n_batches), m->lat_max / 1000.0);
+	}
+	if (m->ctl) {
+		snd_ctl_close (m->ctl);
+	}
+	snd_seq_close (m->seq);
+	pthread_mutex_destroy (&m->lock);
+	free (m->card);
+	m->seq  = NULL;
+	m->ctl  = NULL;
+	m->card = NULL;
+}
+
+/* *****************************************************************************
+ * Metrics exporter
+ *
+ * Serves a Prometheus text page over HTTP on a UNIX socket or loopback TCP
+ * port. Connections are non-blocking and served from port_event(), the
+ * request is read (possibly over several calls) before the response is
+ * sent. All values come from the control cache, a scrape never reads the
+ * device.
+ */
+
+#define METRICS_PAGE_SIZE 16384
+#define METRICS_TIMEOUT   5000000 // usec, per connection
+
+static int metrics_page (RobTkApp* ui, char* p, size_t size)
+{
+	SmDevice const* d = ui->sm.device;
+	const bool up = ui->sm.mixer != NULL;
+	size_t len = 0;
+#define OUT(...) do { int n = snprintf (p + len, size - len, __VA_ARGS__); if (n > 0 && (size_t)n < size - len) len += n; } while (0)
+
+	OUT ("# HELP scarlett_up Device is connected.\n# TYPE scarlett_up gauge\nscarlett_up %d\n", up ? 1 : 0);
+
+	if (up && d->smst) {
+		OUT ("# HELP scarlett_master_gain_db Master gain.\n# TYPE scarlett_master_gain_db gauge\n");
+		OUT ("scarlett_master_gain_db %.0f\n", sm_get_dB (sm_mst_gain (&ui->sm)));
+		OUT ("# HELP scarlett_master_mute Master mute.\n# TYPE scarlett_master_mute gauge\n");
+		OUT ("scarlett_master_mute %d\n", sm_get_mute (sm_mst_gain (&ui->sm)) ? 1 : 0);
+	}
+	if (up && d->smst + d->samo > 0) {
+		OUT ("# HELP scarlett_output_gain_db Output gain.\n# TYPE scarlett_output_gain_db gauge\n");
+		for (unsigned int o = 0; o < d->smst; ++o) {
+			OUT ("scarlett_output_gain_db{output=\"%s\"} %.0f\n", sm_out_gain_label (&ui->sm, o), sm_get_dB (sm_out_gain (&ui->sm, o)));
+		}
+		for (unsigned int o = 0; o < d->samo; ++o) {
+			OUT ("scarlett_output_gain_db{output=\"%s\"} %.0f\n", sm_aux_gain_label (&ui->sm, o), sm_get_dB (sm_aux_gain (&ui->sm, o)));
+		}
+	}
+	if (up && d->smst) {
+		OUT ("# HELP scarlett_output_mute Output mute.\n# TYPE scarlett_output_mute gauge\n");
+		for (unsigned int o = 0; o < d->smst; ++o) {
+			OUT ("scarlett_output_mute{output=\"%s\"} %d\n", sm_out_gain_label (&ui->sm, o), sm_get_mute (sm_out_gain (&ui->sm, o)) ? 1 : 0);
+		}
+	}
+	if (up) {
+		OUT ("# HELP scarlett_matrix_active_crosspoints Cross-points above -inf.\n# TYPE scarlett_matrix_active_crosspoints gauge\n");
+		OUT ("scarlett_matrix_active_crosspoints %u\n", ui->routes.n);
+	}
+
+	OUT ("# HELP scarlett_control_writes_total Control writes.\n# TYPE scarlett_control_writes_total counter\n");
+	SmWriteStats const* ws = sm_write_stats ();
+	OUT ("scarlett_control_writes_total %llu\n", (unsigned long long)ws->n_writes);
+
+	/* quantiles over the most recent writes */
+	const unsigned int n = ws->n_writes < SM_WSTAT_RING ? ws->n_writes : SM_WSTAT_RING;
+	if (n > 0) {
+		uint32_t lat[SM_WSTAT_RING];
+		memcpy (lat, ws->lat, n * sizeof (uint32_t));
+		qsort (lat, n, sizeof (uint32_t), cmp_u32);
+		OUT ("# HELP scarlett_control_write_latency_seconds Control write duration.\n# TYPE scarlett_control_write_latency_seconds summary\n");
+		OUT ("scarlett_control_write_latency_seconds{quantile=\"0.5\"} %g\n", lat[n / 2] * 1e-6);
+		OUT ("scarlett_control_write_latency_seconds{quantile=\"0.9\"} %g\n", lat[n * 9 / 10] * 1e-6);
+		OUT ("scarlett_control_write_latency_seconds{quantile=\"0.99\"} %g\n", lat[n * 99 / 100] * 1e-6);
+		OUT ("scarlett_control_write_latency_seconds_count %u\n", n);
+	}
+
+	OUT ("# HELP scarlett_write_rate_limit Max. batched control writes per second.\n# TYPE scarlett_write_rate_limit gauge\n");
+	OUT ("scarlett_write_rate_limit %g\n", ui->throttle.rate);
+	OUT ("# HELP scarlett_write_batch_limit Max. control writes per flush.\n# TYPE scarlett_write_batch_limit gauge\n");
+	OUT ("scarlett_write_batch_limit %u\n", ui->throttle.batch);
+
+	OUT ("# HELP scarlett_alsa_events_total Control changes reported by the device.\n# TYPE scarlett_alsa_events_total counter\n");
+	OUT ("scarlett_alsa_events_total %llu\n", (unsigned long long)ui->n_events);
+	OUT ("# HELP scarlett_reconnects_total Device re-attachments.\n# TYPE scarlett_reconnects_total counter\n");
+	OUT ("scarlett_reconnects_total %d\n", ui->reconnect_cnt);
+	OUT ("# HELP scarlett_gui_invalidations_total Changed controls to be shown.\n# TYPE scarlett_gui_invalidations_total counter\n");
+	OUT ("scarlett_gui_invalidations_total %llu\n", (unsigned long long)ui->redraw.n_invalidations);
+	OUT ("# HELP scarlett_gui_frames_total GUI updates.\n# TYPE scarlett_gui_frames_total counter\n");
+	OUT ("scarlett_gui_frames_total %llu\n", (unsigned long long)ui->redraw.n_frames);
+#undef OUT
+	return len;
+}
+
+/* listen on a loopback port (all digits) or UNIX socket path */
+static bool metrics_open (RobTkApp* ui, const char* where)
+{
+	int fd;
+	if (strspn (where, "0123456789") == strlen (where)) {
+		struct sockaddr_in sa;
+		memset (&sa, 0, sizeof (sa));
+		sa.sin_family      = AF_INET;
+		sa.sin_port        = htons (atoi (where));
+		sa.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+		int one = 1;
+		fd = socket (AF_INET, SOCK_STREAM, 0);
+		if (fd >= 0) {
+			setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof (one));
+			if (bind (fd, (struct sockaddr*)&sa, sizeof (sa)) < 0) {
+				close (fd);
+				fd = -1;
+			}
+		}
+	} else {
+		struct sockaddr_un sa;
+		memset (&sa, 0, sizeof (sa));
+		sa.sun_family = AF_UNIX;
+		if (strlen (where) >= sizeof (sa.sun_path)) {
+			fprintf (stderr, "Metrics: socket path too long\n");
+			return false;
+		}
+		strcpy (sa.sun_path, where);
+		unlink (where);
+		fd = socket (AF_UNIX, SOCK_STREAM, 0);
+		if (fd >= 0 && bind (fd, (struct sockaddr*)&sa, sizeof (sa)) < 0) {
+			close (fd);
+			fd = -1;
+		}
+		if (fd >= 0) {
+			ui->metrics_path = strdup (where);
+		}
+	}
+	if (fd < 0 || listen (fd, 4) < 0 || fcntl (fd, F_SETFL, O_NONBLOCK) < 0) {
+		fprintf (stderr, "Metrics: cannot listen on '%s': %s\n", where, strerror (errno));
+		if (fd >= 0) {
+			close (fd);
+		}
+		return false;
+	}
+	ui->metrics_fd = fd;
+	return true;
+}
+
+static void metrics_drop (MetricsClient* mc)
+{
+	close (mc->fd);
+	free (mc->out);
+	mc->fd  = -1;
+	mc->out = NULL;
+}
+
+static void metrics_close (RobTkApp* ui)
+{
+	if (ui->metrics_fd >= 0) {
+		for (int i = 0; i < METRICS_CLIENTS; ++i) {
+			if (ui->metrics_client[i].fd >= 0) {
+				metrics_drop (&ui->metrics_client[i]);
+			}
+		}
+		close (ui->metrics_fd);
+	}
+	if (ui->metrics_path) {
+		unlink (ui->metrics_path);
+	}
+	free (ui->metrics_path);
+	ui->metrics_fd   = -1;
+	ui->metrics_path = NULL;
+}
+
+/* read the request, then reply; false when the connection is done */
+static bool metrics_client_io (RobTkApp* ui, MetricsClient* mc)
+{
+	if (!mc->out) {
+		const ssize_t n = recv (mc->fd, mc->req + mc->n_req, sizeof (mc->req) - 1 - mc->n_req, 0);
+		if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+			return false;
+		}
+		if (n > 0) {
+			mc->n_req += n;
+			mc->req[mc->n_req] = '\0';
+		}
+		/* the request itself is not relevant, only its end */
+		if (!strstr (mc->req, "\r\n\r\n") && !strstr (mc->req, "\n\n") && mc->n_req < sizeof (mc->req) - 1) {
+			return true;
+		}
+		char page[METRICS_PAGE_SIZE];
+		const int len = metrics_page (ui, page, sizeof (page));
+		mc->out = malloc (len + 128);
+		if (!mc->out) {
+			return false;
+		}
+		mc->n_out = snprintf (mc->out, 128,
+				"HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %d\r\n\r\n", len);
+		memcpy (mc->out + mc->n_out, page, len);
+		mc->n_out += len;
+		mc->sent = 0;
+	}
+	const ssize_t n = send (mc->fd, mc->out + mc->sent, mc->n_out - mc->sent, MSG_NOSIGNAL);
+	if (n < 0) {
+		return errno == EAGAIN || errno == EWOULDBLOCK;
+	}
+	mc->sent += n;
+	return mc->sent < mc->n_out;
+}
+
+/* accept and answer pending scrapes, called from port_event() */
+static void metrics_serve (RobTkApp* ui)
+{
+	if (ui->metrics_fd < 0) {
+		return;
+	}
+	const int64_t now = mono_usec ();
+	for (int i = 0; i < METRICS_CLIENTS; ++i) {
+		MetricsClient* mc = &ui->metrics_client[i];
+		if (mc->fd < 0) {
+			int fd = accept (ui->metrics_fd, NULL, NULL);
+			if (fd < 0) {
+				continue;
+			}
+			if (fcntl (fd, F_SETFL, O_NONBLOCK) < 0) {
+				close (fd);
+				continue;
+			}
+			mc->fd    = fd;
+			mc->n_req = 0;
+			mc->t0    = now;
+		}
+		if (!metrics_client_io (ui, mc) || now - mc->t0 > METRICS_TIMEOUT) {
+			metrics_drop (mc);
+		}
+	}
+}
+
+/* *****************************************************************************
+ * Shared memory state export
+ *
+ * Publishes the control values for local readers, see ShmHeader. The
+ * segment is updated from port_event() with the controls reported as
+ * changed, readers never block the writer and need no syscalls.
+ */
+
+static void shm_write_ctrl (RobTkApp* ui, unsigned int i)
+{
+	SmCtrl*   c = &ui->sm.ctrl[i];
+	ShmCtrl* e = &ui->shm->ctrl[i];
+	e->db  = ctrl_has_db (c) ? lrintf (100.f * sm_get_dB (c)) : SHM_NO_DB;
+	e->val = ctrl_has_val (c) ? ctrl_get_val (c) : -1;
+}
+
+static void shm_begin (ShmHeader* h)
+{
+	__atomic_store_n (&h->seq, h->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence (__ATOMIC_RELEASE);
+}
+
+static void shm_end (ShmHeader* h)
+{
+	++h->generation;
+	__atomic_store_n (&h->seq, h->seq + 1, __ATOMIC_RELEASE);
+}
+
+/* publish changed controls, called from port_event() */
+static void shm_update (RobTkApp* ui, bool all)
+{
+	ShmHeader* h = ui->shm;
+	const bool online = ui->sm.mixer != NULL;
+	if (!h || (h->online == online && (!online || (!all && ui->n_changed == 0)))) {
+		return;
+	}
+	shm_begin (h);
+	h->online = online;
+	if (ui->sm.mixer && all) {
+		for (unsigned int i = 0; i < ui->sm.ctrl_cnt; ++i) {
+			shm_write_ctrl (ui, i);
+		}
+	} else if (ui->sm.mixer) {
+		for (unsigned int k = 0; k < ui->n_changed; ++k) {
+			shm_write_ctrl (ui, ui->changed[k]);
+		}
+	}
+	shm_end (h);
+}
+
+static bool shm_open_state (RobTkApp* ui, const char* name)
+{
+	const size_t size = sizeof (ShmHeader) + ui->sm.ctrl_cnt * sizeof (ShmCtrl);
+	int fd = shm_open (name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0 || ftruncate (fd, size) < 0) {
+		fprintf (stderr, "Shm: cannot create '%s': %s\n", name, strerror (errno));
+		if (fd >= 0) {
+			close (fd);
+			shm_unlink (name);
+		}
+		return false;
+	}
+	void* p = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close (fd);
+	if (p == MAP_FAILED) {
+		fprintf (stderr, "Shm: cannot map '%s'\n", name);
+		shm_unlink (name);
+		return false;
+	}
+	ShmHeader* h = (ShmHeader*)p;
+	memset (h, 0, size);
+	h->version    = SHM_VERSION;
+	h->n_ctrl     = ui->sm.ctrl_cnt;
+	h->entry_size = sizeof (ShmCtrl);
+	snprintf (h->device, sizeof (h->device), "%s", ui->sm.device->name);
+	for (unsigned int i = 0; i < ui->sm.ctrl_cnt; ++i) {
+		snprintf (h->ctrl[i].name, sizeof (h->ctrl[i].name), "%s", ui->sm.ctrl[i].name);
+		h->ctrl[i].caps = ui->sm.ctrl[i].caps;
+	}
+	ui->shm      = h;
+	ui->shm_size = size;
+	ui->shm_name = strdup (name);
+
+	shm_update (ui, true);
+	/* readers check the magic last */
+	__atomic_store_n (&h->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+	return true;
+}
+
+static void shm_close (RobTkApp* ui)
+{
+	if (!ui->shm) {
+		return;
+	}
+	ui->shm->magic = 0;
+	munmap (ui->shm, ui->shm_size);
+	shm_unlink (ui->shm_name);
+	free (ui->shm_name);
+	ui->shm = NULL;
+	ui->shm_name = NULL;
+}
+
+/* *****************************************************************************
+ * Matrix view
+ *
+ * Widgets exist for the visible vp_rows x vp_cols cross-points only, the
+ * values of all cross-points are kept in mtx_val and mtx_src. Scrolling
+ * re-binds the same dials, selectors and labels to other cross-points,
+ * so the row and column headers stay in place. The widget name holds the
+ * position in the view. The capture column scrolls along with the rows,
+ * its values are kept in cap_src.
+ */
+
+/* cross-point shown by the view dial at position p */
+static unsigned int mtx_xp (RobTkApp* ui, unsigned int p)
+{
+	const unsigned int r = ui->vp_r0 + p / ui->vp_cols;
+	const unsigned int c = ui->vp_c0 + p % ui->vp_cols;
+	return r * ui->sm.device->smo + c;
+}
+
+/* view dial of a cross-point, NULL if it is scrolled out of view */
+static RobTkDial* mtx_dial (RobTkApp* ui, unsigned int n)
+{
+	const unsigned int r = n / ui->sm.device->smo;
+	const unsigned int c = n % ui->sm.device->smo;
+	if (r < ui->vp_r0 || r >= ui->vp_r0 + ui->vp_rows || c < ui->vp_c0 || c >= ui->vp_c0 + ui->vp_cols) {
+		return NULL;
+	}
+	return ui->mtx_gain[(r - ui->vp_r0) * ui->vp_cols + c - ui->vp_c0];
+}
+
+static RobTkSelect* mtx_sel (RobTkApp* ui, unsigned int r)
+{
+	if (r < ui->vp_r0 || r >= ui->vp_r0 + ui->vp_rows) {
+		return NULL;
+	}
+	return ui->mtx_sel[r - ui->vp_r0];
+}
+
+static int mtx_click_state (float dB)
+{
+	if (dB == -128) {
+		return 1;
+	} else if (dB == 0) {
+		return 2;
+	}
+	return 0;
+}
+
+/* edit a cross-point, as if its dial was turned */
+static void mtx_edit (RobTkApp* ui, unsigned int n, float knob)
+{
+	RobTkDial* d = mtx_dial (ui, n);
+	if (d) {
+		robtk_dial_set_value (d, knob);
+		return;
+	}
+	ui->mtx_val[n] = knob;
+	if (ui->disable_signals || !ui->sm.mixer) return;
+	edit_dB (ui, sm_matrix_ctrl_n (&ui->sm, n), knob_to_db (knob));
+}
+
+/* show mtx_val, mtx_src on the visible widgets (signals disabled) */
+static void mtx_view_refresh (RobTkApp* ui)
+{
+	const unsigned int smo = ui->sm.device->smo;
+	for (unsigned int pr = 0; pr < ui->vp_rows; ++pr) {
+		const unsigned int r = ui->vp_r0 + pr;
+		robtk_select_set_value (ui->mtx_sel[pr], ui->mtx_src[r]);
+		for (unsigned int pc = 0; pc < ui->vp_cols; ++pc) {
+			robtk_dial_set_value (ui->mtx_gain[pr * ui->vp_cols + pc], ui->mtx_val[r * smo + ui->vp_c0 + pc]);
+		}
+	}
+}
+
+/* *****************************************************************************
+ * Matrix kernels
+ *
+ * Full refresh (device to mtx_val, mtx_src), apply (mtx_val, mtx_src to
+ * the device, differing controls only) and reset (force-write) of the
+ * matrix. The bodies are instantiated per known preset with constant
+ * dimensions and control layout, so the index arithmetic folds away.
+ * Other layouts use the generic kernel with control indices computed once.
+ */
+
+static bool sync_enum (SmCtrl* c, int val)
+{
+	if (sm_get_enum (c) == val) {
+		return false;
+	}
+	sm_set_enum (c, val);
+	return true;
+}
+
+static bool sync_dB (SmCtrl* c, float dB)
+{
+	sm_get_dB (c); // refresh cached value
+	const long prev = c->db_val;
+	sm_set_dB (c, dB);
+	return c->db_val != prev;
+}
+
+static bool sync_mute (SmCtrl* c, bool muted)
+{
+	if (sm_get_mute (c) == muted) {
+		return false;
+	}
+	sm_set_mute (c, muted);
+	return true;
+}
+
+static bool sync_switch (SmCtrl* c, bool on)
+{
+	if (sm_get_switch (c) == on) {
+		return false;
+	}
+	sm_set_switch (c, on);
+	return true;
+}
+
+/* SEL and XP are expressions of r (and c), giving the control index */
+#define MTX_REFRESH(SMI, SMO, SEL, XP)                                           \
+	SmCtrl* ctrl = ui->sm.ctrl;                                                    \
+	for (unsigned int r = 0; r < (SMI); ++r) {                                     \
+		ui->mtx_src[r] = sm_get_enum (&ctrl[SEL]);                                   \
+		for (unsigned int c = 0; c < (SMO); ++c) {                                   \
+			ui->mtx_val[r * (SMO) + c] = db_to_knob (sm_get_dB (&ctrl[XP]));           \
+		}                                                                            \
+	}
+
+#define MTX_APPLY(SMI, SMO, SEL, XP)                                             \
+	SmCtrl* ctrl = ui->sm.ctrl;                                                    \
+	unsigned int n_mod = 0;                                                        \
+	for (unsigned int r = 0; r < (SMI); ++r) {                                     \
+		n_mod += sync_enum (&ctrl[SEL], ui->mtx_src[r]);                             \
+		for (unsigned int c = 0; c < (SMO); ++c) {                                   \
+			n_mod += sync_dB (&ctrl[XP], knob_to_db (ui->mtx_val[r * (SMO) + c]));     \
+		}                                                                            \
+	}                                                                              \
+	return n_mod;
+
+#define MTX_RESET(SMI, SMO, SEL, XP)                                             \
+	SmCtrl* ctrl = ui->sm.ctrl;                                                    \
+	for (unsigned int r = 0; r < (SMI); ++r) {                                     \
+		SmCtrl* sctrl = &ctrl[SEL];                                                  \
+		const int val = ui->mtx_src[r];                                              \
+		sm_set_enum (sctrl, (val + 1) % sctrl->n_items);                             \
+		sm_set_enum (sctrl, val);                                                    \
+	}                                                                              \
+	for (unsigned int r = 0; r < (SMI); ++r) {                                     \
+		for (unsigned int c = 0; c < (SMO); ++c) {                                   \
+			SmCtrl* xctrl = &ctrl[XP];                                                 \
+			const float val = knob_to_db (ui->mtx_val[r * (SMO) + c]);                 \
+			sm_set_dB (xctrl, val == -128 ? 127 : -128);                               \
+			sm_set_dB (xctrl, val);                                                    \
+		}                                                                            \
+	}
+
+typedef struct {
+	const char*  name;  //< SmDevice name
+	unsigned int smi, smo;
+	bool         column_major;
+	unsigned int mix_offset, mix_stride;
+	unsigned int in_offset, in_stride;
+	void         (*refresh) (RobTkApp*);
+	unsigned int (*apply) (RobTkApp*);
+	void         (*reset) (RobTkApp*);
+} MtxKernel;
+
+#define MTX_KERNEL_SEL(IN_OFF, IN_STRIDE) ((IN_OFF) + r * (IN_STRIDE))
+#define MTX_KERNEL_XP(COLMAJ, MIX_OFF, MIX_STRIDE) \
+	((COLMAJ) ? (MIX_OFF) + c * (MIX_STRIDE) + r : (MIX_OFF) + r * (MIX_STRIDE) + c)
+
+#define MTX_KERNEL(ID, NAME, SMI, SMO, COLMAJ, MIX_OFF, MIX_STRIDE, IN_OFF, IN_STRIDE)                      \
+	static void mtx_refresh_##ID (RobTkApp* ui) {                                                             \
+		MTX_REFRESH (SMI, SMO, MTX_KERNEL_SEL (IN_OFF, IN_STRIDE), MTX_KERNEL_XP (COLMAJ, MIX_OFF, MIX_STRIDE)) \
+	}                                                                                                         \
+	static unsigned int mtx_apply_##ID (RobTkApp* ui) {                                                       \
+		MTX_APPLY (SMI, SMO, MTX_KERNEL_SEL (IN_OFF, IN_STRIDE), MTX_KERNEL_XP (COLMAJ, MIX_OFF, MIX_STRIDE))   \
+	}                                                                                                         \
+	static void mtx_reset_##ID (RobTkApp* ui) {                                                               \
+		MTX_RESET (SMI, SMO, MTX_KERNEL_SEL (IN_OFF, IN_STRIDE), MTX_KERNEL_XP (COLMAJ, MIX_OFF, MIX_STRIDE))   \
+	}
+
+#define MTX_KERNEL_ENTRY(ID, NAME, SMI, SMO, COLMAJ, MIX_OFF, MIX_STRIDE, IN_OFF, IN_STRIDE) \
+	{ NAME, SMI, SMO, COLMAJ, MIX_OFF, MIX_STRIDE, IN_OFF, IN_STRIDE, mtx_refresh_##ID, mtx_apply_##ID, mtx_reset_##ID },
+
+/* one kernel per preset, from the layouts shared with libscarlettmixer */
+#define MTX_PRESET_KERNEL(ID) MTX_PRESET_X (MTX_KERNEL, ID, SM_MATRIX_##ID)
+#define MTX_PRESET_ENTRY(ID)  MTX_PRESET_X (MTX_KERNEL_ENTRY, ID, SM_MATRIX_##ID)
+#define MTX_PRESET_X(M, ID, P) M (ID, P)
+
+SM_MATRIX_PRESETS (MTX_PRESET_KERNEL)
+
+static void mtx_refresh_generic (RobTkApp* ui) {
+	MTX_REFRESH (ui->sm.device->smi, ui->sm.device->smo, ui->mtx_sel_idx[r], ui->mtx_idx[r * ui->sm.device->smo + c])
+}
+
+static unsigned int mtx_apply_generic (RobTkApp* ui) {
+	MTX_APPLY (ui->sm.device->smi, ui->sm.device->smo, ui->mtx_sel_idx[r], ui->mtx_idx[r * ui->sm.device->smo + c])
+}
+
+static void mtx_reset_generic (RobTkApp* ui) {
+	MTX_RESET (ui->sm.device->smi, ui->sm.device->smo, ui->mtx_sel_idx[r], ui->mtx_idx[r * ui->sm.device->smo + c])
+}
+
+static const MtxKernel mtx_kernels[] = {
+	SM_MATRIX_PRESETS (MTX_PRESET_ENTRY)
+	{ "generic", 0, 0, false, 0, 0, 0, 0, mtx_refresh_generic, mtx_apply_generic, mtx_reset_generic },
+};
+
+#define N_MTX_KERNELS (sizeof (mtx_kernels) / sizeof (mtx_kernels[0]))
+
+/* pick the kernel for the device, needs mtx_idx, mtx_sel_idx allocated */
+static void mtx_kernel_init (RobTkApp* ui)
+{
+	SmDevice const* d = ui->sm.device;
+	const unsigned int generic = N_MTX_KERNELS - 1;
+
+	for (unsigned int r = 0; r < d->smi; ++r) {
+		ui->mtx_sel_idx[r] = sm_matrix_sel (&ui->sm, r) - ui->sm.ctrl;
+		for (unsigned int c = 0; c < d->smo; ++c) {
+			ui->mtx_idx[r * d->smo + c] = sm_matrix_ctrl_cr (&ui->sm, c, r) - ui->sm.ctrl;
+		}
+	}
+
+	ui->mtx_kernel = generic;
+	for (unsigned int i = 0; i < generic; ++i) {
+		MtxKernel const* k = &mtx_kernels[i];
+		if (strcmp (k->name, d->name)) {
+			continue;
+		}
+		if (   k->smi == d->smi && k->smo == d->smo
+		    && k->column_major == d->matrix_mix_column_major
+		    && k->mix_offset == d->matrix_mix_offset && k->mix_stride == d->matrix_mix_stride
+		    && k->in_offset == d->matrix_in_offset && k->in_stride == d->matrix_in_stride) {
+			ui->mtx_kernel = i;
+		} else if (verbose) {
+			printf ("Matrix kernel: layout of '%s' differs from the preset, using generic\n", d->name);
+		}
+		break;
+	}
+}
+
+/* *****************************************************************************
+ * Callbacks
+ */
+
+#define ROUTES_VIEW_MAX 32 // lines
+
+static void routes_view_update (RobTkApp* ui)
+{
+	if (!ui->routes_lbl || !ui->routes.dirty || !robtk_cbtn_get_active (ui->btn_routes)) {
+		return;
+	}
+	char txt[ROUTES_VIEW_MAX * 32];
+	routes_format (ui, txt, sizeof (txt), ROUTES_VIEW_MAX);
+	robtk_lbl_set_text (ui->routes_lbl, txt);
+	ui->routes.dirty = false;
+}
+
+static bool cb_routes (RobWidget* w, void* handle) {
+	RobTkApp* ui = (RobTkApp*)handle;
+	if (robtk_cbtn_get_active (ui->btn_routes)) {
+		ui->routes.dirty = true;
+		routes_view_update (ui);
+		robwidget_show (robtk_lbl_widget (ui->routes_lbl), true);
+	} else {
+		robwidget_hide (robtk_lbl_widget (ui->routes_lbl), true);
+	}
+	return TRUE;
+}
+
+static bool cb_btn_reset (RobWidget* w, void* handle) {
+	RobTkApp* ui = (RobTkApp*)handle;
+	/* toggle all values (force change) */
+
+	for (int r = 0; r < ui->sm.device->sin; ++r) {
+		SmCtrl* sctrl = sm_src_sel (&ui->sm, r);
+		int mcnt = sctrl->n_items;
+		const int val = ui->cap_src[r];
+		sm_set_enum (sctrl, (val + 1) % mcnt);
+		sm_set_enum (sctrl, val);
+	}
+	for (unsigned int o = 0; o < ui->sm.device->sout; ++o) {
+		SmCtrl* sctrl = sm_out_sel (&ui->sm, o);
+		int mcnt = sctrl->n_items;
+		const int val = robtk_select_get_value (ui->out_sel[o]);
+		sm_set_enum (sctrl, (val + 1) % mcnt);
+		sm_set_enum (sctrl, val);
+	}
+
+	mtx_kernels[ui->mtx_kernel].reset (ui);
+	for (unsigned int n = 0; n < ui->sm.device->smst; ++n) {
+		SmCtrl* ctrl = sm_out_gain (&ui->sm, n);
+		const bool mute = robtk_dial_get_state (ui->out_gain[n]) == 1;
+		const float val = knob_to_db (robtk_dial_get_value (ui->out_gain[n]));
+		sm_set_mute (ctrl, !mute);
+		sm_set_mute (ctrl, mute);
+		if (val == -128) {
+			sm_set_dB (ctrl, 127);
+		} else {
+			sm_set_dB (ctrl, -128);
+		}
+		sm_set_dB (ctrl, val);
+	}
+	for (unsigned int n = 0; n < ui->sm.device->samo; ++n) {
+		SmCtrl* ctrl = sm_aux_gain (&ui->sm, n);
+		const float val = knob_to_db (robtk_dial_get_value (ui->aux_gain[n]));
+		if (val == -128) {
+			sm_set_dB (ctrl, 127);
+		} else {
+			sm_set_dB (ctrl, -128);
+		}
+		sm_set_dB (ctrl, val);
+	}
+	return TRUE;
+}
+
+static bool cb_set_hiz (RobWidget* w, void* handle) {
+	RobTkApp* ui = (RobTkApp*)handle;
+	if (ui->disable_signals || !ui->sm.mixer) return TRUE;
+	for (uint32_t i = 0; i < ui->sm.device->num_hiz; ++i) {
+		int val = robtk_cbtn_get_active (ui->btn_hiz[i]) ? 1 : 0;
+		edit_val (ui, sm_hiz (&ui->sm, i), val);
+	}
+	return TRUE;
+}
+
+static bool cb_set_pad (RobWidget* w, void* handle) {
+	RobTkApp* ui = (RobTkApp*)handle;
+	if (ui->disable_signals || !ui->sm.mixer) return TRUE;
+	for (uint32_t i = 0; i < ui->sm.device->num_pad; ++i) {
+		int val = robtk_cbtn_get_active (ui->btn_pad[i]) ? 1 : 0;
+		edit_val (ui, sm_pad (&ui->sm, i), val);
+	}
+	return TRUE;
+}
+
+static bool cb_set_air (RobWidget* w, void* handle) {
+	RobTkApp* ui = (RobTkApp*)handle;
+	if (ui->disable_signals || !ui->sm.mixer) return TRUE;
+	for (uint32_t i = 0; i < ui->sm.device->num_air; ++i) {
+		edit_val (ui, sm_air (&ui->sm, i), robtk_cbtn_get_active (ui->btn_air[i]));
+	}
+	return TRUE;
+}
+
+static bool cb_src_sel (RobWidget* w, void* handle) {
+	RobTkApp* ui = (RobTkApp*)handle;
+	if (ui->disable_signals || !ui->sm.mixer) return TRUE;
+	unsigned int p;
+	memcpy (&p, w->name, sizeof (unsigned int));
+	const unsigned int r = ui->cap_r0 + p;
+	ui->cap_src[r] = robtk_select_get_value (ui->src_sel[p]);
+	edit_val (ui, sm_src_sel (&ui->sm, r), ui->cap_src[r]);
+	return TRUE;
+}
+
+static bool cb_mtx_src (RobWidget* w, void* handle) {
+	RobTkApp* ui = (RobTkApp*)handle;
+	unsigned int p;
+	memcpy (&p, w->name, sizeof (unsigned int));
+	const unsigned int r = ui->vp_r0 + p;
+	const int val = robtk_select_get_value (ui->mtx_sel[p]);
+	ui->mtx_src[r] = val;
+	if (ui->disable_signals || !ui->sm.mixer) return TRUE;
+	edit_val (ui, sm_matrix_sel (&ui->sm, r), val);
+	return TRUE;
+}
+
+static bool cb_mtx_gain (RobWidget* w, void* handle) {
+	RobTkApp* ui = (RobTkApp*)handle;
+	unsigned int p;
+	memcpy (&p, w->name, sizeof (unsigned int));
+	const unsigned int n = mtx_xp (ui, p);
+	const float knob = robtk_dial_get_value (ui->mtx_gain[p]);
+	const float val = knob_to_db (knob);
+	ui->mtx_gain[p]->click_state = mtx_click_state (val);
+	ui->mtx_val[n] = knob;
+	if (ui->disable_signals || !ui->sm.mixer) return TRUE;
+	edit_dB (ui, sm_matrix_ctrl_n (&ui->sm, n), val);
+	return TRUE;
+}
+
+static bool cb_out_src (RobWidget* w, void* handle) {
+	RobTkApp* ui = (RobTkApp*)handle;
+	if (ui->disable_signals || !ui->sm.mixer) return TRUE;
+	unsigned int n;
+	memcpy (&n, w->name, sizeof (unsigned int));
+	const float val = robtk_select_get_value (ui->out_sel[n]);
+	edit_val (ui, sm_out_sel (&ui->sm, n), val);
+	return TRUE;
+}
+
+static bool cb_out_gain (RobWidget* w, void* handle) {
+	RobTkApp* ui = (RobTkApp*)handle;
+	if (ui->disable_signals || !ui->sm.mixer) return TRUE;
+	unsigned int n;
+	memcpy (&n, w->name, sizeof (unsigned int));
+	const bool mute = robtk_dial_get_state (ui->out_gain[n]) == 1;
+	const float val = robtk_dial_get_value (ui->out_gain[n]);
+	edit_val (ui, sm_out_gain (&ui->sm, n), mute);
+	edit_dB (ui, sm_out_gain (&ui->sm, n), knob_to_db (val));
+	return TRUE;
+}
+
+static bool cb_aux_gain (RobWidget* w, void* handle) {
+	RobTkApp* ui = (RobTkApp*)handle;
+	if (ui->disable_signals || !ui->sm.mixer) return TRUE;
+	unsigned int n;
+	memcpy (&n, w->name, sizeof (unsigned int));
+	const float val = robtk_dial_get_value (ui->aux_gain[n]);
+	edit_dB (ui, sm_aux_gain (&ui->sm, n), knob_to_db (val));
+	return TRUE;
+}
+
+static bool cb_undo (RobWidget* w, void* handle) {
+	RobTkApp* ui = (RobTkApp*)handle;
+	if (ui->disable_signals || !ui->sm.mixer) return TRUE;
+	history_undo (ui);
+	return TRUE;
+}
+
+static bool cb_redo (RobWidget* w, void* handle) {
+	RobTkApp* ui = (RobTkApp*)handle;
+	if (ui->disable_signals || !ui->sm.mixer) return TRUE;
+	history_redo (ui);
+	return TRUE;
+}
+
+static bool cb_morph (RobWidget* w, void* handle) {
+	RobTkApp* ui = (RobTkApp*)handle;
+	if (ui->disable_signals || !ui->sm.mixer) return TRUE;
+	morph_set (ui, robtk_scale_get_value (ui->morph_fader));
+	return TRUE;
+}
+
+static bool cb_mst_gain (RobWidget* w, void* handle) {
+	RobTkApp* ui = (RobTkApp*)handle;
+	if (ui->disable_signals || !ui->sm.mixer) return TRUE;
+	const bool mute = robtk_dial_get_state (ui->mst_gain) == 1;
+	const float val = robtk_dial_get_value (ui->mst_gain);
+	edit_val (ui, sm_mst_gain (&ui->sm), mute);
+	edit_dB (ui, sm_mst_gain (&ui->sm), knob_to_db (val));
+	return TRUE;
+}
+
+/* *****************************************************************************
+ * Automation timeline parser
+ *
+ * one move per line: <start-sec> <target> <dB|-inf> <duration-sec> [lin|fader|scurve]
+ * targets: master, out:N, aux:N, mix:IN:MIX (e.g. mix:3:C)
+ */
+
+static SmCtrl* parse_target (RobTkApp* ui, const char* t)
+{
+	unsigned int n;
+	char mix;
+	if (!strcmp (t, "master")) {
+		return ui->sm.device->smst ? sm_mst_gain (&ui->sm) : NULL;
+	}
+	if (sscanf (t, "out:%u", &n) == 1 && n > 0 && n <= ui->sm.device->smst) {
+		return sm_out_gain (&ui->sm, n - 1);
+	}
+	if (sscanf (t, "aux:%u", &n) == 1 && n > 0 && n <= ui->sm.device->samo) {
+		return sm_aux_gain (&ui->sm, n - 1);
+	}
+	if (sscanf (t, "mix:%u:%c", &n, &mix) == 2 && n > 0) {
+		return sm_matrix_ctrl_cr (&ui->sm, toupper (mix) - 'A', n - 1);
+	}
+	return NULL;
+}
+
+static bool automation_parse (RobTkApp* ui, const char* line)
+{
+	char target[32], db[16], curve[16] = "fader";
+	AutoMove m;
+	memset (&m, 0, sizeof (AutoMove));
+
+	while (*line == ' ' || *line == '\t') {
+		++line;
+	}
+	if (*line == '#' || *line == '\n' || *line == '\0') {
+		return true;
+	}
+	if (sscanf (line, "%lf %31s %15s %lf %15s", &m.t_start, target, db, &m.duration, curve) < 4) {
+		fprintf (stderr, "Automation: cannot parse '%s'\n", line);
+		return false;
+	}
+	if (!(m.ctrl = parse_target (ui, target))) {
+		fprintf (stderr, "Automation: invalid target '%s'\n", target);
+		return false;
+	}
+	m.from = NAN;
+	m.to = strcmp (db, "-inf") ? strtof (db, NULL) : -128.f;
+
+	if (!strcmp (curve, "lin")) {
+		m.curve = CURVE_LIN;
+	} else if (!strcmp (curve, "scurve")) {
+		m.curve = CURVE_SCURVE;
+	} else {
+		m.curve = CURVE_FADER;
+	}
+	if (!automation_add (&ui->automation, &m, false)) {
+		fprintf (stderr, "Automation: too many moves\n");
+		return false;
+	}
+	return true;
+}
+
+static bool automation_load (RobTkApp* ui, const char* path)
+{
+	FILE* f = fopen (path, "r");
+	if (!f) {
+		fprintf (stderr, "Automation: cannot open '%s'\n", path);
+		return false;
+	}
+	char line[256];
+	bool rv = true;
+	while (fgets (line, sizeof (line), f)) {
+		rv &= automation_parse (ui, line);
+	}
+	fclose (f);
+	return rv;
+}
+
+/* *****************************************************************************
+ * GUI Helpers
+ */
+
+static void set_select_values (RobTkSelect* s,  SmCtrl* ctrl)
+{
+	if (!ctrl) return;
+	assert (ctrl);
+
+	int mcnt = ctrl->n_items;
+	for (int i = 0; i < mcnt; ++i) {
+		char name[64];
+		if (sm_get_enum_name (ctrl, i, name, sizeof (name)) < 0) {
+			continue;
+		}
+		robtk_select_add_item (s, i, name);
+	}
+	robtk_select_set_value (s, sm_get_enum (ctrl));
+}
+
+static void dial_annotation_db (RobTkDial* d, cairo_t* cr, void* data)
+{
+	RobTkApp* ui = (RobTkApp*)data;
+	char txt[16];
+	snprintf (txt, 16, "%+3.0fdB", knob_to_db (d->cur));
+
+	int tw, th;
+	cairo_save (cr);
+	PangoLayout * pl = pango_cairo_create_layout (cr);
+	pango_layout_set_font_description (pl, ui->font);
+	pango_layout_set_text (pl, txt, -1);
+	pango_layout_get_pixel_size (pl, &tw, &th);
+	cairo_translate (cr, d->w_width / 2, d->w_height - 0);
+	cairo_translate (cr, -tw / 2.0 , -th);
+	cairo_set_source_rgba (cr, .0, .0, .0, .5);
+	rounded_rectangle (cr, -1, -1, tw+3, th+1, 3);
+	cairo_fill (cr);
+	CairoSetSouerceRGBA (c_wht);
+	pango_cairo_show_layout (cr, pl);
+	g_object_unref (pl);
+	cairo_restore (cr);
+	cairo_new_path (cr);
+}
+
+/* render the matrix grid at the given widget scale, the surfaces keep
+ * their logical size and are painted 1:1 by scaled dials */
+static void create_faceplate (RobTkApp *ui, float scale) {
+	cairo_t* cr;
+	float c_bg[4]; get_color_from_theme (1, c_bg);
+	const int sf_w = ceilf (GD_WIDTH * scale);
+	const int sf_h = ceilf (GED_HEIGHT * scale);
+	ui->mtx_sf_scale = scale;
+
+#define MTX_SF(SF)                                                             \
+	SF = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, sf_w, sf_h);           \
+	cairo_surface_set_device_scale (SF, scale, scale);                           \
+	cr = cairo_create (SF);                                                      \
+	cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);                              \
+	cairo_rectangle (cr, 0, 0, GD_WIDTH, GED_HEIGHT);                            \
+	CairoSetSouerceRGBA (c_bg);                                                  \
+	cairo_fill (cr);                                                             \
+	CairoSetSouerceRGBA (c_g60);                                                 \
+	cairo_set_line_cap (cr, CAIRO_LINE_CAP_BUTT);                                \
+	cairo_set_line_width (cr, 1.0);
+
+#define MTX_ARROW_H               \
+	cairo_move_to (cr, 5, GD_CY);   \
+	cairo_rel_line_to (cr, -5, -4); \
+	cairo_rel_line_to (cr, 0, 8);   \
+	cairo_close_path (cr);          \
+	cairo_fill (cr);
+
+#define MTX_ARROW_V                      \
+	cairo_move_to (cr, GD_CX, GED_HEIGHT); \
+	cairo_rel_line_to (cr, -4, -5);        \
+	cairo_rel_line_to (cr, 8, 0);          \
+	cairo_close_path (cr);                 \
+	cairo_fill (cr);
+
+	MTX_SF (ui->mtx_sf[0]);
+	MTX_ARROW_H;
+	MTX_ARROW_V;
+
+	cairo_move_to (cr, 0, GD_CY);
+	cairo_line_to (cr, GD_WIDTH, GD_CY);
+	cairo_stroke (cr);
+	cairo_move_to (cr, GD_CX, 0);
+	cairo_line_to (cr, GD_CX, GED_HEIGHT);
+	cairo_stroke (cr);
+	cairo_destroy (cr);
+
+	// top-row
+	MTX_SF (ui->mtx_sf[1]);
+	MTX_ARROW_H;
+	MTX_ARROW_V;
+
+	cairo_move_to (cr, 0, GD_CY);
+	cairo_line_to (cr, GD_WIDTH, GD_CY);
+	cairo_stroke (cr);
+	cairo_move_to (cr, GD_CX, GD_CY);
+	cairo_line_to (cr, GD_CX, GED_HEIGHT);
+	cairo_stroke (cr);
 	cairo_destroy (cr);
 
-	// left column
-	MTX_SF (ui->mtx_sf[2]);
-	MTX_ARROW_V;
+	// left column
+	MTX_SF (ui->mtx_sf[2]);
+	MTX_ARROW_V;
+
+	cairo_move_to (cr, 0, GD_CY);
+	cairo_line_to (cr, GD_WIDTH, GD_CY);
+	cairo_stroke (cr);
+	cairo_move_to (cr, GD_CX, 0);
+	cairo_line_to (cr, GD_CX, GED_HEIGHT);
+	cairo_stroke (cr);
+	cairo_destroy (cr);
+
+	// right column
+	MTX_SF (ui->mtx_sf[3]);
+	MTX_ARROW_H;
+	MTX_ARROW_V;
+
+	cairo_move_to (cr, 0, GD_CY);
+	cairo_line_to (cr, GD_CX, GD_CY);
+	cairo_stroke (cr);
+	cairo_move_to (cr, GD_CX, 0);
+	cairo_line_to (cr, GD_CX, GED_HEIGHT);
+	cairo_stroke (cr);
+	cairo_destroy (cr);
+
+	// top-left
+	MTX_SF (ui->mtx_sf[4]);
+	MTX_ARROW_V;
+
+	cairo_move_to (cr, 0, GD_CY);
+	cairo_line_to (cr, GD_WIDTH, GD_CY);
+	cairo_stroke (cr);
+	cairo_move_to (cr, GD_CX, GD_CY);
+	cairo_line_to (cr, GD_CX, GED_HEIGHT);
+	cairo_stroke (cr);
+	cairo_destroy (cr);
+
+	// top-right
+	MTX_SF (ui->mtx_sf[5]);
+	MTX_ARROW_H;
+	MTX_ARROW_V;
+
+	cairo_move_to (cr, 0, GD_CY);
+	cairo_line_to (cr, GD_CX, GD_CY);
+	cairo_stroke (cr);
+	cairo_move_to (cr, GD_CX, GD_CY);
+	cairo_line_to (cr, GD_CX, GED_HEIGHT);
+	cairo_stroke (cr);
+	cairo_destroy (cr);
+#undef MTX_SF
+#undef MTX_ARROW_H
+#undef MTX_ARROW_V
+}
+
+/* grid piece of a matrix cross-point */
+static cairo_surface_t* mtx_faceplate (RobTkApp* ui, unsigned int r, unsigned int c)
+{
+	const unsigned int c_last = ui->sm.device->smo - 1;
+	if (c == c_last && r == 0) {
+		return ui->mtx_sf[5];
+	} else if (c == 0 && r == 0) {
+		return ui->mtx_sf[4];
+	} else if (c == c_last) {
+		return ui->mtx_sf[3];
+	} else if (c == 0) {
+		return ui->mtx_sf[2];
+	} else if (r == 0) {
+		return ui->mtx_sf[1];
+	}
+	return ui->mtx_sf[0];
+}
+
+static RobWidget* robtk_dial_mouse_intercept (RobWidget* handle, RobTkBtnEvent *ev) {
+	RobTkDial* d = (RobTkDial *)GET_HANDLE (handle);
+	RobTkApp* ui = (RobTkApp*)d->handle;
+	if (!d->sensitive) { return NULL; }
+
+	if (ev->button == 2 && (ev->state & ROBTK_MOD_CTRL) && (ev->state & ROBTK_MOD_SHIFT)) {
+		/* ctrl + shift + middle-click: stereo pair of the mix */
+		unsigned int p;
+		memcpy (&p, d->rw->name, sizeof (unsigned int));
+		const unsigned int n = mtx_xp (ui, p);
+		int16_t* v = matrix_get (ui);
+		if (v) {
+			matrix_stereo_pair (ui, v, n % ui->sm.device->smo);
+			matrix_apply (ui, v);
+			free (v);
+		}
+		return handle;
+	}
+
+	if (ev->button == 2 && (ev->state & ROBTK_MOD_CTRL)) {
+		/* ctrl + middle-click: MIDI learn */
+		unsigned int p;
+		memcpy (&p, d->rw->name, sizeof (unsigned int));
+		const unsigned int n = mtx_xp (ui, p);
+		midi_learn (ui, sm_matrix_ctrl_n (&ui->sm, n), false);
+		return handle;
+	}
 
-	cairo_move_to (cr, 0, GD_CY);
-	cairo_line_to (cr, GD_WIDTH, GD_CY);
-	cairo_stroke (cr);
-	cairo_move_to (cr, GD_CX, 0);
-	cairo_line_to (cr, GD_CX, GED_HEIGHT);
-	cairo_stroke (cr);
-	cairo_destroy (cr);
+	if (ev->button == 2 && (ev->state & ROBTK_MOD_SHIFT)) {
+		/* shift + middle-click: fade cross-point in or out */
+		unsigned int p;
+		memcpy (&p, d->rw->name, sizeof (unsigned int));
+		const unsigned int n = mtx_xp (ui, p);
+		automation_fade (&ui->automation, sm_matrix_ctrl_n (&ui->sm, n), d->cur == 0 ? 0 : -128, GUI_FADE_TIME);
+		return handle;
+	}
 
-	// right column
-	MTX_SF (ui->mtx_sf[3]);
-	MTX_ARROW_H;
-	MTX_ARROW_V;
+	if (ev->button == 3 && (ev->state & (ROBTK_MOD_SHIFT | ROBTK_MOD_CTRL))) {
+		/* bulk operations on the mix column or input row, never without modifier */
+		unsigned int p;
+		memcpy (&p, d->rw->name, sizeof (unsigned int));
+		const unsigned int n = mtx_xp (ui, p);
+		const unsigned int c = n % ui->sm.device->smo;
+		const unsigned int r = n / ui->sm.device->smo;
+		int16_t* v = matrix_get (ui);
+		if (!v) {
+			return handle;
+		}
+		switch (ev->state & (ROBTK_MOD_SHIFT | ROBTK_MOD_CTRL)) {
+			case ROBTK_MOD_SHIFT:
+				matrix_clear_mix (ui, v, c);
+				break;
+			case ROBTK_MOD_CTRL:
+				matrix_copy_mix (ui, v, c, (c + 1) % ui->sm.device->smo);
+				break;
+			default:
+				matrix_clear_input (ui, v, r);
+				break;
+		}
+		matrix_apply (ui, v);
+		free (v);
+		return handle;
+	}
 
-	cairo_move_to (cr, 0, GD_CY);
-	cairo_line_to (cr, GD_CX, GD_CY);
+	if (ev->button == 2) {
+		/* middle-click exclusively assign output */
+		unsigned int p;
+		memcpy (&p, d->rw->name, sizeof (unsigned int));
+		const unsigned int n = mtx_xp (ui, p);
+
+		unsigned c = n % ui->sm.device->smo;
+		unsigned r = n / ui->sm.device->smo;
+		history_begin (&ui->history);
+		for (uint32_t i = 0; i < ui->sm.device->smo; ++i) {
+			unsigned int nn = r * ui->sm.device->smo + i;
+			if (i == c) {
+				if (d->cur == 0) {
+					mtx_edit (ui, nn, db_to_knob (0));
+				} else {
+					mtx_edit (ui, nn, 0);
+				}
+			} else {
+				mtx_edit (ui, nn, 0);
+			}
+		}
+		history_end (&ui->history);
+		return handle;
+	}
+	return robtk_dial_mousedown (handle, ev);
+}
+
+/* ctrl + scroll on a matrix dial: trim the whole mix */
+static RobWidget* robtk_dial_scroll_intercept (RobWidget* handle, RobTkBtnEvent *ev) {
+	RobTkDial* d = (RobTkDial *)GET_HANDLE (handle);
+	RobTkApp* ui = (RobTkApp*)d->handle;
+	if (!d->sensitive) { return NULL; }
+
+	if (ev->state & ROBTK_MOD_CTRL) {
+		unsigned int p;
+		memcpy (&p, d->rw->name, sizeof (unsigned int));
+		const unsigned int n = mtx_xp (ui, p);
+		int16_t* v = matrix_get (ui);
+		if (v) {
+			matrix_trim_mix (ui, v, n % ui->sm.device->smo, ev->direction == ROBTK_SCROLL_UP ? 1 : -1);
+			matrix_apply (ui, v);
+			free (v);
+		}
+		return handle;
+	}
+	return robtk_dial_scroll (handle, ev);
+}
+
+/* shift + middle-click on output gains: fade out, or back in to 0dB
+ * ctrl + middle-click: MIDI learn gain, ctrl + shift + middle-click: MIDI learn mute
+ */
+static RobWidget* robtk_dial_fade_intercept (RobWidget* handle, RobTkBtnEvent *ev) {
+	RobTkDial* d = (RobTkDial *)GET_HANDLE (handle);
+	RobTkApp* ui = (RobTkApp*)d->handle;
+	if (!d->sensitive) { return NULL; }
+
+	if (ev->button == 2 && (ev->state & (ROBTK_MOD_SHIFT | ROBTK_MOD_CTRL))) {
+		unsigned int n;
+		memcpy (&n, d->rw->name, sizeof (unsigned int));
+		SmCtrl* ctrl = NULL;
+		if (d == ui->mst_gain) {
+			ctrl = sm_mst_gain (&ui->sm);
+		} else if (n < ui->sm.device->smst && d == ui->out_gain[n]) {
+			ctrl = sm_out_gain (&ui->sm, n);
+		} else if (n < ui->sm.device->samo && d == ui->aux_gain[n]) {
+			ctrl = sm_aux_gain (&ui->sm, n);
+		}
+		if (ctrl && (ev->state & ROBTK_MOD_CTRL)) {
+			midi_learn (ui, ctrl, ev->state & ROBTK_MOD_SHIFT);
+		} else if (ctrl) {
+			automation_fade (&ui->automation, ctrl, d->cur == 0 ? 0 : -128, GUI_FADE_TIME);
+		}
+		return handle;
+	}
+	return robtk_dial_mousedown (handle, ev);
+}
+
+/* *****************************************************************************
+ * Matrix tile rendering
+ *
+ * The matrix view is split into tiles of MTX_TILE x MTX_TILE dials, each
+ * cached in an image surface, and dials expose by copying from their tile.
+ * Tiles are only refreshed when the whole view is about to be exposed
+ * (scrolling, rescaling, bulk changes), on a frame and while the window is
+ * visible. Dials that changed since, or that are hovered, draw directly.
+ *
+ * Matrix dials are drawn by mtx_dial_paint() rather than robtk, from a
+ * DialSig and faceplate taken on the GUI thread. That is all a tile needs,
+ * so tiles are rendered by a small worker pool while the GUI thread waits.
+ *
+ * Tiles and the faceplate are rendered at the effective widget scale and
+ * re-created only when it changes, so scaled exposes are plain copies.
+ */
+
+static void dial_sig (RobTkDial const* d, DialSig* s)
+{
+	s->cur         = d->cur;
+	s->click_state = d->click_state;
+	s->sensitive   = d->sensitive;
+}
+
+static bool dial_sig_equal (DialSig const* a, DialSig const* b)
+{
+	return a->cur == b->cur && a->click_state == b->click_state && a->sensitive == b->sensitive;
+}
+
+static MtxTile* tile_at (TileRender* tr, unsigned int r, unsigned int c)
+{
+	return &tr->tile[(r / MTX_TILE) * tr->n_cols + c / MTX_TILE];
+}
+
+/* fill per click-state: other, -inf, 0dB */
+static const float mtx_dial_col[3][4] = {
+	{ .30, .30, .30, 1.0 },
+	{ .12, .12, .12, 1.0 },
+	{ .25, .45, .25, 1.0 },
+};
+
+/* draw a matrix dial at the origin of cr, in device pixels. Only uses its
+ * arguments and cairo, and may run on any thread */
+static void mtx_dial_paint (cairo_t* cr, DialSig const* s, cairo_surface_t* face, float scale)
+{
+	const float ang = (.75 + 1.5 * s->cur) * M_PI;
+	const float dfl = (.75 + 1.5 * db_to_knob (0)) * M_PI;
+
+	cairo_save (cr);
+	cairo_scale (cr, scale, scale);
+
+	/* the faceplate carries its device scale */
+	cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+	cairo_set_source_surface (cr, face, 0, 0);
+	cairo_paint (cr);
+	cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
+
+	if (s->sensitive) {
+		CairoSetSouerceRGBA (mtx_dial_col[s->click_state < 3 ? s->click_state : 0]);
+	} else {
+		cairo_set_source_rgba (cr, .5, .5, .5, .2);
+	}
+	cairo_arc (cr, GD_CX, GD_CY, GED_RADIUS, 0, 2 * M_PI);
+	cairo_fill_preserve (cr);
+	cairo_set_line_width (cr, .75);
+	CairoSetSouerceRGBA (c_blk);
 	cairo_stroke (cr);
-	cairo_move_to (cr, GD_CX, 0);
-	cairo_line_to (cr, GD_CX, GED_HEIGHT);
+
+	/* range, and the gain relative to 0dB */
+	cairo_set_line_width (cr, 1.5);
+	cairo_set_source_rgba (cr, .5, .5, .5, .7);
+	cairo_arc (cr, GD_CX, GD_CY, GED_RADIUS + 1.5, .75 * M_PI, 2.25 * M_PI);
+	cairo_stroke (cr);
+	if (s->sensitive) {
+		cairo_set_source_rgba (cr, .75, .75, .75, .8);
+	}
+	if (ang > dfl) {
+		cairo_arc (cr, GD_CX, GD_CY, GED_RADIUS + 1.5, dfl, ang);
+	} else {
+		cairo_arc_negative (cr, GD_CX, GD_CY, GED_RADIUS + 1.5, dfl, ang);
+	}
 	cairo_stroke (cr);
+
+	/* pointer */
+	if (s->sensitive) {
+		CairoSetSouerceRGBA (c_wht);
+	} else {
+		cairo_set_source_rgba (cr, .5, .5, .5, .7);
+	}
+	cairo_move_to (cr, GD_CX, GD_CY);
+	cairo_line_to (cr, GD_CX + GED_RADIUS * cosf (ang), GD_CY + GED_RADIUS * sinf (ang));
+	cairo_stroke (cr);
+	cairo_restore (cr);
+}
+
+/* render from the tile's sig and face, safe on a worker thread */
+static void tile_render (TileRender* tr, MtxTile* t, unsigned int vc)
+{
+	const float scale = tr->scale;
+	cairo_t* cr = cairo_create (t->sf);
+	for (unsigned int r = t->r0; r < t->r0 + t->nr; ++r) {
+		for (unsigned int c = t->c0; c < t->c0 + t->nc; ++c) {
+			cairo_save (cr);
+			cairo_translate (cr, (c - t->c0) * GD_WIDTH * scale, (r - t->r0) * GED_HEIGHT * scale);
+			mtx_dial_paint (cr, &tr->sig[r * vc + c], tr->face[r * vc + c], scale);
+			cairo_restore (cr);
+		}
+	}
 	cairo_destroy (cr);
+	cairo_surface_flush (t->sf);
+	t->dirty = false;
+}
+
+/* snapshot the dials of a tile, on the GUI thread */
+static void tile_prepare (RobTkApp* ui, MtxTile* t)
+{
+	TileRender* tr = &ui->tiles;
+	const unsigned int vc = ui->vp_cols;
+	for (unsigned int r = t->r0; r < t->r0 + t->nr; ++r) {
+		for (unsigned int c = t->c0; c < t->c0 + t->nc; ++c) {
+			dial_sig (ui->mtx_gain[r * vc + c], &tr->sig[r * vc + c]);
+			tr->face[r * vc + c] = mtx_faceplate (ui, ui->vp_r0 + r, ui->vp_c0 + c);
+		}
+	}
+}
+
+/* only touches ui->tiles, and the view size which is fixed */
+static void* tile_worker (void* arg)
+{
+	RobTkApp* ui = (RobTkApp*)arg;
+	TileRender* tr = &ui->tiles;
+	pthread_mutex_lock (&tr->lock);
+	while (tr->run) {
+		if (tr->next >= tr->n_jobs) {
+			pthread_cond_wait (&tr->work, &tr->lock);
+			continue;
+		}
+		MtxTile* t = &tr->tile[tr->queue[tr->next++]];
+		++tr->n_busy;
+		pthread_mutex_unlock (&tr->lock);
+		tile_render (tr, t, ui->vp_cols);
+		pthread_mutex_lock (&tr->lock);
+		if (--tr->n_busy == 0 && tr->next >= tr->n_jobs) {
+			pthread_cond_signal (&tr->done);
+		}
+	}
+	pthread_mutex_unlock (&tr->lock);
+	return NULL;
+}
+
+/* render the queued tiles, returns when all are done */
+static void tiles_render (RobTkApp* ui, unsigned int n_jobs, bool parallel)
+{
+	TileRender* tr = &ui->tiles;
+	if (!parallel || tr->n_workers == 0 || n_jobs < 2) {
+		for (unsigned int i = 0; i < n_jobs; ++i) {
+			tile_render (tr, &tr->tile[tr->queue[i]], ui->vp_cols);
+		}
+		return;
+	}
+	pthread_mutex_lock (&tr->lock);
+	tr->n_jobs = n_jobs;
+	tr->next   = 0;
+	pthread_cond_broadcast (&tr->work);
+	while (tr->next < tr->n_jobs || tr->n_busy > 0) {
+		pthread_cond_wait (&tr->done, &tr->lock);
+	}
+	tr->n_jobs = 0;
+	pthread_mutex_unlock (&tr->lock);
+}
+
+/* compare a full serial render against the worker pool, once */
+static void tiles_bench (RobTkApp* ui)
+{
+	TileRender* tr = &ui->tiles;
+	for (unsigned int i = 0; i < tr->n_tiles; ++i) {
+		tile_prepare (ui, &tr->tile[i]);
+		tr->queue[i] = i;
+	}
+	const int n_iter = 10;
+	const int64_t t0 = mono_usec ();
+	for (int i = 0; i < n_iter; ++i) {
+		tiles_render (ui, tr->n_tiles, false);
+	}
+	const int64_t t1 = mono_usec ();
+	for (int i = 0; i < n_iter; ++i) {
+		tiles_render (ui, tr->n_tiles, true);
+	}
+	const int64_t t2 = mono_usec ();
+	printf ("Matrix: %u tiles, %u workers, full render serial %.2f ms, parallel %.2f ms (%.1fx)\n",
+			tr->n_tiles, tr->n_workers, (t1 - t0) / (1000.0 * n_iter), (t2 - t1) / (1000.0 * n_iter),
+			t2 > t1 ? (t1 - t0) / (double)(t2 - t1) : 0);
+}
+
+static void tiles_alloc (TileRender* tr, float scale)
+{
+	for (unsigned int i = 0; i < tr->n_tiles; ++i) {
+		MtxTile* t = &tr->tile[i];
+		if (t->sf) {
+			cairo_surface_destroy (t->sf);
+		}
+		t->sf = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+				ceilf (t->nc * GD_WIDTH * scale), ceilf (t->nr * GED_HEIGHT * scale));
+		t->dirty = true;
+	}
+	tr->scale = scale;
+	tr->full  = true;
+}
+
+/* re-create faceplate and tiles when the effective widget scale changed */
+static void faceplate_rescale (RobTkApp* ui, float scale)
+{
+	if (scale == ui->mtx_sf_scale && (!ui->tiles.tile || scale == ui->tiles.scale)) {
+		return;
+	}
+	if (verbose) {
+		printf ("Matrix: rendering faceplate at %.2fx\n", scale);
+	}
+
+	cairo_surface_t* old[6];
+	memcpy (old, ui->mtx_sf, sizeof (old));
+	create_faceplate (ui, scale);
+	for (unsigned int r = 0; r < ui->vp_rows; ++r) {
+		for (unsigned int c = 0; c < ui->vp_cols; ++c) {
+			robtk_dial_set_surface (ui->mtx_gain[r * ui->vp_cols + c], mtx_faceplate (ui, ui->vp_r0 + r, ui->vp_c0 + c));
+		}
+	}
+	for (int i = 0; i < 6; ++i) {
+		cairo_surface_destroy (old[i]);
+	}
+
+	if (ui->tiles.tile) {
+		tiles_alloc (&ui->tiles, scale);
+	}
+}
+
+/* re-render tiles with dirty cross-points before a full view expose,
+ * called from redraw_tick() */
+static void tiles_update (RobTkApp* ui)
+{
+	TileRender* tr = &ui->tiles;
+	if (!tr->tile || !tr->full) {
+		return;
+	}
+	tr->full = false;
+	faceplate_rescale (ui, ui->mtx_gain[0]->rw->widget_scale);
+
+	const int64_t t0 = mono_usec ();
+	const unsigned int vc = ui->vp_cols;
+	unsigned int n_jobs = 0;
+	for (unsigned int i = 0; i < tr->n_tiles; ++i) {
+		MtxTile* t = &tr->tile[i];
+		for (unsigned int r = t->r0; r < t->r0 + t->nr && !t->dirty; ++r) {
+			for (unsigned int c = t->c0; c < t->c0 + t->nc; ++c) {
+				DialSig s;
+				dial_sig (ui->mtx_gain[r * vc + c], &s);
+				if (!dial_sig_equal (&s, &tr->sig[r * vc + c])) {
+					t->dirty = true;
+					break;
+				}
+			}
+		}
+		if (t->dirty) {
+			tile_prepare (ui, t);
+			tr->queue[n_jobs++] = i;
+		}
+	}
+	if (n_jobs == 0) {
+		return;
+	}
+	tiles_render (ui, n_jobs, true);
+	const int64_t dt = mono_usec () - t0;
+
+	++tr->n_frames;
+	tr->n_rendered += n_jobs;
+	tr->t_total    += dt;
+	if (dt > tr->t_max) {
+		tr->t_max = dt;
+	}
+	if (tr->n_frames == 1 && verbose) {
+		tiles_bench (ui);
+	}
+	if (verbose > 1) {
+		printf ("Matrix: rendered %u/%u tiles in %.2f ms (mean %.2f ms, max %.2f ms)\n",
+				n_jobs, tr->n_tiles, dt / 1000.0,
+				tr->t_total / (1000.0 * tr->n_frames), tr->t_max / 1000.0);
+	}
+}
+
+/* matrix dial expose: copy from the tile while it is current */
+static bool mtx_dial_expose (RobWidget* handle, cairo_t* cr, cairo_rectangle_t* ev)
+{
+	RobTkDial* d = (RobTkDial *)GET_HANDLE (handle);
+	RobTkApp* ui = (RobTkApp*)d->handle;
+	TileRender* tr = &ui->tiles;
+
+	faceplate_rescale (ui, handle->widget_scale);
+
+	unsigned int p;
+	memcpy (&p, handle->name, sizeof (unsigned int));
+	const unsigned int c = p % ui->vp_cols;
+	const unsigned int r = p / ui->vp_cols;
+	MtxTile* t = tr->tile ? tile_at (tr, r, c) : NULL;
+
+	DialSig s;
+	dial_sig (d, &s);
+	if (!t || t->dirty || d->prelight || !dial_sig_equal (&s, &tr->sig[p])) {
+		if (t && !d->prelight) {
+			t->dirty = true;
+		}
+		cairo_save (cr);
+		cairo_rectangle (cr, ev->x, ev->y, ev->width, ev->height);
+		cairo_clip (cr);
+		mtx_dial_paint (cr, &s, mtx_faceplate (ui, ui->vp_r0 + r, ui->vp_c0 + c), handle->widget_scale);
+		if (d->prelight && d->sensitive) {
+			cairo_scale (cr, handle->widget_scale, handle->widget_scale);
+			cairo_set_source_rgba (cr, 1, 1, 1, .1);
+			cairo_arc (cr, GD_CX, GD_CY, GED_RADIUS - 1, 0, 2 * M_PI);
+			cairo_fill (cr);
+			dial_annotation_db (d, cr, ui);
+		}
+		cairo_restore (cr);
+		return TRUE;
+	}
+
+	cairo_save (cr);
+	cairo_rectangle (cr, ev->x, ev->y, ev->width, ev->height);
+	cairo_clip (cr);
+	cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+	cairo_set_source_surface (cr, t->sf, -(double)((c - t->c0) * GD_WIDTH * tr->scale), -(double)((r - t->r0) * GED_HEIGHT * tr->scale));
+	cairo_paint (cr);
+	cairo_restore (cr);
+	return TRUE;
+}
+
+static void tiles_stop (RobTkApp* ui)
+{
+	TileRender* tr = &ui->tiles;
+	if (!tr->tile) {
+		return;
+	}
+	pthread_mutex_lock (&tr->lock);
+	tr->run = false;
+	pthread_cond_broadcast (&tr->work);
+	pthread_mutex_unlock (&tr->lock);
+	for (unsigned int i = 0; i < tr->n_workers; ++i) {
+		pthread_join (tr->thread[i], NULL);
+	}
+	pthread_cond_destroy (&tr->work);
+	pthread_cond_destroy (&tr->done);
+	pthread_mutex_destroy (&tr->lock);
+
+	if (verbose && tr->n_frames > 0) {
+		printf ("Matrix: %llu updates, %llu tiles, mean %.2f ms, max %.2f ms\n",
+				(unsigned long long)tr->n_frames, (unsigned long long)tr->n_rendered,
+				tr->t_total / (1000.0 * tr->n_frames), tr->t_max / 1000.0);
+	}
+	for (unsigned int i = 0; i < tr->n_tiles; ++i) {
+		cairo_surface_destroy (tr->tile[i].sf);
+	}
+	free (tr->tile);
+	free (tr->sig);
+	free (tr->face);
+	free (tr->queue);
+	memset (tr, 0, sizeof (TileRender));
+}
+
+/* called once the matrix dials exist */
+static void tiles_start (RobTkApp* ui)
+{
+	TileRender* tr = &ui->tiles;
+	const unsigned int vr = ui->vp_rows;
+	const unsigned int vc = ui->vp_cols;
+	const unsigned int n_rows = (vr + MTX_TILE - 1) / MTX_TILE;
+
+	memset (tr, 0, sizeof (TileRender));
+	tr->n_cols  = (vc + MTX_TILE - 1) / MTX_TILE;
+	tr->n_tiles = n_rows * tr->n_cols;
+	tr->tile    = calloc (tr->n_tiles, sizeof (MtxTile));
+	tr->sig     = calloc (vr * vc, sizeof (DialSig));
+	tr->face    = calloc (vr * vc, sizeof (cairo_surface_t*));
+	tr->queue   = calloc (tr->n_tiles, sizeof (unsigned));
+	if (!tr->tile || !tr->sig || !tr->face || !tr->queue) {
+		free (tr->tile);
+		free (tr->sig);
+		free (tr->face);
+		free (tr->queue);
+		memset (tr, 0, sizeof (TileRender));
+		return;
+	}
+
+	for (unsigned int i = 0; i < tr->n_tiles; ++i) {
+		MtxTile* t = &tr->tile[i];
+		t->r0 = (i / tr->n_cols) * MTX_TILE;
+		t->c0 = (i % tr->n_cols) * MTX_TILE;
+		t->nr = vr - t->r0 < MTX_TILE ? vr - t->r0 : MTX_TILE;
+		t->nc = vc - t->c0 < MTX_TILE ? vc - t->c0 : MTX_TILE;
+	}
+	tiles_alloc (tr, ui->mtx_sf_scale);
+
+	for (unsigned int n = 0; n < vr * vc; ++n) {
+		robwidget_set_expose_event (ui->mtx_gain[n]->rw, mtx_dial_expose);
+	}
+
+	/* one core stays with the GUI thread */
+	long n_cpu = sysconf (_SC_NPROCESSORS_ONLN);
+	unsigned int n_workers = n_cpu > 1 ? n_cpu - 1 : 0;
+	if (n_workers > TILE_MAX_WORKERS) {
+		n_workers = TILE_MAX_WORKERS;
+	}
+	if (n_workers > tr->n_tiles) {
+		n_workers = tr->n_tiles;
+	}
+
+	pthread_mutex_init (&tr->lock, NULL);
+	pthread_cond_init (&tr->work, NULL);
+	pthread_cond_init (&tr->done, NULL);
+	tr->run = true;
+	for (unsigned int i = 0; i < n_workers; ++i) {
+		if (pthread_create (&tr->thread[i], NULL, tile_worker, ui)) {
+			break;
+		}
+		++tr->n_workers;
+	}
+}
+
+/* *****************************************************************************
+ * Matrix view scrolling
+ */
+
+/* bind the view widgets to the cross-points at vp_r0, vp_c0 */
+static void mtx_view_bind (RobTkApp* ui)
+{
+	const bool ds = ui->disable_signals;
+	ui->disable_signals = true;
+
+	for (unsigned int pr = 0; pr < ui->vp_rows; ++pr) {
+		const unsigned int r = ui->vp_r0 + pr;
+		/* all matrix inputs offer the same sources */
+		robtk_select_set_default_item (ui->mtx_sel[pr], 1 + r);
+		robtk_select_set_value (ui->mtx_sel[pr], ui->mtx_src[r]);
+
+		for (unsigned int pc = 0; pc < ui->vp_cols; ++pc) {
+			const unsigned int c = ui->vp_c0 + pc;
+			const unsigned int n = r * ui->sm.device->smo + c;
+			RobTkDial* d = ui->mtx_gain[pr * ui->vp_cols + pc];
+			robtk_dial_set_value (d, ui->mtx_val[n]);
+			d->click_state = mtx_click_state (knob_to_db (ui->mtx_val[n]));
+			robtk_dial_set_surface (d, mtx_faceplate (ui, r, c));
+			queue_draw (d->rw);
+		}
+	}
+	for (unsigned int pc = 0; pc < ui->vp_cols; ++pc) {
+		char txt[8];
+		sprintf (txt, "Mix %c", 'A' + ui->vp_c0 + pc);
+		robtk_lbl_set_text (ui->mtx_lbl[pc], txt);
+	}
+
+	/* capture inputs, scrolled over the same range (there may be more of them) */
+	const unsigned int n_r0 = ui->sm.device->smi - ui->vp_rows;
+	const unsigned int n_c0 = ui->sm.device->sin - ui->cap_rows;
+	ui->cap_r0 = n_r0 > 0 ? (ui->vp_r0 * n_c0 + n_r0 / 2) / n_r0 : 0;
+	for (unsigned int p = 0; p < ui->cap_rows; ++p) {
+		const unsigned int r = ui->cap_r0 + p;
+		char txt[8];
+		sprintf (txt, "%d", r + 1);
+		robtk_lbl_set_text (ui->src_lbl[p], txt);
+		/* all capture inputs offer the same sources */
+		robtk_select_set_default_item (ui->src_sel[p], sm_src_sel_default (r, sm_src_sel (&ui->sm, r)->n_items));
+		robtk_select_set_value (ui->src_sel[p], ui->cap_src[r]);
+	}
+
+	/* the faceplate of the dials is not part of their DialSig */
+	for (unsigned int i = 0; i < ui->tiles.n_tiles; ++i) {
+		ui->tiles.tile[i].dirty = true;
+	}
+	ui->tiles.full = true;
+	ui->disable_signals = ds;
+}
+
+static bool cb_vp_scroll (RobWidget* w, void* handle) {
+	RobTkApp* ui = (RobTkApp*)handle;
+	unsigned int r0 = ui->vp_r0;
+	unsigned int c0 = ui->vp_c0;
+	if (ui->vp_hscroll) {
+		c0 = rintf (robtk_scale_get_value (ui->vp_hscroll));
+	}
+	if (ui->vp_vscroll) {
+		/* vertical scales increase upwards */
+		r0 = ui->sm.device->smi - ui->vp_rows - rintf (robtk_scale_get_value (ui->vp_vscroll));
+	}
+	if (r0 == ui->vp_r0 && c0 == ui->vp_c0) {
+		return TRUE;
+	}
+	ui->vp_r0 = r0;
+	ui->vp_c0 = c0;
+	mtx_view_bind (ui);
+	return TRUE;
+}
+
+/* *****************************************************************************
+ * Redraw scheduler
+ *
+ * Device changes update the model right away (mtx_val, mtx_src) and are
+ * recorded as damage: the bounding box of changed cross-points and a flag
+ * for all other widgets. Widgets are updated from the damage, which is
+ * when robtk queues their redraw, at most once per frame and not at all
+ * while the window is hidden. An event storm thus costs one frame per
+ * interval, no matter how many controls changed.
+ */
+
+static void redraw_damage_all (Redraw* rd, SmDevice const* d)
+{
+	rd->r0 = 0;
+	rd->c0 = 0;
+	rd->r1 = d->smi;
+	rd->c1 = d->smo;
+	rd->other = true;
+}
+
+static void redraw_damage_xp (Redraw* rd, unsigned int r, unsigned int c)
+{
+	if (rd->r0 >= rd->r1) {
+		rd->r0 = r;
+		rd->r1 = r + 1;
+		rd->c0 = c;
+		rd->c1 = c + 1;
+		return;
+	}
+	if (r < rd->r0) rd->r0 = r;
+	if (r >= rd->r1) rd->r1 = r + 1;
+	if (c < rd->c0) rd->c0 = c;
+	if (c >= rd->c1) rd->c1 = c + 1;
+}
+
+/* update the model from collect_changes() and record the damage */
+static void redraw_invalidate (RobTkApp* ui)
+{
+	Redraw* rd = &ui->redraw;
+	const unsigned int smo = ui->sm.device->smo;
+
+	if (ui->n_changed == 0) {
+		/* events without known controls, refresh everything */
+		mtx_kernels[ui->mtx_kernel].refresh (ui);
+		redraw_damage_all (rd, ui->sm.device);
+		++rd->n_invalidations;
+		return;
+	}
+
+	bool other = false;
+	for (unsigned int k = 0; k < ui->n_changed; ++k) {
+		const uint16_t x = ui->routes.ctrl_xp[ui->changed[k]];
+		if (x == ROUTE_NONE) {
+			other = true;
+			continue;
+		}
+		ui->mtx_val[x] = db_to_knob (sm_get_dB (&ui->sm.ctrl[ui->changed[k]]));
+		redraw_damage_xp (rd, x / smo, x % smo);
+	}
+	if (other) {
+		for (unsigned int r = 0; r < ui->sm.device->smi; ++r) {
+			ui->mtx_src[r] = sm_get_enum (sm_matrix_sel (&ui->sm, r));
+		}
+		rd->other = true;
+	}
+	rd->n_invalidations += ui->n_changed;
+}
+
+static void redraw_frame (RobTkApp* ui)
+{
+	Redraw* rd = &ui->redraw;
+	SmCtrl* ctrl;
 
-	// top-left
-	MTX_SF (ui->mtx_sf[4]);
-	MTX_ARROW_V;
+	TRACE0 (redraw_start);
+	ui->disable_signals = true;
 
-	cairo_move_to (cr, 0, GD_CY);
-	cairo_line_to (cr, GD_WIDTH, GD_CY);
-	cairo_stroke (cr);
-	cairo_move_to (cr, GD_CX, GD_CY);
-	cairo_line_to (cr, GD_CX, GED_HEIGHT);
-	cairo_stroke (cr);
-	cairo_destroy (cr);
+	/* damaged cross-points in view */
+	const unsigned int r0 = rd->r0 > ui->vp_r0 ? rd->r0 : ui->vp_r0;
+	const unsigned int c0 = rd->c0 > ui->vp_c0 ? rd->c0 : ui->vp_c0;
+	const unsigned int r1 = rd->r1 < ui->vp_r0 + ui->vp_rows ? rd->r1 : ui->vp_r0 + ui->vp_rows;
+	const unsigned int c1 = rd->c1 < ui->vp_c0 + ui->vp_cols ? rd->c1 : ui->vp_c0 + ui->vp_cols;
+	for (unsigned int r = r0; r < r1; ++r) {
+		for (unsigned int c = c0; c < c1; ++c) {
+			RobTkDial* d = ui->mtx_gain[(r - ui->vp_r0) * ui->vp_cols + c - ui->vp_c0];
+			robtk_dial_set_value (d, ui->mtx_val[r * ui->sm.device->smo + c]);
+		}
+	}
+	if (r0 == ui->vp_r0 && r1 == ui->vp_r0 + ui->vp_rows && c0 == ui->vp_c0 && c1 == ui->vp_c0 + ui->vp_cols) {
+		ui->tiles.full = true;
+	}
 
-	// top-right
-	MTX_SF (ui->mtx_sf[5]);
-	MTX_ARROW_H;
-	MTX_ARROW_V;
+	if (rd->other) {
+		for (unsigned int r = 0; r < ui->sm.device->sin; ++r) {
+			ui->cap_src[r] = sm_get_enum (sm_src_sel (&ui->sm, r));
+		}
+		for (unsigned int p = 0; p < ui->cap_rows; ++p) {
+			robtk_select_set_value (ui->src_sel[p], ui->cap_src[ui->cap_r0 + p]);
+		}
 
-	cairo_move_to (cr, 0, GD_CY);
-	cairo_line_to (cr, GD_CX, GD_CY);
-	cairo_stroke (cr);
-	cairo_move_to (cr, GD_CX, GD_CY);
-	cairo_line_to (cr, GD_CX, GED_HEIGHT);
-	cairo_stroke (cr);
-	cairo_destroy (cr);
-}
+		for (unsigned int r = 0; r < ui->vp_rows; ++r) {
+			robtk_select_set_value (ui->mtx_sel[r], ui->mtx_src[ui->vp_r0 + r]);
+		}
 
-static RobWidget* robtk_dial_mouse_intercept (RobWidget* handle, RobTkBtnEvent *ev) {
-	RobTkDial* d = (RobTkDial *)GET_HANDLE (handle);
-	RobTkApp* ui = (RobTkApp*)d->handle;
-	if (!d->sensitive) { return NULL; }
+		for (unsigned int o = 0; o < ui->sm.device->smst; ++o) {
+			ctrl = sm_out_gain (&ui->sm, o);
+			robtk_dial_set_value (ui->out_gain[o], db_to_knob (sm_get_dB (ctrl)));
+			robtk_dial_set_state (ui->out_gain[o], sm_get_mute (ctrl) ? 1 : 0);
+		}
 
-	if (ev->button == 2) {
-		/* middle-click exclusively assign output */
-		unsigned int n;
-		memcpy (&n, d->rw->name, sizeof (unsigned int));
+		for (unsigned int o = 0; o < ui->sm.device->samo; ++o) {
+			ctrl = sm_aux_gain (&ui->sm, o);
+			robtk_dial_set_value (ui->aux_gain[o], db_to_knob (sm_get_dB (ctrl)));
+		}
 
-		unsigned c = n % ui->device->smo;
-		unsigned r = n / ui->device->smo;
-		for (uint32_t i = 0; i < ui->device->smo; ++i) {
-			unsigned int nn = r * ui->device->smo + i;
-			if (i == c) {
-				if (d->cur == 0) {
-					robtk_dial_set_value (ui->mtx_gain[nn], db_to_knob (0));
-				} else {
-					robtk_dial_set_value (ui->mtx_gain[nn], 0);
-				}
-			} else {
-				robtk_dial_set_value (ui->mtx_gain[nn], 0);
-			}
+		if (ui->sm.device->smst) {
+			ctrl = sm_mst_gain (&ui->sm);
+			robtk_dial_set_value (ui->mst_gain, db_to_knob (sm_get_dB (ctrl)));
+			robtk_dial_set_state (ui->mst_gain, sm_get_mute (ctrl) ? 1 : 0);
+		}
+
+		for (unsigned int i = 0; i < ui->sm.device->num_hiz; ++i) {
+			robtk_cbtn_set_active (ui->btn_hiz[i], sm_get_enum (sm_hiz (&ui->sm, i)) == 1);
+		}
+
+		for (unsigned int o = 0; o < ui->sm.device->sout; ++o) {
+			ctrl = sm_out_sel (&ui->sm, o);
+			robtk_select_set_value (ui->out_sel[o], sm_get_enum (ctrl));
 		}
-		return handle;
 	}
-	return robtk_dial_mousedown (handle, ev);
+
+	ui->disable_signals = false;
+	routes_view_update (ui);
+
+	rd->r0 = rd->r1 = 0;
+	rd->c0 = rd->c1 = 0;
+	rd->other = false;
+	++rd->n_frames;
+	TRACE0 (redraw_end);
+}
+
+/* called from port_event(), renders pending damage when a frame is due */
+static void redraw_tick (RobTkApp* ui)
+{
+	Redraw* rd = &ui->redraw;
+	const bool damaged = rd->r0 < rd->r1 || rd->other;
+	if (!damaged && !ui->tiles.full) {
+		return;
+	}
+	if (rd->hidden) {
+		return;
+	}
+	const int64_t now = mono_usec ();
+	if (now < rd->t_next) {
+		return;
+	}
+	rd->t_next = now + rd->interval;
+	if (damaged) {
+		redraw_frame (ui);
+	}
+	tiles_update (ui);
 }
 
 /* *****************************************************************************
@@ -1140,47 +4466,88 @@ static RobWidget* toplevel (RobTkApp* ui, void* const top) {
 	ui->rw = rob_vbox_new (FALSE, 2);
 	robwidget_make_toplevel (ui->rw, top);
 
-	create_faceplate (ui);
+	create_faceplate (ui, 1.f);
 	ui->font = pango_font_description_from_string ("Mono 9px");
 
 	/* device dependent construction */
-	ui->mtx_sel = malloc (ui->device->sin * sizeof (RobTkSelect *));
-	ui->mtx_gain = malloc (ui->device->smi * ui->device->smo * sizeof (RobTkDial *));
-	ui->mtx_lbl = malloc (ui->device->smo * sizeof (RobTkLbl *));
+	SmDevice const* d = ui->sm.device;
+	const unsigned int n_sel = sm_n_sel_lbl (d);
 
-	ui->src_lbl = malloc (ui->device->sin * sizeof (RobTkLbl *));
-	ui->src_sel = malloc (ui->device->sin * sizeof (RobTkSelect *));
-
-	ui->out_lbl = malloc (ui->device->smst * sizeof (RobTkLbl *));
-	ui->out_sel = malloc (ui->device->sout * sizeof (RobTkSelect *));
-	ui->out_gain = malloc (ui->device->smst * sizeof (RobTkDial *));
-	ui->aux_lbl = malloc (ui->device->samo * sizeof (RobTkLbl *));
-	ui->aux_gain = malloc (ui->device->samo * sizeof (RobTkDial *));
-	ui->sel_lbl = malloc (ui->device->sout - ui->device->samo - (ui->device->smst * 2) * sizeof (RobTkLbl *));
-
-
-	if (ui->device->num_hiz > 0) {
-		ui->btn_hiz = malloc (ui->device->num_hiz * sizeof (RobTkCBtn *));
-	} else {
-		ui->btn_hiz = NULL;
+	if (ui->vp_rows == 0 || ui->vp_rows > d->smi) {
+		ui->vp_rows = d->smi;
 	}
-	if  (ui->device->num_pad > 0) {
-		ui->btn_pad = malloc (ui->device->num_pad * sizeof (RobTkCBtn *));
-	} else {
-		ui->btn_pad = NULL;
+	if (ui->vp_cols == 0 || ui->vp_cols > d->smo) {
+		ui->vp_cols = d->smo;
 	}
-	if  (ui->device->num_air > 0) {
-		ui->btn_air = malloc (ui->device->num_air * sizeof (RobTkCBtn *));
-	} else {
-		ui->btn_air = NULL;
+	const unsigned int vr = ui->vp_rows;
+	const unsigned int vc = ui->vp_cols;
+
+	/* with a row window, the capture column shares it */
+	ui->cap_rows = vr < d->smi && d->sin > vr ? vr : d->sin;
+	const unsigned int cr = ui->cap_rows;
+
+	size_t arena_size = 0;
+	arena_size += sm_arena_round (vr * sizeof (RobTkSelect *));
+	arena_size += sm_arena_round (vr * vc * sizeof (RobTkDial *));
+	arena_size += sm_arena_round (vc * sizeof (RobTkLbl *));
+	arena_size += sm_arena_round (d->smi * d->smo * sizeof (float));
+	arena_size += sm_arena_round (d->smi * sizeof (int));
+	arena_size += sm_arena_round (d->smi * d->smo * sizeof (uint16_t));
+	arena_size += sm_arena_round (d->smi * sizeof (uint16_t));
+	arena_size += sm_arena_round (cr * sizeof (RobTkLbl *));
+	arena_size += sm_arena_round (cr * sizeof (RobTkSelect *));
+	arena_size += sm_arena_round (d->sin * sizeof (int));
+	arena_size += sm_arena_round (d->smst * sizeof (RobTkLbl *));
+	arena_size += sm_arena_round (d->sout * sizeof (RobTkSelect *));
+	arena_size += sm_arena_round (d->smst * sizeof (RobTkDial *));
+	arena_size += sm_arena_round (d->samo * sizeof (RobTkLbl *));
+	arena_size += sm_arena_round (d->samo * sizeof (RobTkDial *));
+	arena_size += sm_arena_round (n_sel * sizeof (RobTkLbl *));
+	arena_size += sm_arena_round (d->num_hiz * sizeof (RobTkCBtn *));
+	arena_size += sm_arena_round (d->num_pad * sizeof (RobTkCBtn *));
+	arena_size += sm_arena_round (d->num_air * sizeof (RobTkCBtn *));
+
+	SmArena* a = &ui->gui_arena;
+	sm_arena_init (a, arena_size);
+
+	ui->mtx_sel  = sm_arena_alloc (a, vr * sizeof (RobTkSelect *));
+	ui->mtx_gain = sm_arena_alloc (a, vr * vc * sizeof (RobTkDial *));
+	ui->mtx_lbl  = sm_arena_alloc (a, vc * sizeof (RobTkLbl *));
+	ui->mtx_val  = sm_arena_alloc (a, d->smi * d->smo * sizeof (float));
+	ui->mtx_src  = sm_arena_alloc (a, d->smi * sizeof (int));
+	ui->mtx_idx     = sm_arena_alloc (a, d->smi * d->smo * sizeof (uint16_t));
+	ui->mtx_sel_idx = sm_arena_alloc (a, d->smi * sizeof (uint16_t));
+
+	ui->src_lbl  = sm_arena_alloc (a, cr * sizeof (RobTkLbl *));
+	ui->src_sel  = sm_arena_alloc (a, cr * sizeof (RobTkSelect *));
+	ui->cap_src  = sm_arena_alloc (a, d->sin * sizeof (int));
+
+	ui->out_lbl  = sm_arena_alloc (a, d->smst * sizeof (RobTkLbl *));
+	ui->out_sel  = sm_arena_alloc (a, d->sout * sizeof (RobTkSelect *));
+	ui->out_gain = sm_arena_alloc (a, d->smst * sizeof (RobTkDial *));
+	ui->aux_lbl  = sm_arena_alloc (a, d->samo * sizeof (RobTkLbl *));
+	ui->aux_gain = sm_arena_alloc (a, d->samo * sizeof (RobTkDial *));
+	ui->sel_lbl  = sm_arena_alloc (a, n_sel * sizeof (RobTkLbl *));
+
+	ui->btn_hiz  = sm_arena_alloc (a, d->num_hiz * sizeof (RobTkCBtn *));
+	ui->btn_pad  = sm_arena_alloc (a, d->num_pad * sizeof (RobTkCBtn *));
+	ui->btn_air  = sm_arena_alloc (a, d->num_air * sizeof (RobTkCBtn *));
+
+	if (verbose) {
+		printf ("Arena: ctrl %u allocations, %zu/%zu bytes; gui %u allocations, %zu/%zu bytes\n",
+				ui->sm.arena.n_alloc, ui->sm.arena.used, ui->sm.arena.size,
+				a->n_alloc, a->used, a->size);
+		printf ("Matrix view: %u x %u of %u x %u cross-points\n", vr, vc, d->smi, d->smo);
 	}
 
 	const int c0 = 4; // matrix column offset
-	const int rb = 2 + ui->device->smi; // matrix bottom
+	const int vx = vc < d->smo ? 1 : 0; // horizontal scrollbar
+	const int vy = vr < d->smi ? 1 : 0; // vertical scrollbar
+	const int rb = 2 + vr + vx; // matrix bottom
 
 	/* table layout. NB: these are min sizes, table grows if needed */
-	ui->matrix = rob_table_new (/*rows*/rb, /*cols*/ 5 + ui->device->smo, FALSE);
-	ui->output = rob_table_new (/*rows*/4,  /*cols*/ 2 + 3 * ui->device->smst, FALSE);
+	ui->matrix = rob_table_new (/*rows*/rb, /*cols*/ 5 + vc + vy, FALSE);
+	ui->output = rob_table_new (/*rows*/4,  /*cols*/ 2 + 3 * ui->sm.device->smst, FALSE);
 
 	/* headings */
 	ui->heading[0]  = robtk_lbl_new ("Capture");
@@ -1188,20 +4555,23 @@ static RobWidget* toplevel (RobTkApp* ui, void* const top) {
 	ui->heading[1]  = robtk_lbl_new ("Source");
 	rob_table_attach (ui->matrix, robtk_lbl_widget (ui->heading[1]), c0, c0 + 1, 0, 1, 2, 6, RTK_SHRINK, RTK_SHRINK);
 	ui->heading[2]  = robtk_lbl_new ("Matrix Mixer");
-	rob_table_attach (ui->matrix, robtk_lbl_widget (ui->heading[2]), c0 + 1, c0 + 1 + ui->device->smo, 0, 1, 2, 6, RTK_SHRINK, RTK_SHRINK);
+	rob_table_attach (ui->matrix, robtk_lbl_widget (ui->heading[2]), c0 + 1, c0 + 1 + vc, 0, 1, 2, 6, RTK_SHRINK, RTK_SHRINK);
 
-	/* input selectors */
-	for (unsigned r = 0; r < ui->device->sin; ++r) {
+	/* input selectors, the view shows cr of them */
+	for (unsigned r = 0; r < ui->sm.device->sin; ++r) {
+		ui->cap_src[r] = sm_get_enum (sm_src_sel (&ui->sm, r));
+	}
+	for (unsigned r = 0; r < cr; ++r) {
 		char txt[8];
 		sprintf (txt, "%d", r + 1);
 		ui->src_lbl[r] = robtk_lbl_new (txt);
 		rob_table_attach (ui->matrix, robtk_lbl_widget (ui->src_lbl[r]), 1, 2, r + 1, r + 2, 2, 2, RTK_SHRINK, RTK_SHRINK);
 
 		ui->src_sel[r] = robtk_select_new ();
-		Mctrl* sctrl = src_sel (ui, r);
-		int mcnt = snd_mixer_selem_get_enum_items (sctrl->elem);
+		SmCtrl* sctrl = sm_src_sel (&ui->sm, r);
+		int mcnt = sctrl->n_items;
 		set_select_values (ui->src_sel[r], sctrl);
-		robtk_select_set_default_item (ui->src_sel[r], src_sel_default (r, mcnt));
+		robtk_select_set_default_item (ui->src_sel[r], sm_src_sel_default (r, mcnt));
 		robtk_select_set_callback (ui->src_sel[r], cb_src_sel, ui);
 
 		rob_table_attach (ui->matrix, robtk_select_widget (ui->src_sel[r]), 2, 3, r + 1, r + 2, 2, 2, RTK_SHRINK, RTK_SHRINK);
@@ -1215,19 +4585,23 @@ static RobWidget* toplevel (RobTkApp* ui, void* const top) {
 	rob_table_attach (ui->matrix, robtk_sep_widget (ui->spc_v[0]), 0, 1, 0, rb, 0, 0, RTK_EXANDF, RTK_FILL);
 	ui->spc_v[1] = robtk_sep_new (FALSE);
 	robtk_sep_set_linewidth (ui->spc_v[1], 0);
-	rob_table_attach (ui->matrix, robtk_sep_widget (ui->spc_v[1]), c0 + 1 + ui->device->smo, c0 + 2 + ui->device->smo, 0, rb, 0, 0, RTK_EXANDF, RTK_FILL);
+	rob_table_attach (ui->matrix, robtk_sep_widget (ui->spc_v[1]), c0 + 1 + vc + vy, c0 + 2 + vc + vy, 0, rb, 0, 0, RTK_EXANDF, RTK_FILL);
 
 	/* vertical separator line between inputs and matrix (c0-1 .. c0)*/
 	ui->sep_v = robtk_sep_new (FALSE);
 	rob_table_attach (ui->matrix, robtk_sep_widget (ui->sep_v), 3, 4, 0, rb, 10, 0, RTK_SHRINK, RTK_FILL);
 
+	/* matrix values, the view shows vr x vc of them */
+	mtx_kernel_init (ui);
+	mtx_kernels[ui->mtx_kernel].refresh (ui);
+
 	/* matrix */
 	unsigned int r;
 
-	for (r = 0; r < ui->device->smi; ++r) {
+	for (r = 0; r < vr; ++r) {
 		ui->mtx_sel[r] = robtk_select_new ();
 
-		Mctrl* sctrl = matrix_sel (ui, r);
+		SmCtrl* sctrl = sm_matrix_sel (&ui->sm, r);
 		set_select_values (ui->mtx_sel[r], sctrl);
 		robtk_select_set_default_item (ui->mtx_sel[r], 1 + r); // XXX defaults (0 == off)
 		robtk_select_set_callback (ui->mtx_sel[r], cb_mtx_src, ui);
@@ -1235,67 +4609,53 @@ static RobWidget* toplevel (RobTkApp* ui, void* const top) {
 		rob_table_attach (ui->matrix, robtk_select_widget (ui->mtx_sel[r]), c0, c0 + 1, r + 1, r + 2, 2, 2, RTK_SHRINK, RTK_SHRINK);
 		memcpy (ui->mtx_sel[r]->rw->name, &r, sizeof (unsigned int));
 
-		for (unsigned int c = 0; c < ui->device->smo; ++c) {
-			unsigned int n = r * ui->device->smo + c;
-			Mctrl* ctrl = matrix_ctrl_cr (ui, c, r);
-			assert (ctrl);
-			ui->mtx_gain[n] = robtk_dial_new_with_size (
+		for (unsigned int c = 0; c < vc; ++c) {
+			unsigned int p = r * vc + c;
+			ui->mtx_gain[p] = robtk_dial_new_with_size (
 					0, 1, 1.f / 80.f,
 					GD_WIDTH, GED_HEIGHT, GD_CX, GD_CY, GED_RADIUS);
-			robtk_dial_set_default (ui->mtx_gain[n], db_to_knob (0));
-			robtk_dial_set_value (ui->mtx_gain[n], db_to_knob (get_dB (ctrl)));
-			robtk_dial_set_callback (ui->mtx_gain[n], cb_mtx_gain, ui);
-			robtk_dial_annotation_callback (ui->mtx_gain[n], dial_annotation_db, ui);
-			robwidget_set_mousedown (ui->mtx_gain[n]->rw, robtk_dial_mouse_intercept);
-			ui->mtx_gain[n]->displaymode = 3;
-
-			if (0 == robtk_dial_get_value (ui->mtx_gain[n])) {
-				ui->mtx_gain[n]->click_state = 1;
-			}
-			else if (0 == knob_to_db (robtk_dial_get_value (ui->mtx_gain[n]))) {
-				ui->mtx_gain[n]->click_state = 2;
-			}
-
-			if (c == (ui->device->smo - 1) && r == 0) {
-				robtk_dial_set_surface (ui->mtx_gain[n], ui->mtx_sf[5]);
-			}
-			else if (c == 0 && r == 0) {
-				robtk_dial_set_surface (ui->mtx_gain[n], ui->mtx_sf[4]);
-			}
-			else if (c == (ui->device->smo - 1)) {
-				robtk_dial_set_surface (ui->mtx_gain[n], ui->mtx_sf[3]);
-			}
-			else if (c == 0) {
-				robtk_dial_set_surface (ui->mtx_gain[n], ui->mtx_sf[2]);
-			}
-			else if (r == 0) {
-				robtk_dial_set_surface (ui->mtx_gain[n], ui->mtx_sf[1]);
-			}
-			else {
-				robtk_dial_set_surface (ui->mtx_gain[n], ui->mtx_sf[0]);
-			}
+			robtk_dial_set_default (ui->mtx_gain[p], db_to_knob (0));
+			robtk_dial_set_callback (ui->mtx_gain[p], cb_mtx_gain, ui);
+			robtk_dial_annotation_callback (ui->mtx_gain[p], dial_annotation_db, ui);
+			robwidget_set_mousedown (ui->mtx_gain[p]->rw, robtk_dial_mouse_intercept);
+			robwidget_set_mousescroll (ui->mtx_gain[p]->rw, robtk_dial_scroll_intercept);
+			ui->mtx_gain[p]->displaymode = 3;
 
-			rob_table_attach (ui->matrix, robtk_dial_widget (ui->mtx_gain[n]), c0 + c + 1, c0 + c + 2, r + 1, r + 2, 0, 0, RTK_SHRINK, RTK_SHRINK);
+			rob_table_attach (ui->matrix, robtk_dial_widget (ui->mtx_gain[p]), c0 + c + 1, c0 + c + 2, r + 1, r + 2, 0, 0, RTK_SHRINK, RTK_SHRINK);
 
-			memcpy (ui->mtx_gain[n]->rw->name, &n, sizeof (unsigned int));
+			memcpy (ui->mtx_gain[p]->rw->name, &p, sizeof (unsigned int));
 		}
 	}
 
 	/* matrix out labels */
-	for (unsigned int c = 0; c < ui->device->smo; ++c) {
-		char txt[8];
-		sprintf (txt, "Mix %c", 'A' + c);
-		ui->mtx_lbl[c]  = robtk_lbl_new (txt);
+	for (unsigned int c = 0; c < vc; ++c) {
+		ui->mtx_lbl[c]  = robtk_lbl_new ("Mix A");
 		rob_table_attach (ui->matrix, robtk_lbl_widget (ui->mtx_lbl[c]), c0 + c + 1, c0 + c + 2, r + 1, r + 2, 2, 2, RTK_SHRINK, RTK_SHRINK);
 	}
 
+	/* scrollbars, the row and column headers above stay in place */
+	if (vx) {
+		ui->vp_hscroll = robtk_scale_new (0, d->smo - vc, 1, TRUE);
+		robtk_scale_set_callback (ui->vp_hscroll, cb_vp_scroll, ui);
+		rob_table_attach (ui->matrix, robtk_scale_widget (ui->vp_hscroll), c0 + 1, c0 + 1 + vc, r + 2, r + 3, 2, 2, RTK_FILL, RTK_SHRINK);
+	}
+	if (vy) {
+		ui->vp_vscroll = robtk_scale_new (0, d->smi - vr, 1, FALSE);
+		robtk_scale_set_value (ui->vp_vscroll, d->smi - vr);
+		robtk_scale_set_callback (ui->vp_vscroll, cb_vp_scroll, ui);
+		rob_table_attach (ui->matrix, robtk_scale_widget (ui->vp_vscroll), c0 + 1 + vc, c0 + 2 + vc, 1, 1 + vr, 2, 2, RTK_SHRINK, RTK_FILL);
+	}
+
+	mtx_view_bind (ui);
+	tiles_start (ui);
+
 	/*** output Table ***/
 
 	/* master level */
-	if (ui->device->smst) {
+	if (ui->sm.device->smst) {
 		ui->out_mst = robtk_lbl_new ("Master");
 		rob_table_attach (ui->output, robtk_lbl_widget (ui->out_mst), 0, 2, 0, 1, 2, 2, RTK_SHRINK, RTK_SHRINK);
-		Mctrl* ctrl = mst_gain (ui);
+		SmCtrl* ctrl = sm_mst_gain (&ui->sm);
 		ui->mst_gain = robtk_dial_new_with_size (
 				0, 1, 1.f / 80.f,
 				75, 50, 37.5, 22.5, 20);
@@ -1306,22 +4666,23 @@ static RobWidget* toplevel (RobTkApp* ui, void* const top) {
 		robtk_dial_set_default (ui->mst_gain, db_to_knob (0));
 		robtk_dial_set_default_state (ui->mst_gain, 0);
 
-		robtk_dial_set_value (ui->mst_gain, db_to_knob (get_dB (ctrl)));
-		robtk_dial_set_state (ui->mst_gain, get_mute (ctrl) ? 1 : 0);
+		robtk_dial_set_value (ui->mst_gain, db_to_knob (sm_get_dB (ctrl)));
+		robtk_dial_set_state (ui->mst_gain, sm_get_mute (ctrl) ? 1 : 0);
 		robtk_dial_set_callback (ui->mst_gain, cb_mst_gain, ui);
 		robtk_dial_annotation_callback (ui->mst_gain, dial_annotation_db, ui);
+		robwidget_set_mousedown (ui->mst_gain->rw, robtk_dial_fade_intercept);
 		rob_table_attach (ui->output, robtk_dial_widget (ui->mst_gain), 0, 2, 1, 3, 2, 0, RTK_SHRINK, RTK_SHRINK);
 	}
 
 	/* output level + labels */
-	for (unsigned int o = 0; o < ui->device->smst; ++o) {
+	for (unsigned int o = 0; o < ui->sm.device->smst; ++o) {
 		int row = 4 * floor (o / 5); // beware of bleed into Hi-Z, Pads
 		int oc = o % 5;
 
-		ui->out_lbl[o]  = robtk_lbl_new (out_gain_label (ui, o));
+		ui->out_lbl[o]  = robtk_lbl_new (sm_out_gain_label (&ui->sm, o));
 		rob_table_attach (ui->output, robtk_lbl_widget (ui->out_lbl[o]), 3 * oc + 2, 3 * oc + 5, row, row + 1, 2, 2, RTK_SHRINK, RTK_SHRINK);
 
-		Mctrl* ctrl = out_gain (ui, o);
+		SmCtrl* ctrl = sm_out_gain (&ui->sm, o);
 		ui->out_gain[o] = robtk_dial_new_with_size (
 				0, 1, 1.f / 80.f,
 				65, 40, 32.5, 17.5, 15);
@@ -1332,24 +4693,25 @@ static RobWidget* toplevel (RobTkApp* ui, void* const top) {
 		robtk_dial_set_default (ui->out_gain[o], db_to_knob (0));
 		robtk_dial_set_default_state (ui->out_gain[o], 0);
 
-		robtk_dial_set_value (ui->out_gain[o], db_to_knob (get_dB (ctrl)));
-		robtk_dial_set_state (ui->out_gain[o], get_mute (ctrl) ? 1 : 0);
+		robtk_dial_set_value (ui->out_gain[o], db_to_knob (sm_get_dB (ctrl)));
+		robtk_dial_set_state (ui->out_gain[o], sm_get_mute (ctrl) ? 1 : 0);
 		robtk_dial_set_callback (ui->out_gain[o], cb_out_gain, ui);
 		robtk_dial_annotation_callback (ui->out_gain[o], dial_annotation_db, ui);
+		robwidget_set_mousedown (ui->out_gain[o]->rw, robtk_dial_fade_intercept);
 		rob_table_attach (ui->output, robtk_dial_widget (ui->out_gain[o]), 3 * oc + 2, 3 * oc + 5, row + 1, row + 2, 2, 0, RTK_SHRINK, RTK_SHRINK);
 
 		memcpy (ui->out_gain[o]->rw->name, &o, sizeof (unsigned int));
 	}
 
 	/* aux mono outputs & labels */
-	for (unsigned int o = 0; o < ui->device->samo; ++o) {
+	for (unsigned int o = 0; o < ui->sm.device->samo; ++o) {
 		int row = 4 * floor (o / 5); // beware of bleed into Hi-Z, Pads
 		int oc = o % 5;
 
-		ui->aux_lbl[o]  = robtk_lbl_new (aux_gain_label (ui, o));
+		ui->aux_lbl[o]  = robtk_lbl_new (sm_aux_gain_label (&ui->sm, o));
 		rob_table_attach (ui->output, robtk_lbl_widget (ui->aux_lbl[o]), 3 * oc + 2, 3 * oc + 5, row, row + 1, 2, 2, RTK_SHRINK, RTK_SHRINK);
 
-		Mctrl* ctrl = aux_gain (ui, o);
+		SmCtrl* ctrl = sm_aux_gain (&ui->sm, o);
 		ui->aux_gain[o] = robtk_dial_new_with_size (
 				0, 1, 1.f / 80.f,
 				65, 40, 32.5, 17.5, 15);
@@ -1360,221 +4722,709 @@ static RobWidget* toplevel (RobTkApp* ui, void* const top) {
 		robtk_dial_set_default (ui->aux_gain[o], db_to_knob (0));
 		robtk_dial_set_default_state (ui->aux_gain[o], 0);
 
-		robtk_dial_set_value (ui->aux_gain[o], db_to_knob (get_dB (ctrl)));
+		robtk_dial_set_value (ui->aux_gain[o], db_to_knob (sm_get_dB (ctrl)));
 		robtk_dial_set_callback (ui->aux_gain[o], cb_aux_gain, ui);
 		robtk_dial_annotation_callback (ui->aux_gain[o], dial_annotation_db, ui);
+		robwidget_set_mousedown (ui->aux_gain[o]->rw, robtk_dial_fade_intercept);
 		rob_table_attach (ui->output, robtk_dial_widget (ui->aux_gain[o]), 3 * oc + 2, 3 * oc + 5, row + 1, row + 2, 2, 0, RTK_SHRINK, RTK_SHRINK);
 
 		memcpy (ui->aux_gain[o]->rw->name, &o, sizeof (unsigned int));
 	}
 
-	for (unsigned int o = 0; o < ui->device->sout - ui->device->samo - (ui->device->smst * 2); ++o) {
-		int row_base = (o + ui->device->samo + (ui->device->smst * 2));
+	for (unsigned int o = 0; o < n_sel; ++o) {
+		int row_base = (o + ui->sm.device->samo + (ui->sm.device->smst * 2));
 		int row = 4 * floor (row_base / 6); // beware of bleed into Hi-Z, Pads
 		int oc = row_base % 6;
 
-		ui->sel_lbl[o]  = robtk_lbl_new (out_select_label (ui, o));
+		ui->sel_lbl[o]  = robtk_lbl_new (sm_out_select_label (&ui->sm, o));
 		rob_table_attach (ui->output, robtk_lbl_widget (ui->sel_lbl[o]), 3 * oc + 2, 3 * oc + 5, row, row + 1, 2, 2, RTK_SHRINK, RTK_SHRINK);
 	}
 
 	/* Hi-Z*/
-	for (unsigned int i = 0; i < ui->device->num_hiz; ++i) {
+	for (unsigned int i = 0; i < ui->sm.device->num_hiz; ++i) {
 		ui->btn_hiz[i] = robtk_cbtn_new ("HiZ", GBT_LED_LEFT, false);
-		robtk_cbtn_set_active (ui->btn_hiz[i], get_enum (hiz (ui, i)) == 1);
+		robtk_cbtn_set_active (ui->btn_hiz[i], sm_get_enum (sm_hiz (&ui->sm, i)) == 1);
 		robtk_cbtn_set_callback (ui->btn_hiz[i], cb_set_hiz, ui);
 		rob_table_attach (ui->output, robtk_cbtn_widget (ui->btn_hiz[i]),
 				i, i + 1, 3, 4, 0, 0, RTK_SHRINK, RTK_SHRINK);
 	}
 
 	/* Pads */
-	for (unsigned int i = 0; i < ui->device->num_pad; ++i) {
+	for (unsigned int i = 0; i < ui->sm.device->num_pad; ++i) {
 		ui->btn_pad[i] = robtk_cbtn_new ("Pad", GBT_LED_LEFT, false);
-		if (ui->device->pads_are_switches) {
-			robtk_cbtn_set_active (ui->btn_pad[i], get_switch (pad (ui, i)) == 1);
+		if (ui->sm.device->pads_are_switches) {
+			robtk_cbtn_set_active (ui->btn_pad[i], sm_get_switch (sm_pad (&ui->sm, i)) == 1);
+		} else {
+			robtk_cbtn_set_active (ui->btn_pad[i], sm_get_enum (sm_pad (&ui->sm, i)) == 1);
+		}
+		robtk_cbtn_set_callback (ui->btn_pad[i], cb_set_pad, ui);
+		rob_table_attach (ui->output, robtk_cbtn_widget (ui->btn_pad[i]),
+				i, i + 1, 4, 5, 0, 0, RTK_SHRINK, RTK_SHRINK);
+	}
+
+	/* Airs */
+	for (unsigned int i = 0; i < ui->sm.device->num_air; ++i) {
+		ui->btn_air[i] = robtk_cbtn_new ("Air", GBT_LED_LEFT, false);
+			robtk_cbtn_set_active (ui->btn_air[i], sm_get_switch (sm_air (&ui->sm, i)) == 1);
+		robtk_cbtn_set_callback (ui->btn_air[i], cb_set_air, ui);
+		rob_table_attach (ui->output, robtk_cbtn_widget (ui->btn_air[i]),
+				i, i + 1, 5, 6, 0, 0, RTK_SHRINK, RTK_SHRINK);
+	}
+
+	/* output selectors */
+	for (unsigned int o = 0; o < ui->sm.device->sout; ++o) {
+		int row = 4 * floor (o / 10); // beware of bleed into Hi-Z, Pads
+		int pc = 3 * (o / 2); /* stereo-pair column */
+		pc %= 15;
+
+		ui->out_sel[o] = robtk_select_new ();
+		SmCtrl* sctrl = sm_out_sel (&ui->sm, o);
+		set_select_values (ui->out_sel[o], sctrl);
+		robtk_select_set_default_item (ui->out_sel[o], sm_out_sel_default (o));
+		robtk_select_set_callback (ui->out_sel[o], cb_out_src, ui);
+
+		memcpy (ui->out_sel[o]->rw->name, &o, sizeof (unsigned int));
+
+		if (o < (ui->sm.device->smst * 2)) {
+			if (o & 1) {
+				/* right channel */
+				rob_table_attach (ui->output, robtk_select_widget (ui->out_sel[o]), 3 + pc, 5 + pc, row + 3, row + 4, 2, 2, RTK_SHRINK, RTK_SHRINK);
+			} else {
+				/* left channel */
+				rob_table_attach (ui->output, robtk_select_widget (ui->out_sel[o]), 2 + pc, 4 + pc, row + 2, row + 3, 2, 2, RTK_SHRINK, RTK_SHRINK);
+			}
+		} else {
+			/* mono channel */
+			pc = 3 * o;
+
+			rob_table_attach (ui->output, robtk_select_widget (ui->out_sel[o]), 2 + pc, 5 + pc, row + 3, row + 4, 2, 2, RTK_SHRINK, RTK_SHRINK);
+		}
+	}
+
+#if 0
+	/* re-send */
+	ui->btn_reset = robtk_pbtn_new ("R");
+	rob_table_attach (ui->output, robtk_pbtn_widget (ui->btn_reset), 1 + 3 * (ui->sm.device->sout / 2), 2 + 3 * (ui->sm.device->sout / 2), 2, 3, 2, 2, RTK_SHRINK, RTK_SHRINK);
+	robtk_pbtn_set_callback_up (ui->btn_reset, cb_btn_reset, ui);
+#endif
+
+	ui->sep_h = robtk_sep_new (TRUE);
+
+	/* top-level packing */
+	rob_vbox_child_pack (ui->rw, ui->matrix, TRUE, TRUE);
+	rob_vbox_child_pack (ui->rw, robtk_sep_widget (ui->sep_h), TRUE, TRUE);
+	rob_vbox_child_pack (ui->rw, ui->output, TRUE, TRUE);
+
+	ui->tool_box = rob_hbox_new (FALSE, 4);
+	ui->btn_undo = robtk_pbtn_new ("Undo");
+	ui->btn_redo = robtk_pbtn_new ("Redo");
+	robtk_pbtn_set_callback_up (ui->btn_undo, cb_undo, ui);
+	robtk_pbtn_set_callback_up (ui->btn_redo, cb_redo, ui);
+	rob_hbox_child_pack (ui->tool_box, robtk_pbtn_widget (ui->btn_undo), FALSE, FALSE);
+	rob_hbox_child_pack (ui->tool_box, robtk_pbtn_widget (ui->btn_redo), FALSE, FALSE);
+	ui->btn_routes = robtk_cbtn_new ("Routes", GBT_LED_LEFT, false);
+	robtk_cbtn_set_callback (ui->btn_routes, cb_routes, ui);
+	rob_hbox_child_pack (ui->tool_box, robtk_cbtn_widget (ui->btn_routes), FALSE, FALSE);
+
+	if (ui->morph.step) {
+		ui->morph_box    = rob_hbox_new (FALSE, 4);
+		ui->morph_lbl[0] = robtk_lbl_new ("Scene A");
+		ui->morph_lbl[1] = robtk_lbl_new ("Scene B");
+		ui->morph_fader  = robtk_scale_new (0, 1, 1.f / 256.f, TRUE);
+		robtk_scale_set_value (ui->morph_fader, ui->morph.pos);
+		robtk_scale_set_callback (ui->morph_fader, cb_morph, ui);
+		rob_hbox_child_pack (ui->morph_box, robtk_lbl_widget (ui->morph_lbl[0]), FALSE, FALSE);
+		rob_hbox_child_pack (ui->morph_box, robtk_scale_widget (ui->morph_fader), TRUE, TRUE);
+		rob_hbox_child_pack (ui->morph_box, robtk_lbl_widget (ui->morph_lbl[1]), FALSE, FALSE);
+		rob_hbox_child_pack (ui->tool_box, ui->morph_box, TRUE, TRUE);
+	}
+	rob_vbox_child_pack (ui->rw, ui->tool_box, TRUE, TRUE);
+
+	ui->routes_lbl = robtk_lbl_new ("No active routes");
+	rob_vbox_child_pack (ui->rw, robtk_lbl_widget (ui->routes_lbl), FALSE, FALSE);
+	robwidget_hide (robtk_lbl_widget (ui->routes_lbl), false);
+	return ui->rw;
+}
+
+static void gui_cleanup (RobTkApp* ui) {
+
+	midi_stop (ui);
+	metrics_close (ui);
+	shm_close (ui);
+	journal_close (ui);
+	tiles_stop (ui);
+	free (ui->pollfds);
+
+	if (verbose) {
+		printf ("Writes: latency p90 %.2f ms, limit %.0f/s, batch %u, %u back-offs\n",
+				ui->throttle.lat_p90 / 1000.0, ui->throttle.rate, ui->throttle.batch, ui->throttle.n_backoff);
+	}
+	if (verbose && ui->redraw.n_frames > 0) {
+		printf ("GUI: %llu changes, %llu frames\n",
+				(unsigned long long)ui->redraw.n_invalidations,
+				(unsigned long long)ui->redraw.n_frames);
+	}
+
+	for (unsigned int i = 0; i < ui->cap_rows; ++i) {
+		robtk_select_destroy (ui->src_sel[i]);
+		robtk_lbl_destroy (ui->src_lbl[i]);
+	}
+	for (unsigned int r = 0; r < ui->vp_rows; ++r) {
+		robtk_select_destroy (ui->mtx_sel[r]);
+		for (unsigned int c = 0; c < ui->vp_cols; ++c) {
+			robtk_dial_destroy (ui->mtx_gain[r * ui->vp_cols + c]);
+		}
+	}
+	for (unsigned int i = 0; i < ui->vp_cols; ++i) {
+		robtk_lbl_destroy (ui->mtx_lbl[i]);
+	}
+	if (ui->vp_hscroll) {
+		robtk_scale_destroy (ui->vp_hscroll);
+	}
+	if (ui->vp_vscroll) {
+		robtk_scale_destroy (ui->vp_vscroll);
+	}
+	for (int i = 0; i < ui->sm.device->sout; ++i) {
+		robtk_select_destroy (ui->out_sel[i]);
+	}
+	for (int i = 0; i < ui->sm.device->smst; ++i) {
+		robtk_lbl_destroy (ui->out_lbl[i]);
+		robtk_dial_destroy (ui->out_gain[i]);
+	}
+	for (int i = 0; i < ui->sm.device->samo; ++i) {
+		robtk_lbl_destroy (ui->aux_lbl[i]);
+		robtk_dial_destroy (ui->aux_gain[i]);
+	}
+	for (unsigned int i = 0; i < sm_n_sel_lbl (ui->sm.device); ++i) {
+		robtk_lbl_destroy (ui->sel_lbl[i]);
+	}
+
+	for (int i = 0; i < 3; ++i) {
+		robtk_lbl_destroy (ui->heading[i]);
+	}
+	for (int i = 0; i < 6; ++i) {
+		cairo_surface_destroy (ui->mtx_sf[i]);
+	}
+
+	if (ui->sm.device->smst) {
+		robtk_lbl_destroy (ui->out_mst);
+		robtk_dial_destroy (ui->mst_gain);
+	}
+
+	for (int i = 0; i < ui->sm.device->num_hiz; i++) {
+		robtk_cbtn_destroy (ui->btn_hiz[i]);
+	}
+
+	for (int i = 0; i < ui->sm.device->num_pad; i++) {
+		robtk_cbtn_destroy (ui->btn_pad[i]);
+	}
+
+	for (int i = 0; i < ui->sm.device->num_air; i++) {
+		robtk_cbtn_destroy (ui->btn_air[i]);
+	}
+
+	robtk_sep_destroy (ui->sep_v);
+	robtk_sep_destroy (ui->sep_h);
+	robtk_sep_destroy (ui->spc_v[0]);
+	robtk_sep_destroy (ui->spc_v[1]);
+
+	if (ui->morph_box) {
+		robtk_lbl_destroy (ui->morph_lbl[0]);
+		robtk_lbl_destroy (ui->morph_lbl[1]);
+		robtk_scale_destroy (ui->morph_fader);
+		rob_box_destroy (ui->morph_box);
+	}
+	morph_free (&ui->morph);
+
+	robtk_pbtn_destroy (ui->btn_undo);
+	robtk_pbtn_destroy (ui->btn_redo);
+	robtk_cbtn_destroy (ui->btn_routes);
+	robtk_lbl_destroy (ui->routes_lbl);
+	rob_box_destroy (ui->tool_box);
+	batch_free (ui);
+	routes_free (&ui->routes);
+	free (ui->ctrl_hash);
+
+	rob_table_destroy (ui->output);
+	rob_table_destroy (ui->matrix);
+	rob_box_destroy (ui->rw);
+
+	pango_font_description_free (ui->font);
+
+	sm_close (&ui->sm);
+	sm_arena_free (&ui->gui_arena);
+}
+
+/* *****************************************************************************
+ * Device discovery
+ */
+
+static void list_devices ()
+{
+	SmCardInfo cards[SM_MAX_CARDS];
+	int n_cards = sm_scan_cards (cards, SM_MAX_CARDS);
+	for (int i = 0; i < n_cards; ++i) {
+		if (!cards[i].device) {
+			continue;
+		}
+		printf ("hw:%d\t%s", cards[i].number, cards[i].name);
+		if (cards[i].usb_id) {
+			printf ("\t[%04x:%04x]", cards[i].usb_id >> 16, cards[i].usb_id & 0xffff);
+		}
+		printf ("\n");
+	}
+}
+
+/* *****************************************************************************
+ * Hot-plug, re-attach
+ */
+
+#define RECONNECT_INTERVAL 200000 // usec between presence checks
+
+/* cheap check if the card is (back) and still the same model */
+static bool card_present (const char* card, const char* name)
+{
+	snd_ctl_t *hctl;
+	snd_ctl_card_info_t *card_info;
+	snd_ctl_card_info_alloca (&card_info);
+	bool rv = false;
+
+	if (snd_ctl_open (&hctl, card, 0) < 0) {
+		return false;
+	}
+	if (snd_ctl_card_info (hctl, card_info) >= 0) {
+		const char* card_name = snd_ctl_card_info_get_name (card_info);
+		rv = card_name && !strcmp (card_name, name);
+	}
+	snd_ctl_close (hctl);
+	return rv;
+}
+
+static bool same_layout (SmMixer const* a, SmMixer const* b)
+{
+	if (!sm_device_equal (a->device, b->device)) {
+		return false;
+	}
+	if (a->ctrl_cnt != b->ctrl_cnt) {
+		return false;
+	}
+	/* numids too, MIDI targets address controls by numid */
+	for (unsigned int i = 0; i < a->ctrl_cnt; ++i) {
+		if (strcmp (a->ctrl[i].name, b->ctrl[i].name)
+		    || a->ctrl[i].cv.numid != b->ctrl[i].cv.numid
+		    || a->ctrl[i].cs.numid != b->ctrl[i].cs.numid) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void gui_set_sensitive (RobTkApp* ui, bool en)
+{
+	for (unsigned int r = 0; r < ui->cap_rows; ++r) {
+		robtk_select_set_sensitive (ui->src_sel[r], en);
+	}
+	for (unsigned int r = 0; r < ui->vp_rows; ++r) {
+		robtk_select_set_sensitive (ui->mtx_sel[r], en);
+		for (unsigned int c = 0; c < ui->vp_cols; ++c) {
+			robtk_dial_set_sensitive (ui->mtx_gain[r * ui->vp_cols + c], en);
+		}
+	}
+	for (unsigned int o = 0; o < ui->sm.device->smst; ++o) {
+		robtk_dial_set_sensitive (ui->out_gain[o], en);
+	}
+	for (unsigned int o = 0; o < ui->sm.device->samo; ++o) {
+		robtk_dial_set_sensitive (ui->aux_gain[o], en);
+	}
+	for (unsigned int o = 0; o < ui->sm.device->sout; ++o) {
+		robtk_select_set_sensitive (ui->out_sel[o], en);
+	}
+	if (ui->sm.device->smst) {
+		robtk_dial_set_sensitive (ui->mst_gain, en);
+	}
+	for (unsigned int i = 0; i < ui->sm.device->num_hiz; ++i) {
+		robtk_cbtn_set_sensitive (ui->btn_hiz[i], en);
+	}
+	for (unsigned int i = 0; i < ui->sm.device->num_pad; ++i) {
+		robtk_cbtn_set_sensitive (ui->btn_pad[i], en);
+	}
+	for (unsigned int i = 0; i < ui->sm.device->num_air; ++i) {
+		robtk_cbtn_set_sensitive (ui->btn_air[i], en);
+	}
+	robtk_lbl_set_text (ui->heading[2], en ? "Matrix Mixer" : "Matrix Mixer (offline)");
+}
+
+/* push GUI state to the device, only write controls that differ.
+ * returns the number of modified controls */
+static int apply_gui_state (RobTkApp* ui)
+{
+	int n_mod = 0;
+
+	for (unsigned int r = 0; r < ui->sm.device->sin; ++r) {
+		n_mod += sync_enum (sm_src_sel (&ui->sm, r), ui->cap_src[r]);
+	}
+	n_mod += mtx_kernels[ui->mtx_kernel].apply (ui);
+	for (unsigned int o = 0; o < ui->sm.device->smst; ++o) {
+		n_mod += sync_mute (sm_out_gain (&ui->sm, o), robtk_dial_get_state (ui->out_gain[o]) == 1);
+		n_mod += sync_dB (sm_out_gain (&ui->sm, o), knob_to_db (robtk_dial_get_value (ui->out_gain[o])));
+	}
+	for (unsigned int o = 0; o < ui->sm.device->samo; ++o) {
+		n_mod += sync_dB (sm_aux_gain (&ui->sm, o), knob_to_db (robtk_dial_get_value (ui->aux_gain[o])));
+	}
+	if (ui->sm.device->smst) {
+		n_mod += sync_mute (sm_mst_gain (&ui->sm), robtk_dial_get_state (ui->mst_gain) == 1);
+		n_mod += sync_dB (sm_mst_gain (&ui->sm), knob_to_db (robtk_dial_get_value (ui->mst_gain)));
+	}
+	for (unsigned int o = 0; o < ui->sm.device->sout; ++o) {
+		n_mod += sync_enum (sm_out_sel (&ui->sm, o), robtk_select_get_value (ui->out_sel[o]));
+	}
+	for (unsigned int i = 0; i < ui->sm.device->num_hiz; ++i) {
+		n_mod += sync_enum (sm_hiz (&ui->sm, i), robtk_cbtn_get_active (ui->btn_hiz[i]) ? 1 : 0);
+	}
+	for (unsigned int i = 0; i < ui->sm.device->num_pad; ++i) {
+		if (ui->sm.device->pads_are_switches) {
+			n_mod += sync_switch (sm_pad (&ui->sm, i), robtk_cbtn_get_active (ui->btn_pad[i]));
 		} else {
-			robtk_cbtn_set_active (ui->btn_pad[i], get_enum (pad (ui, i)) == 1);
+			n_mod += sync_enum (sm_pad (&ui->sm, i), robtk_cbtn_get_active (ui->btn_pad[i]) ? 1 : 0);
 		}
-		robtk_cbtn_set_callback (ui->btn_pad[i], cb_set_pad, ui);
-		rob_table_attach (ui->output, robtk_cbtn_widget (ui->btn_pad[i]),
-				i, i + 1, 4, 5, 0, 0, RTK_SHRINK, RTK_SHRINK);
 	}
-
-	/* Airs */
-	for (unsigned int i = 0; i < ui->device->num_air; ++i) {
-		ui->btn_air[i] = robtk_cbtn_new ("Air", GBT_LED_LEFT, false);
-			robtk_cbtn_set_active (ui->btn_air[i], get_switch (air (ui, i)) == 1);
-		robtk_cbtn_set_callback (ui->btn_air[i], cb_set_air, ui);
-		rob_table_attach (ui->output, robtk_cbtn_widget (ui->btn_air[i]),
-				i, i + 1, 5, 6, 0, 0, RTK_SHRINK, RTK_SHRINK);
+	for (unsigned int i = 0; i < ui->sm.device->num_air; ++i) {
+		n_mod += sync_switch (sm_air (&ui->sm, i), robtk_cbtn_get_active (ui->btn_air[i]));
 	}
+	return n_mod;
+}
 
-	/* output selectors */
-	for (unsigned int o = 0; o < ui->device->sout; ++o) {
-		int row = 4 * floor (o / 10); // beware of bleed into Hi-Z, Pads
-		int pc = 3 * (o / 2); /* stereo-pair column */
-		pc %= 15;
-
-		ui->out_sel[o] = robtk_select_new ();
-		Mctrl* sctrl = out_sel (ui, o);
-		set_select_values (ui->out_sel[o], sctrl);
-		robtk_select_set_default_item (ui->out_sel[o], out_sel_default (o));
-		robtk_select_set_callback (ui->out_sel[o], cb_out_src, ui);
+/* device vanished: keep the GUI and the control names, drop alsa handles */
+static void detach_mixer (RobTkApp* ui)
+{
+	sm_detach (&ui->sm);
+	free (ui->pollfds);
+	ui->pollfds = NULL;
+	ui->nfds = 0;
+	/* moves refer to controls of the detached mixer */
+	automation_stop (&ui->automation);
+	ui->reconnect_next = 0;
+	gui_set_sensitive (ui, false);
+	fprintf (stderr, "Device `%s' disconnected, waiting for it to re-appear.\n", ui->card);
+}
 
-		memcpy (ui->out_sel[o]->rw->name, &o, sizeof (unsigned int));
+static void try_reattach (RobTkApp* ui)
+{
+	const int64_t t0 = mono_usec ();
+	if (t0 < ui->reconnect_next) {
+		return;
+	}
+	ui->reconnect_next = t0 + RECONNECT_INTERVAL;
 
-		if (o < (ui->device->smst * 2)) {
-			if (o & 1) {
-				/* right channel */
-				rob_table_attach (ui->output, robtk_select_widget (ui->out_sel[o]), 3 + pc, 5 + pc, row + 3, row + 4, 2, 2, RTK_SHRINK, RTK_SHRINK);
-			} else {
-				/* left channel */
-				rob_table_attach (ui->output, robtk_select_widget (ui->out_sel[o]), 2 + pc, 4 + pc, row + 2, row + 3, 2, 2, RTK_SHRINK, RTK_SHRINK);
+	if (ui->card_auto) {
+		char* card = sm_lookup_card ();
+		if (!card) {
+			return;
+		}
+		free (ui->card);
+		ui->card = card;
+		if (ui->midi.seq) {
+			/* the MIDI thread re-opens its ctl handle on the new card */
+			Midi* m = &ui->midi;
+			pthread_mutex_lock (&m->lock);
+			free (m->card);
+			m->card = strdup (card);
+			if (m->ctl) {
+				snd_ctl_close (m->ctl);
+				m->ctl = NULL;
 			}
-		} else {
-			/* mono channel */
-			pc = 3 * o;
-
-			rob_table_attach (ui->output, robtk_select_widget (ui->out_sel[o]), 2 + pc, 5 + pc, row + 3, row + 4, 2, 2, RTK_SHRINK, RTK_SHRINK);
+			pthread_mutex_unlock (&m->lock);
 		}
+	} else if (!card_present (ui->card, ui->sm.device->name)) {
+		return;
 	}
 
-#if 0
-	/* re-send */
-	ui->btn_reset = robtk_pbtn_new ("R");
-	rob_table_attach (ui->output, robtk_pbtn_widget (ui->btn_reset), 1 + 3 * (ui->device->sout / 2), 2 + 3 * (ui->device->sout / 2), 2, 3, 2, 2, RTK_SHRINK, RTK_SHRINK);
-	robtk_pbtn_set_callback_up (ui->btn_reset, cb_btn_reset, ui);
-#endif
+	SmMixer sm;
+	int rv = sm_open (&sm, ui->card, ui->opts & ~SM_PROBE);
+	if (rv) {
+		return;
+	}
+	if (!same_layout (&ui->sm, &sm)) {
+		sm_close (&sm);
+		fprintf (stderr, "Device `%s' re-appeared with a different layout.\n", ui->card);
+		robtk_close_self (ui->rw->top);
+		return;
+	}
 
-	ui->sep_h = robtk_sep_new (TRUE);
+	sm_close (&ui->sm);
+	ui->sm = sm;
+	++ui->reconnect_cnt;
 
-	/* top-level packing */
-	rob_vbox_child_pack (ui->rw, ui->matrix, TRUE, TRUE);
-	rob_vbox_child_pack (ui->rw, robtk_sep_widget (ui->sep_h), TRUE, TRUE);
-	rob_vbox_child_pack (ui->rw, ui->output, TRUE, TRUE);
-	return ui->rw;
+	int n_mod = apply_gui_state (ui);
+	gui_set_sensitive (ui, true);
+
+	if (verbose) {
+		printf ("Re-attached `%s' in %.1f ms, restored %d controls.\n",
+				ui->card, (mono_usec () - t0) / 1000.0, n_mod);
+	}
 }
 
-static void gui_cleanup (RobTkApp* ui) {
+/* *****************************************************************************
+ * Instant-on
+ *
+ * The device layout and values are cached on exit. On the next start the
+ * GUI is built from the cache and shown read-only while the device is
+ * opened on a thread. Once loaded, the controls that differ from the
+ * cache are flagged as changed, and shown as if the device reported them.
+ */
 
-	close_mixer (ui);
-	free (ui->pollfds);
+/* $XDG_CACHE_HOME/scarlett-mixer/<card>.cache, the directory is created */
+static char* cache_file (const char* card)
+{
+	const char* xdg  = getenv ("XDG_CACHE_HOME");
+	const char* home = getenv ("HOME");
+	char dir[1024];
+	if (xdg && *xdg) {
+		snprintf (dir, sizeof (dir), "%s", xdg);
+	} else if (home && *home) {
+		snprintf (dir, sizeof (dir), "%s/.cache", home);
+	} else {
+		return NULL;
+	}
+	mkdir (dir, 0755);
+	strncat (dir, "/scarlett-mixer", sizeof (dir) - strlen (dir) - 1);
+	if (mkdir (dir, 0755) < 0 && errno != EEXIST) {
+		return NULL;
+	}
 
-	for (int i = 0; i < ui->device->sin; ++i) {
-		robtk_select_destroy (ui->src_sel[i]);
-		robtk_lbl_destroy (ui->src_lbl[i]);
+	const size_t len = strlen (dir) + strlen (card) + 8;
+	char* path = malloc (len);
+	if (!path) {
+		return NULL;
 	}
-	for (int r = 0; r < ui->device->smi; ++r) {
-		robtk_select_destroy (ui->mtx_sel[r]);
-		for (int c = 0; c < ui->device->smo; ++c) {
-			robtk_dial_destroy (ui->mtx_gain[r * ui->device->smo + c]);
-		}
+	snprintf (path, len, "%s/", dir);
+	for (char* p = path + strlen (path); *card; ++card, ++p) {
+		*p = (*card == '/' || *card == ':' || *card == ',') ? '_' : *card;
+		p[1] = '\0';
 	}
-	for (int i = 0; i < ui->device->smo; ++i) {
-		robtk_lbl_destroy (ui->mtx_lbl[i]);
+	strcat (path, ".cache");
+	return path;
+}
+
+static void* loader_thread (void* arg)
+{
+	Loader* l = (Loader*)arg;
+	l->rv = sm_open (&l->sm, l->card, l->opts);
+	__atomic_store_n (&l->done, true, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+static void loader_start (RobTkApp* ui)
+{
+	Loader* l = &ui->loader;
+	l->card   = ui->card;
+	l->opts   = ui->opts & ~SM_PROBE;
+	l->done   = false;
+	l->active = true;
+	l->t0     = mono_usec ();
+	l->threaded = pthread_create (&l->thread, NULL, loader_thread, l) == 0;
+	if (!l->threaded) {
+		loader_thread (l);
 	}
-	for (int i = 0; i < ui->device->sout; ++i) {
-		robtk_select_destroy (ui->out_sel[i]);
+}
+
+static void loader_stop (RobTkApp* ui)
+{
+	Loader* l = &ui->loader;
+	if (!l->active) {
+		return;
 	}
-	for (int i = 0; i < ui->device->smst; ++i) {
-		robtk_lbl_destroy (ui->out_lbl[i]);
-		robtk_dial_destroy (ui->out_gain[i]);
+	if (l->threaded) {
+		pthread_join (l->thread, NULL);
+	}
+	if (l->rv == 0) {
+		sm_close (&l->sm);
 	}
+	l->active = false;
+}
 
-	for (int i = 0; i < 3; ++i) {
-		robtk_lbl_destroy (ui->heading[i]);
+/* replace the cached mixer, flag the controls that differ from the cache */
+static unsigned int loader_adopt (RobTkApp* ui, SmMixer* sm)
+{
+	unsigned int n_diff = 0;
+	for (unsigned int i = 0; i < ui->sm.ctrl_cnt; ++i) {
+		SmCtrl* a = &ui->sm.ctrl[i];
+		SmCtrl* b = &sm->ctrl[i];
+		b->changed = (ctrl_has_db (a) && lrintf (sm_get_dB (a)) != lrintf (sm_get_dB (b)))
+		          || (ctrl_has_val (a) && ctrl_get_val (a) != ctrl_get_val (b));
+		n_diff += b->changed;
 	}
-	for (int i = 0; i < 6; ++i) {
-		cairo_surface_destroy (ui->mtx_sf[i]);
+	/* moves refer to the cached controls */
+	for (int i = 0; i < ui->automation.n_moves; ++i) {
+		AutoMove* m = &ui->automation.move[i];
+		m->ctrl = sm->ctrl + (m->ctrl - ui->sm.ctrl);
 	}
+	sm_close (&ui->sm);
+	ui->sm = *sm;
+	return n_diff;
+}
 
-	if (ui->device->smst) {
-		robtk_lbl_destroy (ui->out_mst);
-		robtk_dial_destroy (ui->mst_gain);
+/* called from port_event() while the cached layout is shown */
+static void loader_poll (RobTkApp* ui)
+{
+	Loader* l = &ui->loader;
+	if (!__atomic_load_n (&l->done, __ATOMIC_ACQUIRE)) {
+		return;
+	}
+	if (l->threaded) {
+		pthread_join (l->thread, NULL);
 	}
+	l->active = false;
 
-	for (int i = 0; i < ui->device->num_hiz; i++) {
-		robtk_cbtn_destroy (ui->btn_hiz[i]);
+	if (l->rv) {
+		fprintf (stderr, "Device `%s' could not be opened.\n", ui->card);
+		robtk_close_self (ui->rw->top);
+		return;
+	}
+	if (!same_layout (&ui->sm, &l->sm)) {
+		sm_close (&l->sm);
+		unlink (ui->cache_path);
+		fprintf (stderr, "Device `%s' differs from the cached layout, please restart.\n", ui->card);
+		robtk_close_self (ui->rw->top);
+		return;
 	}
 
-	for (int i = 0; i < ui->device->num_pad; i++) {
-		robtk_cbtn_destroy (ui->btn_pad[i]);
+	const unsigned int n_diff = loader_adopt (ui, &l->sm);
+	collect_changes (ui);
+	routes_update (ui);
+	shm_update (ui, true);
+	if (ui->n_changed > 0) {
+		redraw_invalidate (ui);
 	}
+	gui_set_sensitive (ui, true);
 
-	for (int i = 0; i < ui->device->num_air; i++) {
-		robtk_cbtn_destroy (ui->btn_air[i]);
+	if (verbose) {
+		printf ("Loaded `%s' in %.1f ms, %u controls differ from the cache.\n",
+				ui->card, (mono_usec () - l->t0) / 1000.0, n_diff);
 	}
+}
 
-	robtk_sep_destroy (ui->sep_v);
-	robtk_sep_destroy (ui->sep_h);
-	robtk_sep_destroy (ui->spc_v[0]);
-	robtk_sep_destroy (ui->spc_v[1]);
+/* *****************************************************************************
+ * Benchmark
+ */
 
-	rob_table_destroy (ui->output);
-	rob_table_destroy (ui->matrix);
-	rob_box_destroy (ui->rw);
+static void bench_backend (const char* card, int opts)
+{
+	const int n_open  = 10;
+	const int n_write = 200;
+
+	SmMixer  sm;
+	int64_t  t_open = 0;
+	int64_t  t_write = 0;
+
+	for (int i = 0; i < n_open; ++i) {
+		const int64_t t0 = mono_usec ();
+		int rv = sm_open (&sm, card, opts);
+		t_open += mono_usec () - t0;
+		if (rv) {
+			fprintf (stderr, "Benchmark: cannot open `%s'\n", card);
+			return;
+		}
+		if (i + 1 < n_open) {
+			sm_close (&sm);
+		}
+	}
 
-	pango_font_description_free (ui->font);
+	/* alternate a single cross-point, bypasses the unchanged-value check */
+	SmCtrl* c = sm_matrix_ctrl_cr (&sm, 0, 0);
+	const float orig = sm_get_dB (c);
+	const int64_t t0 = mono_usec ();
+	for (int i = 0; i < n_write; ++i) {
+		sm_set_dB (c, (i & 1) ? -20 : -21);
+	}
+	t_write = mono_usec () - t0;
+	sm_set_dB (c, orig);
 
-	free (ui->mtx_sel);
-	free (ui->mtx_gain);
-	free (ui->mtx_lbl);
+	printf ("%-5s open: %7.2f ms  write: %7.2f us  arena: %u allocations, %zu bytes\n",
+			(opts & SM_SELEM) ? "selem" : "ctl",
+			t_open / (1000.0 * n_open), t_write / (double)n_write,
+			sm.arena.n_alloc, sm.arena.used);
+
+	sm_close (&sm);
+}
 
-	free (ui->src_lbl);
-	free (ui->src_sel);
+/* apply alternates all cross-points between two gains, so that every
+ * call writes smi * smo controls; `saved' restores the device after */
+static void bench_kernel (RobTkApp* ui, MtxKernel const* k, float const* saved)
+{
+	const int n_refresh = 100;
+	const int n_apply   = 20;
+	const unsigned int n_xp = ui->sm.device->smi * ui->sm.device->smo;
 
-	free (ui->out_lbl);
-	free (ui->out_sel);
-	free (ui->out_gain);
+	const int64_t t0 = mono_usec ();
+	for (int i = 0; i < n_refresh; ++i) {
+		k->refresh (ui);
+	}
+	const int64_t t1 = mono_usec ();
+
+	unsigned int n_mod = 0;
+	int64_t t_apply = 0;
+	for (int i = 0; i < n_apply; ++i) {
+		const float knob = db_to_knob ((i & 1) ? -20 : -21);
+		for (unsigned int n = 0; n < n_xp; ++n) {
+			ui->mtx_val[n] = knob;
+		}
+		const int64_t t2 = mono_usec ();
+		n_mod += k->apply (ui);
+		t_apply += mono_usec () - t2;
+	}
 
-	free (ui->aux_gain);
-	free (ui->aux_lbl);
-	free (ui->sel_lbl);
+	memcpy (ui->mtx_val, saved, n_xp * sizeof (float));
+	k->apply (ui);
 
-	free (ui->btn_hiz);
-	free (ui->btn_pad);
-	free (ui->btn_air);
+	printf ("Matrix kernel %-18s refresh: %7.2f us  apply: %8.2f us (%u writes)\n",
+			k->name, (t1 - t0) / (double)n_refresh, t_apply / (double)n_apply, n_mod / n_apply);
 }
 
-static char* lookup_device ()
+static void bench_kernels (RobTkApp* ui, const char* card, int opts)
 {
-	char* card = NULL;
-	snd_ctl_card_info_t* info;
-	snd_ctl_card_info_alloca(&info);
-	int number = -1;
-	while (!card) {
-		int err = snd_card_next(&number);
-		if (err < 0 || number < 0) {
-			break;
-		}
-		snd_ctl_t* ctl;
-		char buf[16];
-		sprintf (buf, "hw:%d", number);
-		err = snd_ctl_open(&ctl, buf, 0);
-		if (err < 0) {
-			continue;
-		}
-		err = snd_ctl_card_info(ctl, info);
-		snd_ctl_close(ctl);
-		if (err < 0) {
-			continue;
-		}
-		const char* card_name = snd_ctl_card_info_get_name (info);
-		if (!card_name) {
-			continue;
-		}
-		if (verbose > 1) {
-			printf ("* hw:%d \"%s\"\n", number, card_name);
-		}
-		for (unsigned i = 0; i < NUM_DEVICES; i++) {
-			if (!strcmp (card_name, devices[i].name)) {
-				card = strdup (buf);
-			}
-		}
+	if (sm_open (&ui->sm, card, opts)) {
+		fprintf (stderr, "Benchmark: cannot open `%s'\n", card);
+		return;
+	}
+	SmDevice const* d = ui->sm.device;
+	const size_t n_xp = d->smi * d->smo;
+
+	SmArena* a = &ui->gui_arena;
+	if (!sm_arena_init (a, 2 * sm_arena_round (n_xp * sizeof (float))
+	                       + sm_arena_round (d->smi * sizeof (int))
+	                       + sm_arena_round (n_xp * sizeof (uint16_t))
+	                       + sm_arena_round (d->smi * sizeof (uint16_t)))) {
+		sm_close (&ui->sm);
+		return;
 	}
-	if (verbose > 0 && NULL != card) {
-		printf ("Autodetect: Using \"%s\"\n", card);
+	ui->mtx_val     = sm_arena_alloc (a, n_xp * sizeof (float));
+	ui->mtx_src     = sm_arena_alloc (a, d->smi * sizeof (int));
+	ui->mtx_idx     = sm_arena_alloc (a, n_xp * sizeof (uint16_t));
+	ui->mtx_sel_idx = sm_arena_alloc (a, d->smi * sizeof (uint16_t));
+	float* saved    = sm_arena_alloc (a, n_xp * sizeof (float));
+
+	mtx_kernel_init (ui);
+	mtx_kernels[ui->mtx_kernel].refresh (ui);
+	memcpy (saved, ui->mtx_val, n_xp * sizeof (float));
+
+	printf ("Matrix %u x %u (mean of 100 refreshes, 20 applies)\n", d->smi, d->smo);
+	bench_kernel (ui, &mtx_kernels[ui->mtx_kernel], saved);
+	if (ui->mtx_kernel != N_MTX_KERNELS - 1) {
+		bench_kernel (ui, &mtx_kernels[N_MTX_KERNELS - 1], saved);
 	}
-	return card;
+
+	sm_arena_free (a);
+	sm_close (&ui->sm);
+}
+
+static void run_benchmark (RobTkApp* ui, const char* card, int opts)
+{
+	opts &= ~(SM_PROBE | SM_SELEM | OPT_BENCH);
+	printf ("Benchmark `%s' (mean of 10 opens, 200 writes)\n", card);
+	bench_backend (card, opts | SM_SELEM);
+	bench_backend (card, opts);
+	bench_kernels (ui, card, opts);
 }
 
 /* *****************************************************************************
@@ -1583,11 +5433,32 @@ static char* lookup_device ()
 
 static struct option const long_options[] =
 {
+	{"automate", required_argument, 0, 'A'},
+	{"automation", required_argument, 0, 'a'},
+	{"exporter", required_argument, 0, 'E'},
+	{"benchmark", no_argument, 0, 'B'},
+	{"no-cache", no_argument, 0, 'C'},
+	{"flip", required_argument, 0, 'F'},
+	{"max-fps", required_argument, 0, 'f'},
 	{"help", no_argument, 0, 'h'},
+	{"import-state", required_argument, 0, 'I'},
+	{"journal", required_argument, 0, 'j'},
+	{"list", no_argument, 0, 'l'},
+	{"matrix", required_argument, 0, 'X'},
+	{"midi", required_argument, 0, 'M'},
+	{"morph", required_argument, 0, 'm'},
+	{"export-state", required_argument, 0, 'O'},
 	{"preset-only", no_argument, 0, 'P'},
 	{"print-controls", no_argument, 0, 'p'},
+	{"routes", no_argument, 0, 'r'},
+	{"save-scene", required_argument, 0, 's'},
+	{"selem", no_argument, 0, 'S'},
+	{"write-latency", required_argument, 0, 'T'},
 	{"version", no_argument, 0, 'V'},
 	{"verbose", no_argument, 0, 'v'},
+	{"view", required_argument, 0, 'w'},
+	{"write-budget", required_argument, 0, 'W'},
+	{"shm", required_argument, 0, 'Z'},
 	{NULL, 0, NULL, 0}
 };
 
@@ -1602,21 +5473,70 @@ falling back to '%s'.\n\
 Supported devices:\n\
 ", DEFAULT_DEVICE);
 
-	for (unsigned i = 0; i < NUM_DEVICES; i++) {
-		printf ("* %s\n", devices[i].name);
+	for (unsigned i = 0; i < sm_device_count (); i++) {
+		printf ("* %s\n", sm_device_preset (i)->name);
 	}
 
 	printf ("Usage: scarlett-mixer [ OPTIONS ] [ DEVICE ]\n\n");
 	printf ("Options:\n\
+  -A, --automate <move>      add a gain move, same syntax as a timeline line\n\
+  -a, --automation <file>    run the gain automation timeline from the given file\n\
+  -B, --benchmark            compare control backends and time the matrix kernels\n\
+                             on the given soundcard, then exit\n\
+  -C, --no-cache             do not start from (nor update) the cached device\n\
+                             layout and values\n\
+  -E, --exporter <port|path> serve Prometheus metrics on the loopback TCP port\n\
+                             or UNIX socket path\n\
+  -F, --flip <pos>           morph position (0..1) at which switches change (default 0.5)\n\
+  -f, --max-fps <num>        max. GUI updates per second (default %d)\n\
   -h, --help                 display this help and exit\n\
+  -I, --import-state <file>  apply the state of this card from an alsactl\n\
+                             state file (asound.state)\n\
+  -j, --journal <dir>        keep a crash-safe state journal in the given directory\n\
+                             and restore the last state on startup\n\
+  -l, --list                 list supported soundcards that are present and exit\n\
+  -M, --midi <map>           enable MIDI control via the ALSA sequencer, using\n\
+                             (and saving learned mappings to) the given map file\n\
+  -m, --morph <file>         scene to morph between, given twice: scene A and B\n\
+  -O, --export-state <file>  save the state of this card as alsactl state file\n\
+                             and exit\n\
   -p, --print-controls       list control parameters of given soundcard\n\
   -P, --preset-only          do not parse names from kernel-driver\n\
+  -r, --routes               list the active matrix routes and exit\n\
+  -s, --save-scene <file>    save the current state as scene and exit\n\
+  -S, --selem                use the simple-mixer API instead of control numids\n\
+  -T, --write-latency <ms>   control write latency to aim for, batched writes\n\
+                             are slowed down above it (default %.0f)\n\
   -V, --version              print version information and exit\n\
   -v, --verbose              print information (may be specifified twice)\n\
+  -w, --view <ROWSxCOLS>     show at most the given number of matrix inputs and\n\
+                             mixes, and scroll the matrix\n\
+  -W, --write-budget <num>   max. automation control writes per second (default %d)\n\
+  -X, --matrix <op>          apply a bulk matrix operation, may be given repeatedly\n\
+  -Z, --shm <name>           publish the mixer state in the given POSIX shared\n\
+                             memory object (e.g. /scarlett-mixer)\n\
 \n\n\
+Timeline:\n\
+One move per line: <start-sec> <target> <dB|-inf> <duration-sec> [lin|fader|scurve]\n\
+with target: master, out:N, aux:N or mix:IN:MIX. Shift + middle-click on a\n\
+gain knob fades it in or out over %.0f seconds.\n\
+\n\
+Matrix operations:\n\
+clear-mix:MIX, clear-input:IN, copy:MIX:MIX, stereo:MIX (odd inputs left,\n\
+even inputs right), trim:MIX:dB. On a matrix knob: Shift + right-click clears\n\
+the mix, Ctrl + Shift + right-click the input, Ctrl + right-click copies the mix\n\
+to the next, Ctrl + Shift + middle-click builds a stereo pair, Ctrl + scroll\n\
+trims the mix.\n\
+\n\
+MIDI learn:\n\
+Ctrl + middle-click on a gain knob maps the next CC or NRPN received to it,\n\
+Ctrl + Shift + middle-click on an output gain maps its mute.\n\
+\n\
 Examples:\n\
 scarlett-mixer hw:1\n\
-\n");
+scarlett-mixer -A \"0 mix:1:C 0 2\" -A \"60 master -inf 10 scurve\"\n\
+scarlett-mixer -m verse.scene -m chorus.scene\n\
+\n", DEFAULT_MAX_FPS, DEFAULT_WRITE_LATENCY, DEFAULT_WRITE_BUDGET, GUI_FADE_TIME);
 	printf ("Report bugs to <https://github.com/x42/scarlett-mixer/issues>\n");
 	exit (status);
 }
@@ -1628,8 +5548,18 @@ scarlett-mixer hw:1\n\
 
 #define LVGL_RESIZEABLE
 
-static void ui_enable (LV2UI_Handle handle) { }
-static void ui_disable (LV2UI_Handle handle) { }
+static void ui_enable (LV2UI_Handle handle)
+{
+	RobTkApp* ui = (RobTkApp*)handle;
+	ui->redraw.hidden = false;
+	redraw_damage_all (&ui->redraw, ui->sm.device);
+}
+
+static void ui_disable (LV2UI_Handle handle)
+{
+	RobTkApp* ui = (RobTkApp*)handle;
+	ui->redraw.hidden = true;
+}
 
 static LV2UI_Handle
 instantiate (
@@ -1654,30 +5584,155 @@ instantiate (
 		}
 	}
 
-	int opts = OPT_DETECT;
+	int opts = SM_DETECT;
 	int c;
+	const char* automation_file = NULL;
+	const char* automation_moves[MAX_MOVES];
+	int n_automation_moves = 0;
+	double write_budget = DEFAULT_WRITE_BUDGET;
+	double max_fps = DEFAULT_MAX_FPS;
+	double write_latency = DEFAULT_WRITE_LATENCY;
+	const char* scene_files[2] = { NULL, NULL };
+	const char* scene_out = NULL;
+	const char* state_in = NULL;
+	const char* state_out = NULL;
+	bool print_routes = false;
+	bool use_cache = true;
+	float morph_flip = .5f;
+	const char* journal_dir = NULL;
+	const char* midi_map = NULL;
+	const char* exporter = NULL;
+	const char* shm_name = NULL;
+	const char* matrix_ops[16];
+	int n_matrix_ops = 0;
+
 	while (rtkargv && (c = getopt_long (rtkargv->argc, rtkargv->argv,
+			   "A:" /* automate */
+			   "a:" /* automation */
+			   "B"  /* benchmark */
+			   "C"  /* no-cache */
+			   "E:" /* exporter */
+			   "F:" /* flip */
+			   "f:" /* max-fps */
 			   "h"  /* help */
+			   "I:" /* import-state */
+			   "j:" /* journal */
+			   "l"  /* list */
+			   "M:" /* midi */
+			   "m:" /* morph */
+			   "O:" /* export-state */
 			   "P"  /* Preset-Only */
 			   "p"  /* print-controls */
+			   "r"  /* routes */
+			   "s:" /* save-scene */
+			   "S"  /* selem */
+			   "T:" /* write-latency */
 			   "V"  /* version */
-			   "v", /* verbose */
+			   "v"  /* verbose */
+			   "w:" /* view */
+			   "W:" /* write-budget */
+			   "X:" /* matrix */
+			   "Z:", /* shm */
 			   long_options, (int *) 0)) != EOF) {
 		switch (c) {
 			case 'h':
 				usage (0);
+			case 'l':
+				list_devices ();
+				exit (0);
 			case 'V':
 				printf ("scarlet-mixer version %s\n\n", VERSION);
 				printf ("Copyright (C) GPL 2019 Robin Gareus <robin@gareus.org>\n");
 				exit (0);
 			case 'v':
-				++verbose;
+				sm_set_verbose (++verbose);
 				break;
 			case 'P':
-				opts &= ~OPT_DETECT;
+				opts &= ~SM_DETECT;
 				break;
 			case 'p':
-				opts |= OPT_PROBE;
+				opts |= SM_PROBE;
+				break;
+			case 'B':
+				opts |= OPT_BENCH;
+				break;
+			case 'C':
+				use_cache = false;
+				break;
+			case 'S':
+				opts |= SM_SELEM;
+				break;
+			case 'A':
+				if (n_automation_moves < MAX_MOVES) {
+					automation_moves[n_automation_moves++] = optarg;
+				}
+				break;
+			case 'a':
+				automation_file = optarg;
+				break;
+			case 'F':
+				morph_flip = atof (optarg);
+				if (morph_flip < 0 || morph_flip > 1) {
+					usage (EXIT_FAILURE);
+				}
+				break;
+			case 'f':
+				max_fps = atof (optarg);
+				if (max_fps < 1) {
+					usage (EXIT_FAILURE);
+				}
+				break;
+			case 'm':
+				if (scene_files[1]) {
+					usage (EXIT_FAILURE);
+				}
+				scene_files[scene_files[0] ? 1 : 0] = optarg;
+				break;
+			case 'r':
+				print_routes = true;
+				break;
+			case 's':
+				scene_out = optarg;
+				break;
+			case 'I':
+				state_in = optarg;
+				break;
+			case 'O':
+				state_out = optarg;
+				break;
+			case 'j':
+				journal_dir = optarg;
+				break;
+			case 'M':
+				midi_map = optarg;
+				break;
+			case 'E':
+				exporter = optarg;
+				break;
+			case 'Z':
+				shm_name = optarg;
+				break;
+			case 'X':
+				if (n_matrix_ops < 16) {
+					matrix_ops[n_matrix_ops++] = optarg;
+				}
+				break;
+			case 'w':
+				if (2 != sscanf (optarg, "%ux%u", &ui->vp_rows, &ui->vp_cols) || ui->vp_rows == 0 || ui->vp_cols == 0) {
+					usage (EXIT_FAILURE);
+				}
+				break;
+			case 'T':
+				write_latency = atof (optarg);
+				if (write_latency <= 0) {
+					usage (EXIT_FAILURE);
+				}
+				break;
+			case 'W':
+				write_budget = atof (optarg);
+				if (write_budget < 1) {
+					usage (EXIT_FAILURE);
+				}
 				break;
 			default:
 				usage (EXIT_FAILURE);
@@ -1692,22 +5747,124 @@ instantiate (
 		card = strdup (rtkargv->argv[optind]);
 	}
 	if (!card) {
-		card = lookup_device ();
+		card = sm_lookup_card ();
+		ui->card_auto = card != NULL;
 	}
 	if (!card) {
 		card = strdup (DEFAULT_DEVICE);
 	}
 
-	if (open_mixer (ui, card, opts)) {
-		close_mixer (ui);
+	if (opts & OPT_BENCH) {
+		run_benchmark (ui, card, opts);
+		free (card);
+		free (ui);
+		exit (0);
+	}
+
+	/* show the cached layout right away, unless the device is needed before the GUI */
+	const bool instant = use_cache && !(opts & (SM_PROBE | SM_SELEM))
+		&& !print_routes && !scene_out && !state_out && !state_in && !journal_dir
+		&& !midi_map && n_matrix_ops == 0 && !scene_files[0];
+	bool cached = false;
+
+	if (use_cache) {
+		ui->cache_path = cache_file (card);
+	}
+	if (instant && ui->cache_path && sm_cache_load (&ui->sm, ui->cache_path) == 0) {
+		cached = card_present (card, ui->sm.device->name);
+		if (!cached) {
+			sm_close (&ui->sm);
+		}
+	}
+	if (!cached && sm_open (&ui->sm, card, opts)) {
+		free (ui->cache_path);
 		free (ui);
 		free (card);
 		return 0;
 	}
+	ui->card = card;
+	ui->opts = opts;
+
+	throttle_init (&ui->throttle, write_latency, write_budget);
+	if (!batch_alloc (ui) || !routes_init (ui)) {
+		batch_free (ui);
+		routes_free (&ui->routes);
+		sm_close (&ui->sm);
+		free (ui->cache_path);
+		free (ui);
+		free (card);
+		return 0;
+	}
+
+	if (print_routes) {
+		char txt[65536];
+		routes_format (ui, txt, sizeof (txt), UINT16_MAX);
+		printf ("%s\n", txt);
+		sm_close (&ui->sm);
+		exit (0);
+	}
+
+	if (scene_out) {
+		int rv = scene_save (ui, scene_out) ? 0 : EXIT_FAILURE;
+		sm_close (&ui->sm);
+		exit (rv);
+	}
+	if (state_out) {
+		int rv = alsactl_export (ui, state_out) ? 0 : EXIT_FAILURE;
+		sm_close (&ui->sm);
+		exit (rv);
+	}
+	ui->redraw.interval = 1e6 / max_fps;
+	ui->journal.fd = -1;
+	if (journal_dir) {
+		journal_open (ui, journal_dir);
+	}
+	if (state_in) {
+		alsactl_import (ui, state_in);
+	}
+
+	for (int i = 0; i < n_matrix_ops; ++i) {
+		matrix_op (ui, matrix_ops[i]);
+	}
+
+	if (scene_files[0]) {
+		if (!scene_files[1]) {
+			fprintf (stderr, "Morphing requires two scenes.\n");
+		} else {
+			morph_init (ui, scene_files[0], scene_files[1], morph_flip);
+		}
+	}
+
 	ui->disable_signals = true;
 	*widget = toplevel (ui, ui_toplevel);
 	ui->disable_signals = false;
-	free (card);
+
+	if (cached) {
+		gui_set_sensitive (ui, false);
+		robtk_lbl_set_text (ui->heading[2], "Matrix Mixer (loading)");
+		loader_start (ui);
+	}
+
+	ui->automation.budget = write_budget;
+	if (automation_file) {
+		automation_load (ui, automation_file);
+	}
+	for (int i = 0; i < n_automation_moves; ++i) {
+		automation_parse (ui, automation_moves[i]);
+	}
+	if (midi_map) {
+		midi_start (ui, midi_map);
+	}
+	ui->metrics_fd = -1;
+	for (int i = 0; i < METRICS_CLIENTS; ++i) {
+		ui->metrics_client[i].fd = -1;
+	}
+	if (exporter) {
+		metrics_open (ui, exporter);
+	}
+	if (shm_name) {
+		shm_open_state (ui, shm_name);
+	}
 	return ui;
 }
 
@@ -1721,7 +5878,13 @@ static void
 cleanup (LV2UI_Handle handle)
 {
 	RobTkApp* ui = (RobTkApp*)handle;
+	loader_stop (ui);
+	if (ui->cache_path && ui->sm.mixer && sm_cache_save (&ui->sm, ui->cache_path)) {
+		fprintf (stderr, "Cannot save the layout cache '%s'\n", ui->cache_path);
+	}
+	free (ui->cache_path);
 	gui_cleanup (ui);
+	free (ui->card);
 	free (ui);
 }
 
@@ -1739,9 +5902,25 @@ port_event (LV2UI_Handle handle,
             const void*  buffer)
 {
 	RobTkApp* ui = (RobTkApp*)handle;
-	assert (ui->mixer);
 
-	int n = snd_mixer_poll_descriptors_count (ui->mixer);
+	metrics_serve (ui);
+
+	if (!ui->sm.mixer && ui->loader.active) {
+		loader_poll (ui);
+		if (!ui->sm.mixer) {
+			return;
+		}
+	} else if (!ui->sm.mixer) {
+		try_reattach (ui);
+		shm_update (ui, ui->sm.mixer != NULL);
+		return;
+	}
+
+	automation_tick (&ui->automation);
+	throttle_update (ui);
+	midi_batch_flush (ui);
+
+	int n = snd_mixer_poll_descriptors_count (ui->sm.mixer);
 	unsigned short revents;
 
 	if (n != ui->nfds) {
@@ -1749,72 +5928,40 @@ port_event (LV2UI_Handle handle,
 		ui->nfds = n;
 		ui->pollfds = (struct pollfd*)calloc (n, sizeof (struct pollfd));
 	}
-	if (snd_mixer_poll_descriptors (ui->mixer, ui->pollfds, n) < 0) {
+	if (snd_mixer_poll_descriptors (ui->sm.mixer, ui->pollfds, n) < 0) {
 		return;
 	}
 	n = poll (ui->pollfds, ui->nfds, 0);
 	if (n <= 0) {
+		ui->n_changed = 0;
+		journal_update (ui);
+		redraw_tick (ui);
 		return;
 	}
 
-	if (snd_mixer_poll_descriptors_revents (ui->mixer, ui->pollfds, n, &revents) < 0) {
+	if (snd_mixer_poll_descriptors_revents (ui->sm.mixer, ui->pollfds, ui->nfds, &revents) < 0) {
 		fprintf (stderr, "cannot get poll events\n");
-		robtk_close_self (ui->rw->top);
+		detach_mixer (ui);
+		return;
 	}
 	if (revents & (POLLERR | POLLNVAL)) {
 		fprintf (stderr, "Poll error\n");
-		robtk_close_self (ui->rw->top);
+		detach_mixer (ui);
+		return;
 	}
 	else if (revents & POLLIN) {
-		snd_mixer_handle_events (ui->mixer);
-	}
-
-	/* simply update the complete GUI (on any change) */
-
-	ui->disable_signals = true;
-	Mctrl* ctrl;
-
-	for (unsigned int r = 0; r < ui->device->sin; ++r) {
-		ctrl = src_sel (ui, r);
-		robtk_select_set_value (ui->src_sel[r], get_enum (ctrl));
-	}
-
-	for (unsigned int r = 0; r < ui->device->smi; ++r) {
-		ctrl = matrix_sel (ui, r);
-		robtk_select_set_value (ui->mtx_sel[r], get_enum (ctrl));
-
-		for (unsigned int c = 0; c < ui->device->smo; ++c) {
-			unsigned int n = r * ui->device->smo + c;
-			ctrl = matrix_ctrl_cr (ui, c, r);
-			robtk_dial_set_value (ui->mtx_gain[n], db_to_knob (get_dB (ctrl)));
+		if (snd_mixer_handle_events (ui->sm.mixer) < 0) {
+			detach_mixer (ui);
+			return;
 		}
 	}
 
-	for (unsigned int o = 0; o < ui->device->smst; ++o) {
-		ctrl = out_gain (ui, o);
-		robtk_dial_set_value (ui->out_gain[o], db_to_knob (get_dB (ctrl)));
-		robtk_dial_set_state (ui->out_gain[o], get_mute (ctrl) ? 1 : 0);
-	}
-
-	for (unsigned int o = 0; o < ui->device->samo; ++o) {
-		ctrl = aux_gain (ui, o);
-		robtk_dial_set_value (ui->aux_gain[o], db_to_knob (get_dB (ctrl)));
-	}
-
-	if (ui->device->smst) {
-		ctrl = mst_gain (ui);
-		robtk_dial_set_value (ui->mst_gain, db_to_knob (get_dB (ctrl)));
-		robtk_dial_set_state (ui->mst_gain, get_mute (ctrl) ? 1 : 0);
-	}
-
-	for (unsigned int i = 0; i < ui->device->num_hiz; ++i) {
-		robtk_cbtn_set_active (ui->btn_hiz[i], get_enum (hiz (ui, i)) == 1);
-	}
-
-	for (unsigned int o = 0; o < ui->device->sout; ++o) {
-		ctrl = out_sel (ui, o);
-		robtk_select_set_value (ui->out_sel[o], get_enum (ctrl));
-	}
+	ui->n_events += collect_changes (ui);
+	TRACE1 (port_event, ui->n_changed);
+	routes_update (ui);
+	journal_update (ui);
+	shm_update (ui, false);
 
-	ui->disable_signals = false;
+	redraw_invalidate (ui);
+	redraw_tick (ui);
 }
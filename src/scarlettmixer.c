@@ -0,0 +1,1774 @@
+/* libscarlettmixer - control the mixer of Focusrite Scarlett USB devices
+ *
+ * Copyright 2015-2019 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // strdup, clock_gettime
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+#include <alsa/asoundlib.h>
+
+#include "scarlettmixer_private.h"
+#include "trace.h"
+
+static int verbose = 0;
+
+void sm_set_verbose (int level)
+{
+	verbose = level;
+}
+
+/* *****************************************************************************
+ * Device presets
+ */
+
+/* device specifics, see also
+ * https://git.kernel.org/pub/scm/linux/kernel/git/torvalds/linux.git/tree/sound/usb/mixer_scarlett.c#n635
+ */
+
+static SmDevice devices[] = {
+	{
+		SM_MATRIX_FIELDS (s18i6),
+		.usb_id = SM_USB_ID (0x1235, 0x8004),
+		.sin = 18, .sout = 6,
+		.smst = 3,
+		.samo = 0,
+		.num_hiz = 2,
+		.num_pad = 0,
+		.num_air = 0,
+		.num_gain = 3, .num_bus = 6, .num_label = 3,
+		.pads_are_switches = false,
+		.input_offset = 14,
+		.out_gain_map = (int[]){ 1 /* Monitor */, 4 /* Headphone */, 7 /* SPDIF */ }, // PBS
+		.out_gain_labels = (char[][SM_LABEL_LEN]){ "Monitor", "Headphone", "SPDIF" },
+		.out_bus_map = (int[]){ 2, 3, 5, 6, 8, 9 }, // Source, ENUM
+		.hiz_map = (int[]){ 12, 13 },
+	},
+	{
+		SM_MATRIX_FIELDS (s18i8),
+		.usb_id = SM_USB_ID (0x1235, 0x8014),
+		.sin = 18, .sout = 8,
+		.smst = 4,
+		.samo = 0,
+		.num_hiz = 2,
+		.num_pad = 4,
+		.num_air = 0,
+		.num_gain = 4, .num_bus = 8, .num_label = 4,
+		.pads_are_switches = false,
+		.input_offset = 20,   // < Input Source 01, ENUM
+		.out_gain_map = (int[]){ 1 /* Monitor */, 4 /* Headphone 1 */, 7 /* Headphone 2 */, 10 /* SPDIF */ },
+		.out_gain_labels = (char[][SM_LABEL_LEN]){ "Monitor", "Headphone 1", "Headphone 2", "SPDIF" },
+		.out_bus_map = (int[]){ 2, 3, 5, 6, 8, 9, 11, 12 },
+		.hiz_map = (int[]){ 15, 17 }, // < Input 1 Impedance, ENUM,  Input 2 Impedance, ENUM
+		.pad_map = (int[]){ 16, 18, 19, 20 },
+	},
+	{
+		SM_MATRIX_FIELDS (s6i6),
+		.usb_id = SM_USB_ID (0x1235, 0x8012),
+		.sin = 6, .sout = 6,
+		.smst = 3,
+		.samo = 0,
+		.num_hiz = 2,
+		.num_pad = 4, // XXX does the device have pad? bug in kernel-driver?
+		.num_air = 0,
+		.num_gain = 3, .num_bus = 6, .num_label = 3,
+		.pads_are_switches = false,
+		.out_gain_map = (int[]){ 1 /* Monitor */, 4 /* Headphone */, 7 /* SPDIF */ },
+		.out_gain_labels = (char[][SM_LABEL_LEN]){ "Monitor", "Headphone", "SPDIF" },
+		.out_bus_map = (int[]){ 2, 3, 5, 6, 8, 9 },
+		.input_offset = 18,
+		.hiz_map = (int[]){ 12, 14 },
+		.pad_map = (int[]){ 13, 15, 16, 17 },
+	},
+	{
+		SM_MATRIX_FIELDS (s18i20),
+		.usb_id = SM_USB_ID (0x1235, 0x800c),
+		.sin = 18, .sout = 20,
+		.smst = 10,
+		.samo = 0,
+		.num_hiz = 0,
+		.num_pad = 0,
+		.num_air = 0,
+		.num_gain = 10, .num_bus = 20, .num_label = 10,
+		.pads_are_switches = false,
+		.input_offset = 31,
+		.out_gain_map = (int[]){ 1, 7, 10, 13, 16, 19, 22, 25, 28, 2  },
+		.out_gain_labels = (char[][SM_LABEL_LEN]){ "Monitor", "Line 3/4", "Line 5/6", "Line 7/8", "Line 9/10" , "SPDIF", "ADAT 1/2", "ADAT 3/4", "ADAT 5/6", "ADAT 7/8" },
+		.out_bus_map = (int[]){ 5, 6, 8, 9, 11, 12, 14, 15, 17, 18, 20, 21, 23, 24, 26, 27, 29, 30, 3, 4 },
+	},
+	{
+		SM_MATRIX_FIELDS (s8i6),
+		.usb_id = SM_USB_ID (0x1235, 0x8213),
+		.sin = 10, .sout = 6,
+		.smst = 0,
+		.samo = 4,
+		.num_hiz = 2,
+		.num_pad = 2,
+		.num_air = 2,
+		.num_gain = 4, .num_bus = 6, .num_label = 6,
+		.pads_are_switches = true,
+		.out_gain_map = (int[]){ 10 /* Headphone 1 */, 11, 12 /* Headphone 2 */, 13 },
+		.out_gain_labels = (char[][SM_LABEL_LEN]){ "Headphone 1L", "Headphone 1R", "Headphone 2L", "Headphone 2R", "SPDIF/L", "SPDIF/R" },
+		.out_bus_map = (int[]){ 92, 93, 94, 95, 97, 98 },
+		.input_offset = 0,
+		.hiz_map = (int[]){ 15, 18 },
+		.pad_map = (int[]){ 16, 19 },
+		.air_map = (int[]){ 14, 17 },
+	},
+};
+
+#define NUM_DEVICES     (sizeof (devices) / sizeof (devices[0]))
+
+static bool device_is_preset (SmDevice const* d)
+{
+	return d >= devices && d < devices + NUM_DEVICES;
+}
+
+unsigned int sm_device_count (void)
+{
+	return NUM_DEVICES;
+}
+
+SmDevice const* sm_device_preset (unsigned int i)
+{
+	return i < NUM_DEVICES ? &devices[i] : NULL;
+}
+
+/* compact copy of a descriptor, the maps follow the struct in one allocation */
+static SmDevice* device_dup (SmDevice const* src)
+{
+	const size_t n_int = src->num_gain + src->num_bus + src->num_hiz + src->num_pad + src->num_air;
+	SmDevice* d = malloc (sizeof (SmDevice) + n_int * sizeof (int) + src->num_label * SM_LABEL_LEN);
+	if (!d) {
+		return NULL;
+	}
+	memcpy (d, src, sizeof (SmDevice));
+	int* m = (int*)(d + 1);
+
+#define COPY_MAP(MAP, N)                                 \
+	d->MAP = (N) > 0 ? m : NULL;                           \
+	if ((N) > 0) { memcpy (m, src->MAP, (N) * sizeof (int)); } \
+	m += (N);
+
+	COPY_MAP (out_gain_map, src->num_gain);
+	COPY_MAP (out_bus_map, src->num_bus);
+	COPY_MAP (hiz_map, src->num_hiz);
+	COPY_MAP (pad_map, src->num_pad);
+	COPY_MAP (air_map, src->num_air);
+#undef COPY_MAP
+
+	d->out_gain_labels = src->num_label > 0 ? (char (*)[SM_LABEL_LEN])m : NULL;
+	if (src->num_label > 0) {
+		memcpy (d->out_gain_labels, src->out_gain_labels, src->num_label * SM_LABEL_LEN);
+	}
+	return d;
+}
+
+void sm_device_free (SmDevice* d)
+{
+	if (d && !device_is_preset (d)) {
+		free (d);
+	}
+}
+
+bool sm_device_equal (SmDevice const* a, SmDevice const* b)
+{
+	if (a == b) {
+		return true;
+	}
+#define CMP_FIELD(F) if (a->F != b->F) { return false; }
+	CMP_FIELD (smi); CMP_FIELD (smo); CMP_FIELD (sin); CMP_FIELD (sout);
+	CMP_FIELD (smst); CMP_FIELD (samo);
+	CMP_FIELD (num_hiz); CMP_FIELD (num_pad); CMP_FIELD (num_air);
+	CMP_FIELD (num_gain); CMP_FIELD (num_bus); CMP_FIELD (num_label);
+	CMP_FIELD (pads_are_switches); CMP_FIELD (matrix_mix_column_major);
+	CMP_FIELD (matrix_mix_offset); CMP_FIELD (matrix_mix_stride);
+	CMP_FIELD (matrix_in_offset); CMP_FIELD (matrix_in_stride);
+	CMP_FIELD (input_offset);
+#undef CMP_FIELD
+
+#define CMP_MAP(MAP, N) if ((N) > 0 && memcmp (a->MAP, b->MAP, (N) * sizeof (int))) { return false; }
+	CMP_MAP (out_gain_map, a->num_gain);
+	CMP_MAP (out_bus_map, a->num_bus);
+	CMP_MAP (hiz_map, a->num_hiz);
+	CMP_MAP (pad_map, a->num_pad);
+	CMP_MAP (air_map, a->num_air);
+#undef CMP_MAP
+
+	if (a->num_label > 0 && memcmp (a->out_gain_labels, b->out_gain_labels, a->num_label * SM_LABEL_LEN)) {
+		return false;
+	}
+	return !strcmp (a->name, b->name);
+}
+
+/* *****************************************************************************
+ * Memory arena, one allocation per session for device-shaped tables
+ */
+
+#define ARENA_ALIGN 16
+
+size_t sm_arena_round (size_t size)
+{
+	return (size + ARENA_ALIGN - 1) & ~((size_t)ARENA_ALIGN - 1);
+}
+
+bool sm_arena_init (SmArena* a, size_t size)
+{
+	a->base = calloc (1, size > 0 ? size : 1);
+	a->size = a->base ? size : 0;
+	a->used = 0;
+	a->n_alloc = 0;
+	return a->base != NULL;
+}
+
+void* sm_arena_alloc (SmArena* a, size_t size)
+{
+	if (size == 0) {
+		return NULL;
+	}
+	size = sm_arena_round (size);
+	assert (a->used + size <= a->size);
+	void* rv = a->base + a->used;
+	a->used += size;
+	++a->n_alloc;
+	return rv;
+}
+
+char* sm_arena_strdup (SmArena* a, const char* str)
+{
+	size_t len = strlen (str) + 1;
+	char* rv = sm_arena_alloc (a, len);
+	memcpy (rv, str, len);
+	return rv;
+}
+
+void sm_arena_free (SmArena* a)
+{
+	free (a->base);
+	memset (a, 0, sizeof (SmArena));
+}
+
+/* *****************************************************************************
+ * Mapping for the 18i6 and 18i8
+ *
+ * NOTE: these are numerically hardcoded. see `amixer -D hw:2 control`
+ * and #if'd "Print Controls" debug dump below
+ */
+
+/* mixer-matrix ; colums(src) x rows (dest) */
+SmCtrl* sm_matrix_ctrl_cr (SmMixer* m, unsigned int c, unsigned int r)
+{
+	unsigned int ctrl_id;
+	/* Matrix 01 Mix A
+	 *  ..
+	 * Matrix 18 Mix F
+	 */
+	if (r >= m->device->smi || c >= m->device->smo) {
+		return NULL;
+	}
+	if (m->device->matrix_mix_column_major) {
+		ctrl_id = m->device->matrix_mix_offset + c * m->device->matrix_mix_stride + r;
+	} else {
+		ctrl_id = m->device->matrix_mix_offset + r * m->device->matrix_mix_stride + c;
+	}
+	return &m->ctrl[ctrl_id];
+}
+
+/* wrapper to the above, linear lookup */
+SmCtrl* sm_matrix_ctrl_n (SmMixer* m, unsigned int n)
+{
+	unsigned c = n % m->device->smo;
+	unsigned r = n / m->device->smo;
+	return sm_matrix_ctrl_cr (m, c, r);
+}
+
+/* matrix input selector (per row)*/
+SmCtrl* sm_matrix_sel (SmMixer* m, unsigned int r)
+{
+	if (r >= m->device->smi) {
+		return NULL;
+	}
+	/* Matrix 01 Input, ENUM
+	 *  ..
+	 * Matrix 18 Input, ENUM
+	 */
+	unsigned int ctrl_id = m->device->matrix_in_offset + r * m->device->matrix_in_stride;
+	return &m->ctrl[ctrl_id];
+}
+
+/* Input/Capture selector */
+SmCtrl* sm_src_sel (SmMixer* m, unsigned int r)
+{
+	if (r >= m->device->sin) {
+		return NULL;
+	}
+	/* Input Source 01, ENUM
+	 *  ..
+	 * Input Source 18, ENUM
+	 */
+	unsigned int ctrl_id = m->device->input_offset + r;
+	return &m->ctrl[ctrl_id];
+}
+
+int sm_src_sel_default (unsigned int r, int max_values)
+{
+	/* 0 <= r < device->sin;  return 0 .. max_values - 1 */
+	return (r + 7) % max_values; // XXX hardcoded defaults. offset 7: "Analog 1"
+}
+
+/* Output Gains */
+SmCtrl* sm_out_gain (SmMixer* m, unsigned int c)
+{
+	assert (c < m->device->num_gain);
+	return &m->ctrl[m->device->out_gain_map[c]];
+}
+
+static const char* sm_label (SmMixer* m, unsigned int n)
+{
+	return n < m->device->num_label ? m->device->out_gain_labels[n] : "";
+}
+
+const char* sm_out_gain_label (SmMixer* m, int n)
+{
+	return sm_label (m, n);
+}
+
+SmCtrl* sm_aux_gain (SmMixer* m, unsigned int c)
+{
+	assert (c + m->device->smst < m->device->num_gain);
+	return &m->ctrl[m->device->out_gain_map[c + m->device->smst]];
+}
+
+const char* sm_aux_gain_label (SmMixer* m, int n)
+{
+	return sm_label (m, n + m->device->smst);
+}
+
+/* number of output selectors without gain control */
+unsigned int sm_n_sel_lbl (SmDevice const* d)
+{
+	const unsigned int n_gain = d->samo + d->smst * 2;
+	return d->sout > n_gain ? d->sout - n_gain : 0;
+}
+
+const char* sm_out_select_label (SmMixer* m, int n)
+{
+	return sm_label (m, n + m->device->smst + m->device->samo);
+}
+
+/* Output Bus assignment (matrix-out to master) */
+SmCtrl* sm_out_sel (SmMixer* m, unsigned int c)
+{
+	assert (c < m->device->num_bus);
+	return &m->ctrl[m->device->out_bus_map[c]];
+}
+
+int sm_out_sel_default (unsigned int c)
+{
+	/* 0 <= c < device->sout; */
+	return 25 + c; // XXX hardcoded defaults. offset 25: "Mix 1"
+}
+
+/* Hi-Z switches */
+SmCtrl* sm_hiz (SmMixer* m, unsigned int c)
+{
+	assert (c < m->device->num_hiz);
+	return &m->ctrl[m->device->hiz_map[c]];
+}
+
+/* Pad switches */
+SmCtrl* sm_pad (SmMixer* m, unsigned c)
+{
+	assert (c < m->device->num_pad);
+	return &m->ctrl[m->device->pad_map[c]];
+}
+
+/* Air switches */
+SmCtrl* sm_air (SmMixer* m, unsigned c)
+{
+	assert (c < m->device->num_air);
+	return &m->ctrl[m->device->air_map[c]];
+}
+
+/* master gain */
+SmCtrl* sm_mst_gain (SmMixer* m)
+{
+	return &m->ctrl[0]; /* Master, PBS */
+}
+
+/* *****************************************************************************
+ * Write statistics
+ */
+
+static SmWriteStats write_stats;
+
+static int64_t mono_usec (void)
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void write_stats_add (unsigned int index, long value, int64_t t0)
+{
+	const int64_t dt = mono_usec () - t0;
+	write_stats.lat[write_stats.n_writes++ % SM_WSTAT_RING] = dt;
+	TRACE3 (write, index, value, dt);
+}
+
+SmWriteStats const* sm_write_stats (void)
+{
+	return &write_stats;
+}
+
+static void dump_device_desc (SmDevice const* const d)
+{
+	printf ("--- Device: %s\n", d->name);
+	printf ("Matrix: in=%d, out=%d, off=%d, stride=%d\n",
+			d->smi, d->smo, d->matrix_mix_offset, d->matrix_mix_stride);
+	printf ("Matrix: input-select=%d, select-stride=%d\n",
+			d->matrix_in_offset, d->matrix_in_stride);
+	printf ("Inputs: ins=%d select-offset=%d\n",
+			d->sin, d->input_offset);
+	printf ("Masters: n_mst=%d n_out-select=%d\n",
+			d->smst, d->sout);
+	printf ("Switches: n_pad=%d, n_hiz=%d\n",
+			d->num_pad, d->num_hiz);
+
+#define DUMP_ARRAY(name, len, fmt)  \
+  printf (#name " = {");            \
+  for (int i = 0; i < len; ++i) {   \
+    printf (fmt ", ", d->name[i]);  \
+  }                                 \
+  printf ("};\n");
+
+	DUMP_ARRAY (hiz_map, d->num_hiz, "%d");
+	DUMP_ARRAY (pad_map, d->num_pad, "%d");
+	DUMP_ARRAY (air_map, d->num_air, "%d");
+	DUMP_ARRAY (out_gain_map, d->num_gain, "%d");
+	DUMP_ARRAY (out_gain_labels, d->num_label, "%s");
+	DUMP_ARRAY (out_bus_map, d->num_bus, "%d");
+	printf ("---\n");
+}
+
+/* *****************************************************************************
+ * Alsa Mixer Interface
+ */
+
+static void set_label (char* dst, const char* src, size_t len)
+{
+	if (len >= SM_LABEL_LEN) {
+		len = SM_LABEL_LEN - 1;
+	}
+	memcpy (dst, src, len);
+	dst[len] = '\0';
+}
+
+/* query capabilities, channel layout and dB range once */
+static void mctrl_probe (SmCtrl* c)
+{
+	snd_mixer_elem_t* elem = c->elem;
+	long vmin = 0, vmax = 0;
+
+	c->caps = 0;
+	c->pb_chn = c->cp_chn = 0;
+	c->n_items = 0;
+	c->db_min = c->db_max = c->db_step = 0;
+	c->db_valid = false;
+
+	if (snd_mixer_selem_is_enumerated (elem)) {
+		c->caps |= SM_CAP_ENUM;
+		c->n_items = snd_mixer_selem_get_enum_items (elem);
+	}
+	if (snd_mixer_selem_has_playback_switch (elem)) { c->caps |= SM_CAP_PSW; }
+	if (snd_mixer_selem_has_capture_switch (elem))  { c->caps |= SM_CAP_CSW; }
+	if (snd_mixer_selem_has_playback_volume (elem)) { c->caps |= SM_CAP_PVOL; }
+	if (snd_mixer_selem_has_capture_volume (elem))  { c->caps |= SM_CAP_CVOL; }
+
+	for (int chn = 0; chn <= SND_MIXER_SCHN_LAST; ++chn) {
+		snd_mixer_selem_channel_id_t cid = (snd_mixer_selem_channel_id_t) chn;
+		if (snd_mixer_selem_has_playback_channel (elem, cid)) { c->pb_chn |= 1u << chn; }
+		if (snd_mixer_selem_has_capture_channel (elem, cid))  { c->cp_chn |= 1u << chn; }
+	}
+
+	if (c->caps & SM_CAP_PVOL) {
+		snd_mixer_selem_get_playback_dB_range (elem, &c->db_min, &c->db_max);
+		snd_mixer_selem_get_playback_volume_range (elem, &vmin, &vmax);
+	} else if (c->caps & SM_CAP_CVOL) {
+		snd_mixer_selem_get_capture_dB_range (elem, &c->db_min, &c->db_max);
+		snd_mixer_selem_get_capture_volume_range (elem, &vmin, &vmax);
+	}
+
+	/* linear dB-scale: one raw step per quantum, mute-floor has no fixed step */
+	if (vmax > vmin && c->db_max > c->db_min && c->db_min > SND_CTL_TLV_DB_GAIN_MUTE) {
+		c->db_step = (c->db_max - c->db_min) / (vmax - vmin);
+	}
+}
+
+/* clamp to range and round to the nearest step, result in dB * 100 */
+static long mctrl_quantise_dB (SmCtrl const* c, float dB)
+{
+	long val = lrintf (100.f * dB);
+	if (val < c->db_min) { val = c->db_min; }
+	if (val > c->db_max) { val = c->db_max; }
+	if (c->db_step > 0) {
+		val = c->db_min + c->db_step * ((val - c->db_min + c->db_step / 2) / c->db_step);
+	}
+	return val;
+}
+
+/* *****************************************************************************
+ * Control API backend
+ *
+ * The simple-mixer is only used to enumerate controls (the device maps
+ * index its elements). Their kernel controls are matched in one pass over
+ * the hctl element list, values are read once in bulk and then read and
+ * written by numid. Controls that cannot be resolved use the simple-mixer.
+ */
+
+static size_t ctl_arena_size (unsigned int n_ctrl)
+{
+	return n_ctrl * 2 * (sm_arena_round (snd_ctl_elem_value_sizeof ()) + sm_arena_round (SM_TLV_MAX * sizeof (unsigned int)));
+}
+
+/* kernel control names are the simple-mixer name plus one of these */
+static const char* const ctl_suffix[] = {
+	" Playback Volume", " Capture Volume", " Volume",
+	" Playback Switch", " Capture Switch", " Switch",
+	" Playback Enum", " Capture Enum", " Enum",
+	" Playback Route", " Capture Route", " Route",
+	NULL
+};
+
+typedef struct {
+	const char*  name;
+	unsigned int index; //< simple-mixer element index
+	SmCtrl*      c;
+} CtlKey;
+
+static int ctl_key_cmp (const void* a, const void* b)
+{
+	CtlKey const* ka = (CtlKey const*)a;
+	CtlKey const* kb = (CtlKey const*)b;
+	int rv = strcmp (ka->name, kb->name);
+	if (rv == 0) {
+		rv = ka->index < kb->index ? -1 : ka->index > kb->index ? 1 : 0;
+	}
+	return rv;
+}
+
+static bool ctl_fill_elem (SmArena* a, snd_hctl_t* hctl, snd_hctl_elem_t* elem,
+                           snd_ctl_elem_info_t* info, SmCtlElem* e)
+{
+	e->ctl   = snd_hctl_ctl (hctl);
+	e->numid = snd_hctl_elem_get_numid (elem);
+	e->type  = snd_ctl_elem_info_get_type (info);
+	e->count = snd_ctl_elem_info_get_count (info);
+
+	if (e->type == SND_CTL_ELEM_TYPE_INTEGER) {
+		e->min = snd_ctl_elem_info_get_min (info);
+		e->max = snd_ctl_elem_info_get_max (info);
+		e->tlv = sm_arena_alloc (a, SM_TLV_MAX * sizeof (unsigned int));
+		if (snd_hctl_elem_tlv_read (elem, e->tlv, SM_TLV_MAX * sizeof (unsigned int)) < 0) {
+			e->numid = 0;
+			return false;
+		}
+	}
+
+	e->val = sm_arena_alloc (a, snd_ctl_elem_value_sizeof ());
+	snd_ctl_elem_value_set_numid (e->val, e->numid);
+	if (snd_ctl_elem_read (e->ctl, e->val) < 0) {
+		e->numid = 0;
+		return false;
+	}
+	return true;
+}
+
+/* the kernel element slot of a control, by type; NULL if it has none or it was tried */
+static SmCtlElem* ctl_slot (SmCtrl* c, snd_ctl_elem_type_t type)
+{
+	SmCtlElem* e = NULL;
+	switch (type) {
+		case SND_CTL_ELEM_TYPE_INTEGER:
+			e = (c->caps & (SM_CAP_PVOL | SM_CAP_CVOL)) ? &c->cv : NULL;
+			break;
+		case SND_CTL_ELEM_TYPE_BOOLEAN:
+			e = (c->caps & (SM_CAP_PSW | SM_CAP_CSW)) && !(c->caps & SM_CAP_ENUM) ? &c->cs : NULL;
+			break;
+		case SND_CTL_ELEM_TYPE_ENUMERATED:
+			e = (c->caps & SM_CAP_ENUM) ? &c->cs : NULL;
+			break;
+		default:
+			break;
+	}
+	return e && !e->ctl ? e : NULL;
+}
+
+/* find the kernel controls behind the simple-mixer elements, in a single
+ * pass over the hctl element list. Returns the number of controls that
+ * are fully accessed by numid, the others use the simple-mixer API */
+static int ctl_resolve_all (SmArena* a, snd_hctl_t* hctl, SmCtrl* ctrl, unsigned int cnt)
+{
+	CtlKey* keys = (CtlKey*)malloc (cnt * sizeof (CtlKey));
+	if (!keys) {
+		return 0;
+	}
+	for (unsigned int i = 0; i < cnt; ++i) {
+		keys[i].name  = ctrl[i].name;
+		keys[i].index = snd_mixer_selem_get_index (ctrl[i].elem);
+		keys[i].c     = &ctrl[i];
+	}
+	qsort (keys, cnt, sizeof (CtlKey), ctl_key_cmp);
+
+	snd_ctl_elem_info_t* info;
+	snd_ctl_elem_info_alloca (&info);
+
+	for (snd_hctl_elem_t* elem = snd_hctl_first_elem (hctl); elem; elem = snd_hctl_elem_next (elem)) {
+		if (snd_hctl_elem_get_interface (elem) != SND_CTL_ELEM_IFACE_MIXER) {
+			continue;
+		}
+		char name[128];
+		strncpy (name, snd_hctl_elem_get_name (elem), sizeof (name) - 1);
+		name[sizeof (name) - 1] = '\0';
+
+		CtlKey key;
+		key.name  = name;
+		key.index = snd_hctl_elem_get_index (elem);
+		CtlKey* k = (CtlKey*)bsearch (&key, keys, cnt, sizeof (CtlKey), ctl_key_cmp);
+		if (!k) {
+			const size_t len = strlen (name);
+			for (const char* const* sfx = ctl_suffix; *sfx && !k; ++sfx) {
+				const size_t sl = strlen (*sfx);
+				if (len > sl && !strcmp (name + len - sl, *sfx)) {
+					name[len - sl] = '\0';
+					k = (CtlKey*)bsearch (&key, keys, cnt, sizeof (CtlKey), ctl_key_cmp);
+					name[len - sl] = (*sfx)[0];
+				}
+			}
+		}
+		if (!k || snd_hctl_elem_info (elem, info) < 0) {
+			continue;
+		}
+		SmCtlElem* e = ctl_slot (k->c, snd_ctl_elem_info_get_type (info));
+		if (e) {
+			ctl_fill_elem (a, hctl, elem, info, e);
+		}
+	}
+	free (keys);
+
+	int n_resolved = 0;
+	for (unsigned int i = 0; i < cnt; ++i) {
+		SmCtrl* c = &ctrl[i];
+		bool ok = true;
+		if (c->caps & (SM_CAP_PVOL | SM_CAP_CVOL)) {
+			ok &= c->cv.numid != 0;
+		}
+		if (c->caps & (SM_CAP_ENUM | SM_CAP_PSW | SM_CAP_CSW)) {
+			ok &= c->cs.numid != 0;
+		}
+		if (ok) {
+			++n_resolved;
+		} else {
+			c->cv.numid = c->cs.numid = 0;
+		}
+	}
+	return n_resolved;
+}
+
+static long ctl_get (SmCtlElem const* e)
+{
+	switch (e->type) {
+		case SND_CTL_ELEM_TYPE_BOOLEAN:
+			return snd_ctl_elem_value_get_boolean (e->val, 0);
+		case SND_CTL_ELEM_TYPE_ENUMERATED:
+			return snd_ctl_elem_value_get_enumerated (e->val, 0);
+		default:
+			return snd_ctl_elem_value_get_integer (e->val, 0);
+	}
+}
+
+/* set all channels of the value, without writing it */
+static void ctl_fill (SmCtlElem* e, long v)
+{
+	for (unsigned int i = 0; i < e->count; ++i) {
+		switch (e->type) {
+			case SND_CTL_ELEM_TYPE_BOOLEAN:
+				snd_ctl_elem_value_set_boolean (e->val, i, v);
+				break;
+			case SND_CTL_ELEM_TYPE_ENUMERATED:
+				snd_ctl_elem_value_set_enumerated (e->val, i, v);
+				break;
+			default:
+				snd_ctl_elem_value_set_integer (e->val, i, v);
+				break;
+		}
+	}
+}
+
+/* set all channels, single write */
+static int ctl_set (SmCtlElem* e, long v)
+{
+	ctl_fill (e, v);
+	int rv = snd_ctl_elem_write (e->ctl, e->val);
+	if (rv < 0) {
+		snd_ctl_elem_read (e->ctl, e->val);
+	}
+	return rv;
+}
+
+/* simple-mixer element changed, update cached values */
+static int mctrl_elem_cb (snd_mixer_elem_t* elem, unsigned int mask)
+{
+	SmCtrl* c = (SmCtrl*) snd_mixer_elem_get_callback_private (elem);
+	if (!c || mask == SND_CTL_EVENT_MASK_REMOVE || !(mask & SND_CTL_EVENT_MASK_VALUE)) {
+		return 0;
+	}
+	if (c->cv.numid) {
+		snd_ctl_elem_read (c->cv.ctl, c->cv.val);
+	}
+	if (c->cs.numid) {
+		snd_ctl_elem_read (c->cs.ctl, c->cs.val);
+	}
+	c->db_valid = false;
+	c->changed  = true;
+	return 0;
+}
+
+static int do_open_mixer (SmMixer* m, const char* card, int opts)
+{
+	int rv = 0;
+	int err;
+	snd_mixer_selem_id_t *sid;
+	snd_mixer_elem_t *elem;
+	snd_mixer_selem_id_alloca (&sid);
+
+	snd_ctl_t *hctl;
+	snd_ctl_card_info_t *card_info;
+	snd_ctl_card_info_alloca (&card_info);
+
+	if ((err = snd_ctl_open (&hctl, card, 0)) < 0) {
+		fprintf (stderr, "Control device %s open error: %s\n", card, snd_strerror (err));
+		return err;
+	}
+
+	if ((err = snd_ctl_card_info (hctl, card_info)) < 0) {
+		fprintf (stderr, "Control device %s hw info error: %s\n", card, snd_strerror (err));
+		return err;
+	}
+
+	const char* card_name = snd_ctl_card_info_get_name (card_info);
+	snd_ctl_close (hctl);
+
+	if (!card_name) {
+		fprintf (stderr, "Device `%s' is unknown\n", card);
+		return -1;
+	}
+
+	m->device = NULL;
+
+	for (unsigned i = 0; i < NUM_DEVICES; i++) {
+		if (!strcmp (card_name, devices[i].name))
+			m->device = &devices[i];
+	}
+
+	if (m->device == NULL) {
+		fprintf (stderr, "Device `%s' is not supported\n", card);
+		rv = -1;
+		if ((opts & SM_PROBE) == 0) {
+			return -1;
+		}
+	}
+
+	if ((err = snd_mixer_open (&m->mixer, 0)) < 0) {
+		fprintf (stderr, "Mixer %s open error: %s\n", card, snd_strerror (err));
+		return err;
+	}
+	if ((err = snd_mixer_attach (m->mixer, card)) < 0) {
+		fprintf (stderr, "Mixer attach %s error: %s\n", card, snd_strerror (err));
+		snd_mixer_close (m->mixer);
+		m->mixer = NULL;
+		return err;
+	}
+	if ((err = snd_mixer_selem_register (m->mixer, NULL, NULL)) < 0) {
+		fprintf (stderr, "Mixer register error: %s\n", snd_strerror (err));
+		snd_mixer_close (m->mixer);
+		m->mixer = NULL;
+		return err;
+	}
+	err = snd_mixer_load (m->mixer);
+	if (err < 0) {
+		fprintf (stderr, "Mixer %s load error: %s\n", card, snd_strerror (err));
+		snd_mixer_close (m->mixer);
+		m->mixer = NULL;
+		return err;
+	}
+
+	int cnt = 0;
+	size_t arena_size = 0;
+
+	for (elem = snd_mixer_first_elem (m->mixer); elem; elem = snd_mixer_elem_next (elem)) {
+		if (!snd_mixer_selem_is_active (elem)) {
+			continue;
+		}
+		arena_size += sm_arena_round (strlen (snd_mixer_selem_get_name (elem)) + 1);
+		++cnt;
+	}
+
+	m->ctrl_cnt = cnt;
+
+	if (cnt == 0) {
+		fprintf (stderr, "Mixer %s: no controls found\n", card);
+		return -1;
+	}
+
+	if (opts & SM_PROBE) {
+		fprintf (stderr, "Device `%s' has %d contols: \n", card_name, cnt);
+	}
+
+	snd_hctl_t* mixer_hctl = NULL;
+	if (!(opts & SM_SELEM) && snd_mixer_get_hctl (m->mixer, card, &mixer_hctl) == 0) {
+		arena_size += ctl_arena_size (cnt);
+	} else {
+		mixer_hctl = NULL;
+	}
+
+	arena_size += sm_arena_round (cnt * sizeof (SmCtrl));
+	if (!sm_arena_init (&m->arena, arena_size)) {
+		return -1;
+	}
+	m->ctrl = (SmCtrl*)sm_arena_alloc (&m->arena, cnt * sizeof (SmCtrl));
+
+	/* autodetection scratch space, no role has more entries than there are controls */
+	int* scratch = calloc (5 * cnt, sizeof (int));
+	char (*scratch_labels)[SM_LABEL_LEN] = calloc (cnt, SM_LABEL_LEN);
+	if (!scratch || !scratch_labels) {
+		free (scratch);
+		free (scratch_labels);
+		return -1;
+	}
+
+	SmDevice d;
+	memset (&d, 0, sizeof (SmDevice));
+	strncpy (d.name, card_name, 63);
+	d.out_gain_map = scratch;
+	d.out_bus_map  = scratch + cnt;
+	d.hiz_map      = scratch + 2 * cnt;
+	d.pad_map      = scratch + 3 * cnt;
+	d.air_map      = scratch + 4 * cnt;
+	d.out_gain_labels = scratch_labels;
+	int obm = 0;
+	int n_resolved = 0;
+
+	int i = 0;
+	for (elem = snd_mixer_first_elem (m->mixer); elem; elem = snd_mixer_elem_next (elem)) {
+		if (!snd_mixer_selem_is_active (elem)) {
+			continue;
+		}
+
+		SmCtrl* c = &m->ctrl[i];
+		c->elem  = elem;
+		c->index = i;
+		c->name  = sm_arena_strdup (&m->arena, snd_mixer_selem_get_name (elem));
+		mctrl_probe (c);
+		snd_mixer_elem_set_callback_private (elem, c);
+		snd_mixer_elem_set_callback (elem, mctrl_elem_cb);
+
+		if (opts & SM_DETECT) {
+			if (snd_mixer_selem_is_enumerated (elem)) {
+				if (strstr (c->name, " Impedance") || strstr (c->name, " Level")) {
+					d.hiz_map[d.num_hiz++] = i;
+				}
+				if (strstr (c->name, " Pad")) {
+					d.pad_map[d.num_pad++] = i;
+				}
+				if (strstr (c->name, "Input Source 01") || strstr (c->name, "PCM 01")) {
+					assert (d.input_offset == 0);
+					d.input_offset = i;
+				}
+				if (strstr (c->name, "Input Source") || strstr (c->name, "PCM ")) {
+					++d.sin;
+				}
+				if (strstr (c->name, "Matrix 01 Input") || (strstr (c->name, "Mixer Input 01"))) {
+					assert (d.matrix_in_offset == 0);
+					d.matrix_in_offset = i;
+				}
+				if ((strstr (c->name, "Matrix ") || (strstr (c->name, "Mixer "))) && strstr (c->name, " Input")) {
+					++d.smi;
+					if (strstr(c->name, "Mixer ") && (d.smi == 2)) {
+						d.matrix_in_stride = i - d.matrix_in_offset;
+					}
+				}
+				if (strstr (c->name, "Master ") || strstr (c->name, " Output")) { // Source enum
+					char* t1 = strstr(c->name, " Output");
+					d.out_bus_map[obm++] = i;
+					if (t1 && (obm > d.samo + d.smst)) {
+						set_label (d.out_gain_labels[obm - 1], c->name, t1 - c->name);
+						d.sout++;
+					}
+				}
+			} else if (snd_mixer_selem_has_playback_switch (elem)) {
+				if (strstr (c->name, "Master ")) {
+					char* t1 = strchr (c->name, '(');
+					char* t2 = t1 ? strchr (t1, ')') : NULL;
+					if (t2) {
+						++t1;
+						set_label (d.out_gain_labels[d.smst], t1, t2 - t1);
+					}
+					d.out_gain_map[d.smst++] = i;
+					d.sout = d.smst * 2;
+				} else if (strstr (c->name, " Output")) {
+					char* t1 = strstr(c->name, " Output");
+					char* t2 = t1 ? strchr (t1 + 1, ' ') : NULL;
+					if (t2) {
+						char* lbl = d.out_gain_labels[d.smst];
+						set_label (lbl, c->name, t1 - c->name);
+						strncat (lbl, t2, SM_LABEL_LEN - 1 - strlen (lbl));
+					}
+					d.out_gain_map[d.smst++] = i;
+					d.sout = d.smst * 2;
+				}
+			} else if (snd_mixer_selem_has_capture_switch (elem)) {
+				if (strstr (c->name, " Pad")) {
+					d.pad_map[d.num_pad++] = i;
+					d.pads_are_switches = true;
+				} else if (strstr (c->name, " Air")) {
+					d.air_map[d.num_air++] = i;
+				}
+			} else {
+				if (strstr (c->name, "Line 0") || strstr (c->name, "Line 1")) {
+					char* t1 = c->name + 9;
+					char* t2 = strchr (t1 + 1, ')');
+					if (t2) {
+						set_label (d.out_gain_labels[d.smst + d.samo], t1, t2 - t1);
+					}
+					d.out_gain_map[d.smst + d.samo++] = i;
+					d.sout++;
+				}
+
+				if (strstr (c->name, "Matrix 01 Mix A") || strstr (c->name, "Mix A Input 01")) {
+					d.matrix_mix_offset = i;
+				}
+				if (strstr (c->name, "Matrix ") && strstr (c->name, " Mix ")) {
+					int last = c->name[strlen (c->name) - 1] - 'A' + 1;
+					assert (last > 0 && last <= 26);
+					if (last > d.smo) {
+						d.smo = last;
+
+						d.matrix_mix_stride = d.smo + 1;
+						d.matrix_in_stride = d.smo + 1;
+					}
+				} else if (strstr (c->name, "Mix ") && strstr (c->name, " Input ")) {
+					int last = c->name[4] - 'A' + 1;
+					assert (last > 0 && last <= 26);
+					if (last > d.smo) {
+						d.smo = last;
+
+						d.matrix_mix_stride = d.smo;
+						d.matrix_in_stride = d.smo + 1;
+					}
+					d.matrix_mix_column_major = true;
+				}
+			}
+		}
+
+		if (opts & SM_PROBE) {
+			printf (" %d '%s'", i, c->name);
+			if (snd_mixer_selem_is_enumerated (elem)) { printf (", ENUM"); }
+			if (snd_mixer_selem_has_playback_switch (elem)) { printf (", PBS"); }
+			if (snd_mixer_selem_has_capture_switch (elem)) { printf (", CPS"); }
+			printf ("\n");
+		}
+		++i;
+		assert (i <= cnt);
+	}
+
+	if (mixer_hctl) {
+		n_resolved = ctl_resolve_all (&m->arena, mixer_hctl, m->ctrl, cnt);
+	}
+	if (verbose && mixer_hctl) {
+		printf ("Control API: %d/%d controls by numid\n", n_resolved, cnt);
+	}
+
+	d.num_gain  = d.smst + d.samo;
+	d.num_bus   = obm;
+	d.num_label = d.num_gain > d.num_bus ? d.num_gain : d.num_bus;
+	if (d.sout > d.num_bus) {
+		d.sout = d.num_bus; // every output selector needs a control
+	}
+
+	if ((opts & SM_DETECT) && rv == 0 && m->device) {
+		if (verbose > 1) {
+			printf ("CMP %d\n", sm_device_equal (m->device, &d) ? 0 : 1);
+			dump_device_desc (&d);
+			dump_device_desc (m->device);
+		}
+	}
+	if ((opts & SM_DETECT)
+	    /* test is all relevant offsets have been detected */
+	    && (   d.smi != 0 && d.smo != 0
+	        && d.sin != 0 && d.sout != 0
+	        && d.matrix_in_offset != 0 && d.matrix_mix_offset != 0
+	        && (d.smst != 0 || d.samo != 0)
+	       )
+	   )
+	{
+		if (verbose) {
+			printf ("Using autodetected mapping.\n");
+		}
+		if (m->device) {
+			d.usb_id = m->device->usb_id;
+		}
+		SmDevice* dd = device_dup (&d);
+		if (dd) {
+			m->device = dd;
+			rv = 0;
+		}
+	}
+	free (scratch);
+	free (scratch_labels);
+	return rv;
+}
+
+int sm_open (SmMixer* m, const char* card, int opts)
+{
+	memset (m, 0, sizeof (SmMixer));
+	TRACE1 (open_mixer_entry, card);
+	int rv = do_open_mixer (m, card, opts);
+	TRACE2 (open_mixer_exit, rv, m->ctrl_cnt);
+	if (rv) {
+		sm_close (m);
+	}
+	return rv;
+}
+
+void sm_close (SmMixer* m)
+{
+	sm_arena_free (&m->arena);
+	m->ctrl = NULL;
+	m->ctrl_cnt = 0;
+	if (m->mixer) {
+		snd_mixer_close (m->mixer);
+		m->mixer = NULL;
+	}
+	sm_device_free (m->device);
+	m->device = NULL;
+}
+
+void sm_detach (SmMixer* m)
+{
+	if (m->mixer) {
+		snd_mixer_close (m->mixer);
+		m->mixer = NULL;
+	}
+	for (unsigned int i = 0; i < m->ctrl_cnt; ++i) {
+		m->ctrl[i].elem = NULL;
+		m->ctrl[i].cv.ctl = NULL; // owned by the mixer
+		m->ctrl[i].cs.ctl = NULL;
+		m->ctrl[i].db_valid = false;
+	}
+}
+
+SmMixer* sm_mixer_new (void)
+{
+	return (SmMixer*)calloc (1, sizeof (SmMixer));
+}
+
+void sm_mixer_free (SmMixer* m)
+{
+	if (m) {
+		sm_close (m);
+		free (m);
+	}
+}
+
+SmDevice const* sm_device (SmMixer const* m)
+{
+	return m->device;
+}
+
+unsigned int sm_ctrl_count (SmMixer const* m)
+{
+	return m->ctrl_cnt;
+}
+
+SmCtrl* sm_ctrl (SmMixer* m, unsigned int i)
+{
+	return i < m->ctrl_cnt ? &m->ctrl[i] : NULL;
+}
+
+const char* sm_ctrl_name (SmCtrl const* c)
+{
+	return c->name;
+}
+
+unsigned int sm_ctrl_caps (SmCtrl const* c)
+{
+	return c->caps;
+}
+
+/* false if the control of a detached or cached mixer, writes are ignored */
+static bool mctrl_writable (SmCtrl const* c, SmCtlElem const* e)
+{
+	return e->numid ? e->ctl != NULL : c->elem != NULL;
+}
+
+void sm_set_mute (SmCtrl* c, bool muted)
+{
+	int v = muted ? 0 : 1;
+	assert (c && (c->caps & SM_CAP_PSW));
+	if (!mctrl_writable (c, &c->cs)) {
+		return;
+	}
+	const int64_t t0 = mono_usec ();
+	if (c->cs.numid) {
+		ctl_set (&c->cs, v);
+	} else {
+		for (int chn = 0; chn <= SND_MIXER_SCHN_LAST; ++chn) {
+			if (c->pb_chn & (1u << chn)) {
+				snd_mixer_selem_set_playback_switch (c->elem, (snd_mixer_selem_channel_id_t)chn, v);
+			}
+		}
+	}
+	write_stats_add (c->index, v, t0);
+}
+
+bool sm_get_mute (SmCtrl* c)
+{
+	int v = 0;
+	assert (c && (c->caps & SM_CAP_PSW));
+	if (c->cs.numid) {
+		return ctl_get (&c->cs) == 0;
+	}
+	if (!c->elem) {
+		return c->sel_val == 0;
+	}
+	snd_mixer_selem_get_playback_switch (c->elem, (snd_mixer_selem_channel_id_t)0, &v);
+	return v == 0;
+}
+
+float sm_get_dB (SmCtrl* c)
+{
+	assert (c);
+	long val = 0;
+	if (c->cv.numid) {
+		if (snd_tlv_convert_to_dB (c->cv.tlv, c->cv.min, c->cv.max, ctl_get (&c->cv), &val) < 0) {
+			val = 0;
+		}
+	} else if (!c->elem) {
+		val = c->db_val;
+	} else if (c->caps & SM_CAP_PVOL) {
+		snd_mixer_selem_get_playback_dB (c->elem, (snd_mixer_selem_channel_id_t)0, &val);
+	} else if (c->caps & SM_CAP_CVOL) {
+		snd_mixer_selem_get_capture_dB (c->elem, (snd_mixer_selem_channel_id_t)0, &val);
+	}
+	c->db_val = val;
+	c->db_valid = true;
+	return val / 100.f;
+}
+
+void sm_set_dB (SmCtrl* c, float dB)
+{
+	assert (c && (c->caps & (SM_CAP_PVOL | SM_CAP_CVOL)));
+	if (!mctrl_writable (c, &c->cv)) {
+		return;
+	}
+	const long val = mctrl_quantise_dB (c, dB);
+	if (c->db_valid && c->db_val == val) {
+		return;
+	}
+	const int64_t t0 = mono_usec ();
+	if (c->cv.numid) {
+		long raw;
+		if (snd_tlv_convert_from_dB (c->cv.tlv, c->cv.min, c->cv.max, val, 0, &raw) < 0
+		    || ctl_set (&c->cv, raw) < 0) {
+			c->db_valid = false;
+		} else {
+			c->db_val = val;
+			c->db_valid = true;
+		}
+		write_stats_add (c->index, val, t0);
+		return;
+	}
+	for (int chn = 0; chn <= SND_MIXER_SCHN_LAST; ++chn) {
+		snd_mixer_selem_channel_id_t cid = (snd_mixer_selem_channel_id_t) chn;
+		if ((c->caps & SM_CAP_PVOL) && (c->pb_chn & (1u << chn))) {
+			snd_mixer_selem_set_playback_dB (c->elem, cid, val, 0);
+		}
+		if ((c->caps & SM_CAP_CVOL) && (c->cp_chn & (1u << chn))) {
+			snd_mixer_selem_set_capture_dB (c->elem, cid, val, 0);
+		}
+	}
+	c->db_val = val;
+	c->db_valid = true;
+	write_stats_add (c->index, val, t0);
+}
+
+float sm_get_dB_range (SmCtrl* c, bool maximum)
+{
+	return (maximum ? c->db_max : c->db_min) / 100.f;
+}
+
+void sm_set_enum (SmCtrl* c, int v)
+{
+	assert (c->caps & SM_CAP_ENUM);
+	if (!mctrl_writable (c, &c->cs)) {
+		return;
+	}
+	const int64_t t0 = mono_usec ();
+	if (c->cs.numid) {
+		ctl_set (&c->cs, v);
+	} else {
+		snd_mixer_selem_set_enum_item (c->elem, (snd_mixer_selem_channel_id_t)0, v);
+	}
+	write_stats_add (c->index, v, t0);
+}
+
+int sm_get_enum (SmCtrl* c)
+{
+	unsigned int idx = 0;
+	assert (c->caps & SM_CAP_ENUM);
+	if (c->cs.numid) {
+		return ctl_get (&c->cs);
+	}
+	if (!c->elem) {
+		return c->sel_val;
+	}
+	snd_mixer_selem_get_enum_item (c->elem, (snd_mixer_selem_channel_id_t)0, &idx);
+	return idx;
+}
+
+void sm_set_switch (SmCtrl* c, bool on)
+{
+	int v = on ? 1 : 0;
+	assert (c && (c->caps & SM_CAP_CSW));
+	if (!mctrl_writable (c, &c->cs)) {
+		return;
+	}
+	const int64_t t0 = mono_usec ();
+	if (c->cs.numid) {
+		ctl_set (&c->cs, v);
+	} else {
+		snd_mixer_selem_set_capture_switch (c->elem, 0, v);
+	}
+	write_stats_add (c->index, v, t0);
+}
+
+int sm_get_enum_name (SmCtrl* c, int i, char* name, size_t len)
+{
+	assert (c->caps & SM_CAP_ENUM);
+	if (i < 0 || i >= c->n_items) {
+		return -1;
+	}
+	if (c->items) {
+		snprintf (name, len, "%s", c->items[i]);
+		return 0;
+	}
+	if (!c->elem) {
+		return -1;
+	}
+	return snd_mixer_selem_get_enum_item_name (c->elem, i, len, name);
+}
+
+bool sm_get_switch (SmCtrl* c)
+{
+	int v = 0;
+	assert (c && (c->caps & SM_CAP_CSW));
+	if (c->cs.numid) {
+		return ctl_get (&c->cs) == 1;
+	}
+	if (!c->elem) {
+		return c->sel_val == 1;
+	}
+	snd_mixer_selem_get_capture_switch (c->elem, (snd_mixer_selem_channel_id_t)0, &v);
+	return v == 1;
+}
+
+bool sm_raw_to_dB (SmCtrl const* c, long raw, long* dB)
+{
+	if (!c->cv.numid || !c->cv.tlv) {
+		return false;
+	}
+	return snd_tlv_convert_to_dB (c->cv.tlv, c->cv.min, c->cv.max, raw, dB) >= 0;
+}
+
+/* *****************************************************************************
+ * Layout cache
+ *
+ * Header, device descriptor (struct and maps), then per control a
+ * CacheCtrl followed by its name and enum item names (uint32_t length,
+ * characters). Native endian, only read back by the same build.
+ */
+
+#define CACHE_MAGIC 0x534d4332 // "SMC2"
+
+typedef struct {
+	uint32_t numid; //< 0: not present
+	uint32_t count;
+	uint32_t type;
+	int64_t  min;
+	int64_t  max;
+	int64_t  value;
+	uint32_t tlv[SM_TLV_MAX];
+} CacheElem;
+
+typedef struct {
+	uint32_t  caps;
+	uint32_t  pb_chn;
+	uint32_t  cp_chn;
+	int32_t   n_items;
+	int64_t   db_min;
+	int64_t   db_max;
+	int64_t   db_step;
+	uint32_t  name_len;
+	int64_t   db_val;  //< controls without numid
+	int64_t   sel_val; //< controls without numid
+	CacheElem cv;
+	CacheElem cs;
+} CacheCtrl;
+
+typedef struct {
+	const char* p;
+	const char* end;
+} CacheReader;
+
+static bool cache_read (CacheReader* r, void* dst, size_t len)
+{
+	if ((size_t)(r->end - r->p) < len) {
+		return false;
+	}
+	memcpy (dst, r->p, len);
+	r->p += len;
+	return true;
+}
+
+/* length-prefixed string, not terminated */
+static const char* cache_str (CacheReader* r, uint32_t* len)
+{
+	if (!cache_read (r, len, sizeof (uint32_t)) || (size_t)(r->end - r->p) < *len) {
+		return NULL;
+	}
+	const char* s = r->p;
+	r->p += *len;
+	return s;
+}
+
+static bool cache_write_str (FILE* f, const char* s)
+{
+	const uint32_t len = strlen (s);
+	return fwrite (&len, sizeof (uint32_t), 1, f) == 1 && fwrite (s, 1, len, f) == len;
+}
+
+static void cache_elem_store (CacheElem* ce, SmCtlElem const* e)
+{
+	memset (ce, 0, sizeof (CacheElem));
+	if (!e->numid) {
+		return;
+	}
+	ce->numid = e->numid;
+	ce->count = e->count;
+	ce->type  = e->type;
+	ce->min   = e->min;
+	ce->max   = e->max;
+	ce->value = ctl_get (e);
+	if (e->tlv) {
+		memcpy (ce->tlv, e->tlv, sizeof (ce->tlv));
+	}
+}
+
+static void cache_elem_load (SmArena* a, SmCtlElem* e, CacheElem const* ce)
+{
+	if (!ce->numid) {
+		e->numid = 0;
+		return;
+	}
+	e->ctl   = NULL;
+	e->numid = ce->numid;
+	e->count = ce->count;
+	e->type  = (snd_ctl_elem_type_t)ce->type;
+	e->min   = ce->min;
+	e->max   = ce->max;
+	if (e->type == SND_CTL_ELEM_TYPE_INTEGER) {
+		e->tlv = sm_arena_alloc (a, SM_TLV_MAX * sizeof (unsigned int));
+		memcpy (e->tlv, ce->tlv, SM_TLV_MAX * sizeof (unsigned int));
+	}
+	e->val = sm_arena_alloc (a, snd_ctl_elem_value_sizeof ());
+	snd_ctl_elem_value_set_numid (e->val, e->numid);
+	ctl_fill (e, ce->value);
+}
+
+int sm_cache_save (SmMixer* m, const char* path)
+{
+	SmDevice const* d = m->device;
+	if (!m->mixer) {
+		return -1;
+	}
+	char* tmp = malloc (strlen (path) + 5);
+	if (!tmp) {
+		return -1;
+	}
+	sprintf (tmp, "%s.tmp", path);
+	FILE* f = fopen (tmp, "wb");
+	if (!f) {
+		free (tmp);
+		return -1;
+	}
+
+	const uint32_t hdr[3] = { CACHE_MAGIC, SM_API_VERSION, m->ctrl_cnt };
+	bool ok = fwrite (hdr, sizeof (hdr), 1, f) == 1
+		&& fwrite (d, sizeof (SmDevice), 1, f) == 1
+		&& fwrite (d->out_gain_map, sizeof (int), d->num_gain, f) == d->num_gain
+		&& fwrite (d->out_bus_map, sizeof (int), d->num_bus, f) == d->num_bus
+		&& fwrite (d->hiz_map, sizeof (int), d->num_hiz, f) == d->num_hiz
+		&& fwrite (d->pad_map, sizeof (int), d->num_pad, f) == d->num_pad
+		&& fwrite (d->air_map, sizeof (int), d->num_air, f) == d->num_air
+		&& fwrite (d->out_gain_labels, SM_LABEL_LEN, d->num_label, f) == d->num_label;
+
+	for (unsigned int i = 0; ok && i < m->ctrl_cnt; ++i) {
+		SmCtrl* c = &m->ctrl[i];
+		CacheCtrl cc;
+		memset (&cc, 0, sizeof (CacheCtrl));
+		cc.caps     = c->caps;
+		cc.pb_chn   = c->pb_chn;
+		cc.cp_chn   = c->cp_chn;
+		cc.n_items  = (c->caps & SM_CAP_ENUM) ? c->n_items : 0;
+		cc.db_min   = c->db_min;
+		cc.db_max   = c->db_max;
+		cc.db_step  = c->db_step;
+		cc.name_len = strlen (c->name);
+		cache_elem_store (&cc.cv, &c->cv);
+		cache_elem_store (&cc.cs, &c->cs);
+		if ((c->caps & (SM_CAP_PVOL | SM_CAP_CVOL)) && !c->cv.numid) {
+			cc.db_val = lrintf (sm_get_dB (c) * 100.f);
+		}
+		if (!c->cs.numid) {
+			if (c->caps & SM_CAP_ENUM) {
+				cc.sel_val = sm_get_enum (c);
+			} else if (c->caps & SM_CAP_PSW) {
+				cc.sel_val = sm_get_mute (c) ? 0 : 1;
+			} else if (c->caps & SM_CAP_CSW) {
+				cc.sel_val = sm_get_switch (c) ? 1 : 0;
+			}
+		}
+		ok = fwrite (&cc, sizeof (CacheCtrl), 1, f) == 1 && fwrite (c->name, 1, cc.name_len, f) == cc.name_len;
+		for (int k = 0; ok && k < cc.n_items; ++k) {
+			char name[64] = "";
+			sm_get_enum_name (c, k, name, sizeof (name));
+			ok = cache_write_str (f, name);
+		}
+	}
+	ok &= fclose (f) == 0;
+	ok = ok && rename (tmp, path) == 0;
+	if (!ok) {
+		unlink (tmp);
+	}
+	free (tmp);
+	return ok ? 0 : -1;
+}
+
+/* walk the control records; only compute the arena size if m is NULL */
+static bool cache_ctrls (CacheReader* r, SmMixer* m, unsigned int cnt, size_t* size)
+{
+	for (unsigned int i = 0; i < cnt; ++i) {
+		CacheCtrl cc;
+		uint32_t len;
+		if (!cache_read (r, &cc, sizeof (CacheCtrl)) || (size_t)(r->end - r->p) < cc.name_len || cc.n_items < 0) {
+			return false;
+		}
+		const char* name = r->p;
+		r->p += cc.name_len;
+
+		if (!m) {
+			*size += sm_arena_round (cc.name_len + 1) + sm_arena_round (cc.n_items * sizeof (char*));
+			for (int k = 0; k < cc.n_items; ++k) {
+				if (!cache_str (r, &len)) {
+					return false;
+				}
+				*size += sm_arena_round (len + 1);
+			}
+			continue;
+		}
+
+		SmCtrl* c = &m->ctrl[i];
+		c->index   = i;
+		c->name    = sm_arena_alloc (&m->arena, cc.name_len + 1);
+		memcpy (c->name, name, cc.name_len);
+		c->caps    = cc.caps;
+		c->pb_chn  = cc.pb_chn;
+		c->cp_chn  = cc.cp_chn;
+		c->n_items = cc.n_items;
+		c->db_min  = cc.db_min;
+		c->db_max  = cc.db_max;
+		c->db_step = cc.db_step;
+		cache_elem_load (&m->arena, &c->cv, &cc.cv);
+		cache_elem_load (&m->arena, &c->cs, &cc.cs);
+		c->db_val   = cc.db_val;
+		c->db_valid = !c->cv.numid;
+		c->sel_val  = cc.sel_val;
+		if (cc.n_items > 0) {
+			c->items = sm_arena_alloc (&m->arena, cc.n_items * sizeof (char*));
+		}
+		for (int k = 0; k < cc.n_items; ++k) {
+			const char* item = cache_str (r, &len);
+			c->items[k] = sm_arena_alloc (&m->arena, len + 1);
+			memcpy (c->items[k], item, len);
+		}
+	}
+	return true;
+}
+
+static bool cache_parse (SmMixer* m, CacheReader* r)
+{
+	uint32_t hdr[3];
+	SmDevice d;
+
+	if (!cache_read (r, hdr, sizeof (hdr)) || hdr[0] != CACHE_MAGIC || hdr[1] != SM_API_VERSION || hdr[2] == 0
+	    || !cache_read (r, &d, sizeof (SmDevice))) {
+		return false;
+	}
+
+	/* maps, in device_dup() order */
+	const size_t n_maps = (d.num_gain + d.num_bus + d.num_hiz + d.num_pad + d.num_air) * sizeof (int) + d.num_label * SM_LABEL_LEN;
+	int* maps = malloc (n_maps + 1);
+	if (!maps || !cache_read (r, maps, n_maps)) {
+		free (maps);
+		return false;
+	}
+	d.out_gain_map    = maps;
+	d.out_bus_map     = d.out_gain_map + d.num_gain;
+	d.hiz_map         = d.out_bus_map + d.num_bus;
+	d.pad_map         = d.hiz_map + d.num_hiz;
+	d.air_map         = d.pad_map + d.num_pad;
+	d.out_gain_labels = (char (*)[SM_LABEL_LEN])(d.air_map + d.num_air);
+	m->device = device_dup (&d);
+	free (maps);
+	if (!m->device) {
+		return false;
+	}
+
+	/* size the arena, then fill */
+	const CacheReader ctrls = *r;
+	size_t size = sm_arena_round (hdr[2] * sizeof (SmCtrl)) + ctl_arena_size (hdr[2]);
+	if (!cache_ctrls (r, NULL, hdr[2], &size) || !sm_arena_init (&m->arena, size)) {
+		return false;
+	}
+	m->ctrl     = sm_arena_alloc (&m->arena, hdr[2] * sizeof (SmCtrl));
+	m->ctrl_cnt = hdr[2];
+	*r = ctrls;
+	return cache_ctrls (r, m, m->ctrl_cnt, &size);
+}
+
+int sm_cache_load (SmMixer* m, const char* path)
+{
+	memset (m, 0, sizeof (SmMixer));
+
+	FILE* f = fopen (path, "rb");
+	if (!f) {
+		return -1;
+	}
+	fseek (f, 0, SEEK_END);
+	const long fsize = ftell (f);
+	fseek (f, 0, SEEK_SET);
+	char* buf = fsize > 0 ? malloc (fsize) : NULL;
+	if (!buf || fread (buf, 1, fsize, f) != (size_t)fsize) {
+		free (buf);
+		fclose (f);
+		return -1;
+	}
+	fclose (f);
+
+	CacheReader r = { buf, buf + fsize };
+	const bool ok = cache_parse (m, &r);
+	free (buf);
+	if (!ok) {
+		sm_close (m);
+		return -1;
+	}
+	return 0;
+}
+
+/* *****************************************************************************
+ * Device discovery
+ */
+
+#define DEV_HASH_SIZE 16 // power of two, > NUM_DEVICES
+
+static int dev_hash[DEV_HASH_SIZE]; // devices[] index + 1, 0: empty
+
+static unsigned usb_id_hash (unsigned usb_id)
+{
+	return ((usb_id * 2654435761u) >> 16) & (DEV_HASH_SIZE - 1);
+}
+
+static void dev_hash_init (void)
+{
+	static bool initialized = false;
+	if (initialized) {
+		return;
+	}
+	assert (NUM_DEVICES < DEV_HASH_SIZE);
+	for (unsigned i = 0; i < NUM_DEVICES; ++i) {
+		if (devices[i].usb_id == 0) {
+			continue;
+		}
+		unsigned h = usb_id_hash (devices[i].usb_id);
+		while (dev_hash[h]) {
+			h = (h + 1) & (DEV_HASH_SIZE - 1);
+		}
+		dev_hash[h] = i + 1;
+	}
+	initialized = true;
+}
+
+static SmDevice const* device_by_usb_id (unsigned usb_id)
+{
+	dev_hash_init ();
+	for (unsigned h = usb_id_hash (usb_id); dev_hash[h]; h = (h + 1) & (DEV_HASH_SIZE - 1)) {
+		if (devices[dev_hash[h] - 1].usb_id == usb_id) {
+			return &devices[dev_hash[h] - 1];
+		}
+	}
+	return NULL;
+}
+
+static SmDevice const* device_by_name (const char* card_name)
+{
+	for (unsigned i = 0; i < NUM_DEVICES; i++) {
+		if (!strcmp (card_name, devices[i].name)) {
+			return &devices[i];
+		}
+	}
+	return NULL;
+}
+
+/* read card list and USB IDs from procfs, without opening any device.
+ * returns number of cards, or -1 if procfs is not available */
+static int scan_cards_proc (SmCardInfo* cards, int max_cards)
+{
+	FILE* f = fopen ("/proc/asound/cards", "r");
+	if (!f) {
+		return -1;
+	}
+	int n_cards = 0;
+	char line[256];
+	while (n_cards < max_cards && fgets (line, sizeof (line), f)) {
+		SmCardInfo* ci = &cards[n_cards];
+		/* " 2 [USB            ]: USB-Audio - Scarlett 18i8 USB" */
+		if (sscanf (line, "%d [%*[^]]]: %*s - %63[^\n]", &ci->number, ci->name) != 2) {
+			continue; // long name, 2nd line
+		}
+
+		char path[64];
+		unsigned vendor, product;
+		snprintf (path, sizeof (path), "/proc/asound/card%d/usbid", ci->number);
+		FILE* u = fopen (path, "r");
+		if (u && fscanf (u, "%x:%x", &vendor, &product) == 2) {
+			ci->usb_id = SM_USB_ID (vendor, product);
+		} else {
+			ci->usb_id = 0;
+		}
+		if (u) {
+			fclose (u);
+		}
+
+		ci->device = ci->usb_id ? device_by_usb_id (ci->usb_id) : NULL;
+		if (!ci->device) {
+			ci->device = device_by_name (ci->name);
+		}
+		++n_cards;
+	}
+	fclose (f);
+	return n_cards;
+}
+
+/* fallback: ask every card's control device */
+static int scan_cards_ctl (SmCardInfo* cards, int max_cards)
+{
+	snd_ctl_card_info_t* info;
+	snd_ctl_card_info_alloca(&info);
+	int number = -1;
+	int n_cards = 0;
+	while (n_cards < max_cards) {
+		int err = snd_card_next(&number);
+		if (err < 0 || number < 0) {
+			break;
+		}
+		snd_ctl_t* ctl;
+		char buf[16];
+		sprintf (buf, "hw:%d", number);
+		err = snd_ctl_open(&ctl, buf, 0);
+		if (err < 0) {
+			continue;
+		}
+		err = snd_ctl_card_info(ctl, info);
+		snd_ctl_close(ctl);
+		if (err < 0) {
+			continue;
+		}
+		const char* card_name = snd_ctl_card_info_get_name (info);
+		if (!card_name) {
+			continue;
+		}
+		SmCardInfo* ci = &cards[n_cards++];
+		ci->number = number;
+		ci->usb_id = 0;
+		strncpy (ci->name, card_name, sizeof (ci->name) - 1);
+		ci->name[sizeof (ci->name) - 1] = '\0';
+		ci->device = device_by_name (card_name);
+	}
+	return n_cards;
+}
+
+int sm_scan_cards (SmCardInfo* cards, int max_cards)
+{
+	int n_cards = scan_cards_proc (cards, max_cards);
+	if (n_cards < 0) {
+		n_cards = scan_cards_ctl (cards, max_cards);
+	}
+	if (verbose > 1) {
+		for (int i = 0; i < n_cards; ++i) {
+			printf ("* hw:%d \"%s\" [%04x:%04x]\n", cards[i].number, cards[i].name,
+					cards[i].usb_id >> 16, cards[i].usb_id & 0xffff);
+		}
+	}
+	return n_cards;
+}
+
+char* sm_lookup_card (void)
+{
+	SmCardInfo cards[SM_MAX_CARDS];
+	char* card = NULL;
+	int n_cards = sm_scan_cards (cards, SM_MAX_CARDS);
+
+	for (int i = 0; i < n_cards && !card; ++i) {
+		if (cards[i].device) {
+			char buf[16];
+			sprintf (buf, "hw:%d", cards[i].number);
+			card = strdup (buf);
+		}
+	}
+	if (verbose > 0 && NULL != card) {
+		printf ("Autodetect: Using \"%s\"\n", card);
+	}
+	return card;
+}
@@ -0,0 +1,192 @@
+/* libscarlettmixer - control the mixer of Focusrite Scarlett USB devices
+ *
+ * Copyright 2015-2019 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#ifndef SCARLETTMIXER_H
+#define SCARLETTMIXER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* bumped on incompatible changes of the structs or functions below */
+#define SM_API_VERSION 2
+
+#define SM_USB_ID(vendor, product) (((vendor) << 16) | (product))
+
+#define SM_LABEL_LEN 16
+
+/* *****************************************************************************
+ * Device descriptor
+ *
+ * Per-role maps are contiguous arrays of control indices, sized by the
+ * corresponding num_* count. Presets use static compound literals,
+ * autodetected descriptors are a single allocation.
+ */
+
+typedef struct {
+	char        name[64];
+	unsigned    usb_id; //< USB vendor/product, 0 if unknown
+	unsigned    smi;  //< mixer matrix inputs
+	unsigned    smo;  //< mixer matrix outputs
+	unsigned    sin;  //< inputs (capture select)
+	unsigned    sout; //< outputs assigns
+	unsigned    smst; //< main outputs (stereo gain controls w/mute =?= sout / 2)
+	unsigned    samo; //< aux outputs (mono gain controls w/o mute)
+
+	unsigned    num_hiz;
+	unsigned    num_pad;
+	unsigned    num_air;
+	unsigned    num_gain;  //< size of out_gain_map
+	unsigned    num_bus;   //< size of out_bus_map
+	unsigned    num_label; //< size of out_gain_labels
+	bool        pads_are_switches;
+	bool        matrix_mix_column_major;
+	unsigned    matrix_mix_offset;
+	unsigned    matrix_mix_stride;
+	unsigned    matrix_in_offset;
+	unsigned    matrix_in_stride;
+	unsigned    input_offset;
+	int*        out_gain_map;
+	char      (*out_gain_labels)[SM_LABEL_LEN];
+	int*        out_bus_map;
+	int*        hiz_map;
+	int*        pad_map;
+	int*        air_map;
+} SmDevice;
+
+/* number of built-in presets, and preset by index */
+unsigned int    sm_device_count (void);
+SmDevice const* sm_device_preset (unsigned int i);
+
+bool sm_device_equal (SmDevice const* a, SmDevice const* b);
+void sm_device_free (SmDevice* d);
+
+/* number of output selectors without gain control */
+unsigned int sm_n_sel_lbl (SmDevice const* d);
+
+/* *****************************************************************************
+ * Controls
+ */
+
+#define SM_CAP_ENUM (1<<0) //< enumerated
+#define SM_CAP_PSW  (1<<1) //< playback switch
+#define SM_CAP_CSW  (1<<2) //< capture switch
+#define SM_CAP_PVOL (1<<3) //< playback volume
+#define SM_CAP_CVOL (1<<4) //< capture volume
+
+typedef struct SmCtrl SmCtrl;
+
+const char*  sm_ctrl_name (SmCtrl const* c);
+unsigned int sm_ctrl_caps (SmCtrl const* c);
+
+/* *****************************************************************************
+ * Mixer
+ */
+
+#define SM_PROBE  (1<<0) //< print the controls of the device
+#define SM_DETECT (1<<1) //< map controls by name, fall back to the preset
+#define SM_SELEM  (1<<2) //< use the simple-mixer API instead of control numids
+
+typedef struct SmMixer SmMixer;
+
+SmMixer* sm_mixer_new (void);
+void     sm_mixer_free (SmMixer* m); //< closes the mixer
+
+/* open the given card ("hw:N"), returns 0 on success, the mixer
+ * is closed on failure. With SM_PROBE, the controls of unsupported
+ * devices are listed before failing */
+int  sm_open (SmMixer* m, const char* card, int opts);
+void sm_close (SmMixer* m);
+
+/* drop alsa handles, keep the device and the control table (names, caps) */
+void sm_detach (SmMixer* m);
+
+SmDevice const* sm_device (SmMixer const* m);
+unsigned int    sm_ctrl_count (SmMixer const* m);
+SmCtrl*         sm_ctrl (SmMixer* m, unsigned int i);
+
+/* store the device layout and the current values, and load them as a
+ * detached mixer (values can be read, not written). Return 0 on success */
+int  sm_cache_save (SmMixer* m, const char* path);
+int  sm_cache_load (SmMixer* m, const char* path);
+
+/* verbosity of the diagnostics printed to stdout, default 0 */
+void sm_set_verbose (int level);
+
+/* mixer-matrix ; colums(src) x rows (dest), NULL if out of range */
+SmCtrl* sm_matrix_ctrl_cr (SmMixer* m, unsigned int c, unsigned int r);
+SmCtrl* sm_matrix_ctrl_n (SmMixer* m, unsigned int n);
+SmCtrl* sm_matrix_sel (SmMixer* m, unsigned int r);
+SmCtrl* sm_src_sel (SmMixer* m, unsigned int r);
+SmCtrl* sm_out_gain (SmMixer* m, unsigned int c);
+SmCtrl* sm_aux_gain (SmMixer* m, unsigned int c);
+SmCtrl* sm_out_sel (SmMixer* m, unsigned int c);
+SmCtrl* sm_hiz (SmMixer* m, unsigned int c);
+SmCtrl* sm_pad (SmMixer* m, unsigned int c);
+SmCtrl* sm_air (SmMixer* m, unsigned int c);
+SmCtrl* sm_mst_gain (SmMixer* m);
+
+const char* sm_out_gain_label (SmMixer* m, int n);
+const char* sm_aux_gain_label (SmMixer* m, int n);
+const char* sm_out_select_label (SmMixer* m, int n);
+
+/* factory defaults of the selectors */
+int sm_src_sel_default (unsigned int r, int max_values);
+int sm_out_sel_default (unsigned int c);
+
+/* control values, dB are clamped and quantised to the control's steps.
+ * Writes to a detached mixer or one loaded from a cache are ignored */
+void  sm_set_mute (SmCtrl* c, bool muted);
+bool  sm_get_mute (SmCtrl* c);
+void  sm_set_dB (SmCtrl* c, float dB);
+float sm_get_dB (SmCtrl* c);
+float sm_get_dB_range (SmCtrl* c, bool maximum);
+void  sm_set_enum (SmCtrl* c, int v);
+int   sm_get_enum (SmCtrl* c);
+int   sm_get_enum_name (SmCtrl* c, int i, char* name, size_t len);
+void  sm_set_switch (SmCtrl* c, bool on);
+bool  sm_get_switch (SmCtrl* c);
+
+/* *****************************************************************************
+ * Device discovery
+ */
+
+#define SM_MAX_CARDS 32
+
+typedef struct {
+	int             number;
+	unsigned        usb_id;
+	char            name[64];
+	SmDevice const* device; //< matching preset, NULL if unsupported
+} SmCardInfo;
+
+/* list soundcards without opening them, returns the number of cards */
+int sm_scan_cards (SmCardInfo* cards, int max_cards);
+
+/* first supported card as "hw:N" (free() it), or NULL */
+char* sm_lookup_card (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,147 @@
+/* libscarlettmixer - control the mixer of Focusrite Scarlett USB devices
+ *
+ * Copyright 2015-2019 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* library internals, shared with the GUI; not installed and not
+ * covered by SM_API_VERSION */
+#ifndef SCARLETTMIXER_PRIVATE_H
+#define SCARLETTMIXER_PRIVATE_H
+
+#include <alsa/asoundlib.h>
+
+#include "scarlettmixer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* *****************************************************************************
+ * Matrix layout of the built-in presets
+ *
+ * Used for the device table and for the matrix kernels of the GUI, which are
+ * specialised at compile time. Per preset: name, smi, smo, column-major,
+ * mix offset, mix stride, input offset, input stride.
+ */
+
+#define SM_MATRIX_s18i6  "Scarlett 18i6 USB",  18, 6, false, 33, 7, 32, 7
+#define SM_MATRIX_s18i8  "Scarlett 18i8 USB",  18, 8, false, 40, 9, 39, 9 // Matrix 01 Mix A, Matrix 01 Input
+#define SM_MATRIX_s6i6   "Scarlett 6i6 USB",    6, 6, false, 26, 9, 25, 9 // XXX stride should be 7, bug in kernel-driver ?!
+#define SM_MATRIX_s18i20 "Scarlett 18i20 USB", 18, 8, false, 50, 9, 49, 9
+#define SM_MATRIX_s8i6   "Scarlett 8i6 USB",    8, 8, true,  20, 8, 84, 1
+
+/* X (id) for every preset, in device table order */
+#define SM_MATRIX_PRESETS(X) X (s18i6) X (s18i8) X (s6i6) X (s18i20) X (s8i6)
+
+/* designated initializers of an SmDevice */
+#define SM_MATRIX_FIELDS(ID) SM_MATRIX_FIELDS_X (SM_MATRIX_##ID)
+#define SM_MATRIX_FIELDS_X(P) SM_MATRIX_FIELDS_ (P)
+#define SM_MATRIX_FIELDS_(NAME, SMI, SMO, COLMAJ, MIX_OFF, MIX_STRIDE, IN_OFF, IN_STRIDE) \
+	.name = NAME, .smi = SMI, .smo = SMO,                                                  \
+	.matrix_mix_column_major = COLMAJ,                                                     \
+	.matrix_mix_offset = MIX_OFF, .matrix_mix_stride = MIX_STRIDE,                         \
+	.matrix_in_offset = IN_OFF, .matrix_in_stride = IN_STRIDE
+
+/* *****************************************************************************
+ * Memory arena, one allocation for a fixed set of tables
+ */
+
+typedef struct {
+	char*    base;
+	size_t   size;
+	size_t   used;
+	unsigned n_alloc; //< number of sub-allocations
+} SmArena;
+
+size_t sm_arena_round (size_t size);
+bool   sm_arena_init (SmArena* a, size_t size);
+void*  sm_arena_alloc (SmArena* a, size_t size);
+char*  sm_arena_strdup (SmArena* a, const char* str);
+void   sm_arena_free (SmArena* a);
+
+/* *****************************************************************************
+ * Controls
+ */
+
+#define SM_TLV_MAX 64 //< max. dB scale size, in words
+
+/* kernel control element, accessed by numid */
+typedef struct {
+	snd_ctl_t*            ctl;
+	snd_ctl_elem_value_t* val;   //< last known value, also write template
+	unsigned int*         tlv;   //< dB scale, SM_TLV_MAX words
+	unsigned int          numid; //< 0: not resolved, use simple-mixer API
+	unsigned int          count; //< number of channels
+	snd_ctl_elem_type_t   type;
+	long                  min;
+	long                  max;
+} SmCtlElem;
+
+struct SmCtrl {
+	snd_mixer_elem_t* elem;
+	char* name;
+	unsigned int index; //< position in SmMixer.ctrl
+
+	SmCtlElem cv; //< volume
+	SmCtlElem cs; //< switch or enum
+
+	/* cached at enumeration time */
+	unsigned int caps;    //< SM_CAP_* flags
+	unsigned int pb_chn;  //< bitmask of playback channels
+	unsigned int cp_chn;  //< bitmask of capture channels
+	int          n_items; //< enum item count
+	long         db_min;  //< dB * 100
+	long         db_max;  //< dB * 100
+	long         db_step; //< quantisation, dB * 100 (0: none)
+	long         db_val;  //< last known value, dB * 100
+	bool         db_valid;
+	bool         changed; //< set when the device reports a new value, cleared by the caller
+	char**       items;   //< enum item names of a mixer loaded from a cache, else NULL
+	long         sel_val; //< switch or enum value of a cached control without numid
+};
+
+/* dB * 100 of a raw kernel value of the volume control,
+ * false if the control is not accessed by numid */
+bool sm_raw_to_dB (SmCtrl const* c, long raw, long* dB);
+
+/* *****************************************************************************
+ * Mixer
+ */
+
+struct SmMixer {
+	SmDevice*    device;
+	SmCtrl*      ctrl;
+	unsigned int ctrl_cnt;
+	snd_mixer_t* mixer;  //< NULL while detached
+	SmArena      arena;  //< ctrl table and names
+};
+
+/* control write statistics, process-wide */
+#define SM_WSTAT_RING 1024
+
+typedef struct {
+	uint64_t n_writes;
+	uint32_t lat[SM_WSTAT_RING]; //< usec, most recent writes
+} SmWriteStats;
+
+SmWriteStats const* sm_write_stats (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,26 @@
+/* static tracepoints, see contrib/bpftrace/
+ *
+ * Copyright 2015-2019 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ */
+#ifndef SCARLETT_TRACE_H
+#define SCARLETT_TRACE_H
+
+#ifdef HAVE_SDT
+# include <sys/sdt.h>
+# define TRACE0(name)          DTRACE_PROBE (scarlett_mixer, name)
+# define TRACE1(name, a)       DTRACE_PROBE1 (scarlett_mixer, name, a)
+# define TRACE2(name, a, b)    DTRACE_PROBE2 (scarlett_mixer, name, a, b)
+# define TRACE3(name, a, b, c) DTRACE_PROBE3 (scarlett_mixer, name, a, b, c)
+#else
+# define TRACE0(name)
+# define TRACE1(name, a)
+# define TRACE2(name, a, b)
+# define TRACE3(name, a, b, c)
+#endif
+
+#endif